@@ -9,6 +9,12 @@ varying float brightness;
 uniform int numRandomsPerParticle;
 uniform int textureRowSize;
 uniform float time;
+// offsets from calculatePositionNoise() at noiseFieldSize x noiseFieldSize
+// points from -noiseFieldExtent to noiseFieldExtent (see NoiseField.h),
+// or noiseFieldSize 0 to evaluate the noise here
+uniform sampler2D NoiseField;
+uniform float noiseFieldSize;
+uniform float noiseFieldExtent;
 
 int randomCount = -1;
 float id;
@@ -217,6 +223,15 @@ vec4 calculatePositionNoise(float x, float y)
 	return vec4(cos(2*pi*noise+noise3), sin(2*pi*noise+noise3), 0, 0)*(0.1015+(noise2*0.02-0.05) + 0.03*noise3);
 }
 
+vec4 positionNoise(float x, float y)
+{
+	if (noiseFieldSize < 2.)
+		return calculatePositionNoise(x, y);
+	// grid point k is at -extent + k*spacing, and its texel's centre at (k+.5)/size
+	vec2 k = (vec2(x, y) + noiseFieldExtent) / (2.*noiseFieldExtent) * (noiseFieldSize-1.);
+	return vec4(texture2D(NoiseField, (k + .5)/noiseFieldSize).xy, 0, 0);
+}
+
 float ups_sq(float x)
 {
 	return 1. - (1.-x)*(1.-x);
@@ -247,7 +262,7 @@ void main()
 	amount = gl_Vertex.w;
 //	gl_Position = vec4(gl_Vertex.xy, 0, 1);
 //	gl_Position = getPosition();
-	gl_Position += calculatePositionNoise(gl_Position.x, gl_Position.y)*0.24;//*rand();
+	gl_Position += positionNoise(gl_Position.x, gl_Position.y)*0.24;//*rand();
 	gl_Position.z = 0;
 	//	Uv = gl_MultiTexCoord0.st;
 	gl_PointSize = 2.05*(20.12*(1+2*cos(rand())-0.5)*0.7*amount*.75);// + (6 + 6)*amount);
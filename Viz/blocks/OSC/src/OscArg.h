@@ -28,6 +28,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace cinder { namespace osc { 
 	
@@ -107,6 +108,24 @@ typedef enum _ArgType
 	private:
 		std::string value;
 	};
+	
+	class ArgBlob : public Arg
+	{
+	public:
+		ArgBlob( const void* _data, size_t _size ) : value( (const char*)_data, (const char*)_data + _size ) {}
+		
+		/// return the type of this argument
+		ArgType getType() const { return TYPE_BLOB; }
+		std::string getTypeName() const { return "blob"; }
+		
+		/// return value
+		const std::vector<char>& get() const { return value; }
+		/// set value
+		void set( const void* _data, size_t _size ) { value.assign( (const char*)_data, (const char*)_data + _size ); }
+		
+	private:
+		std::vector<char> value;
+	};
 
 } // namespace osc
 } // namespace cinder
\ No newline at end of file
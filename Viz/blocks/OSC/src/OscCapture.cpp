@@ -0,0 +1,167 @@
+#include "OscCapture.h"
+
+#include <cstring>
+
+#if ! defined( _WIN32 )
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace cinder { namespace osc {
+
+static const char CAPTURE_MAGIC[8] = { 'O', 'S', 'C', 'C', 'A', 'P', 'T', '\0' };
+static const uint32_t CAPTURE_VERSION = 1;
+
+static size_t paddedSize( size_t size )
+{
+	return ( size + 7 ) & ~size_t( 7 );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CaptureWriter
+CaptureWriter::CaptureWriter()
+	: mFile( NULL )
+{
+}
+
+CaptureWriter::~CaptureWriter()
+{
+	close();
+}
+
+bool CaptureWriter::open( const std::string &path )
+{
+	close();
+	mFile = fopen( path.c_str(), "wb" );
+	if( ! mFile )
+		return false;
+
+	CaptureFileHeader header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, CAPTURE_MAGIC, sizeof( header.magic ) );
+	header.version = CAPTURE_VERSION;
+	fwrite( &header, sizeof( header ), 1, mFile );
+	return true;
+}
+
+void CaptureWriter::close()
+{
+	if( mFile ) {
+		fclose( mFile );
+		mFile = NULL;
+	}
+}
+
+void CaptureWriter::write( uint64_t timestamp, const char *data, int size, uint32_t address, uint16_t port )
+{
+	if( ! mFile || size < 0 )
+		return;
+
+	CaptureRecordHeader record;
+	memset( &record, 0, sizeof( record ) );
+	record.timestamp = timestamp;
+	record.size = uint32_t( size );
+	record.address = address;
+	record.port = port;
+
+	static const char padding[8] = { 0 };
+	fwrite( &record, sizeof( record ), 1, mFile );
+	fwrite( data, 1, size, mFile );
+	fwrite( padding, 1, paddedSize( size ) - size, mFile );
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CaptureReader
+CaptureReader::CaptureReader()
+	: mData( NULL ), mSize( 0 ), mOffset( 0 )
+{
+}
+
+CaptureReader::~CaptureReader()
+{
+	close();
+}
+
+bool CaptureReader::open( const std::string &path )
+{
+	close();
+
+#if defined( _WIN32 )
+	FILE *file = fopen( path.c_str(), "rb" );
+	if( ! file )
+		return false;
+	fseek( file, 0, SEEK_END );
+	long size = ftell( file );
+	fseek( file, 0, SEEK_SET );
+	mBuffer.resize( size > 0 ? size : 0 );
+	size_t read = mBuffer.empty() ? 0 : fread( &mBuffer[0], 1, mBuffer.size(), file );
+	fclose( file );
+	if( read < sizeof( CaptureFileHeader ) )
+		return false;
+	mData = &mBuffer[0];
+	mSize = read;
+#else
+	int fd = ::open( path.c_str(), O_RDONLY );
+	if( fd < 0 )
+		return false;
+	struct stat info;
+	if( fstat( fd, &info ) != 0 || size_t( info.st_size ) < sizeof( CaptureFileHeader ) ) {
+		::close( fd );
+		return false;
+	}
+	void *mapped = mmap( NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	::close( fd );
+	if( mapped == MAP_FAILED )
+		return false;
+	mData = static_cast<const char*>( mapped );
+	mSize = info.st_size;
+#endif
+
+	const CaptureFileHeader *header = reinterpret_cast<const CaptureFileHeader*>( mData );
+	if( memcmp( header->magic, CAPTURE_MAGIC, sizeof( header->magic ) ) != 0 || header->version != CAPTURE_VERSION ) {
+		close();
+		return false;
+	}
+	rewind();
+	return true;
+}
+
+void CaptureReader::close()
+{
+#if defined( _WIN32 )
+	mBuffer.clear();
+#else
+	if( mData )
+		munmap( const_cast<char*>( mData ), mSize );
+#endif
+	mData = NULL;
+	mSize = 0;
+	mOffset = 0;
+}
+
+bool CaptureReader::next( Packet *packet )
+{
+	if( ! mData || mOffset + sizeof( CaptureRecordHeader ) > mSize )
+		return false;
+	const CaptureRecordHeader *record = reinterpret_cast<const CaptureRecordHeader*>( mData + mOffset );
+	const size_t dataOffset = mOffset + sizeof( CaptureRecordHeader );
+	if( record->size > mSize - dataOffset )
+		return false;
+
+	packet->timestamp = record->timestamp;
+	packet->data = mData + dataOffset;
+	packet->size = int( record->size );
+	packet->address = record->address;
+	packet->port = record->port;
+	mOffset = dataOffset + paddedSize( record->size );
+	return true;
+}
+
+void CaptureReader::rewind()
+{
+	mOffset = sizeof( CaptureFileHeader );
+}
+
+} } // namespace cinder::osc
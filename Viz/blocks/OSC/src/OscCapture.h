@@ -0,0 +1,87 @@
+/*
+ OSC capture files: raw packets as they arrived, with their arrival times, so
+ that a show can be replayed later without the musicians.
+
+ Layout, in host byte order:
+   CaptureFileHeader (16 bytes)
+   any number of records, each a CaptureRecordHeader (24 bytes) followed by
+   the packet bytes, padded with zeros to a multiple of 8.
+
+ Records are only ever appended, and everything is 8-byte aligned, so a
+ capture can be memory mapped and walked in place. A record cut short by a
+ crash is simply treated as the end of the file.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace cinder { namespace osc {
+
+struct CaptureFileHeader {
+	char		magic[8];	//!< "OSCCAPT\0"
+	uint32_t	version;
+	uint32_t	reserved;
+};
+
+struct CaptureRecordHeader {
+	uint64_t	timestamp;	//!< arrival time, nanoseconds since the unix epoch
+	uint32_t	size;		//!< packet bytes, excluding padding
+	uint32_t	address;	//!< sender's IPv4 address
+	uint16_t	port;		//!< sender's port
+	uint16_t	reserved0;
+	uint32_t	reserved1;
+};
+
+class CaptureWriter {
+  public:
+	CaptureWriter();
+	~CaptureWriter();
+
+	//! Creates (or truncates) the file and writes the header. Returns false if it can't be opened.
+	bool open( const std::string &path );
+	void close();
+	bool isOpen() const { return mFile != NULL; }
+
+	void write( uint64_t timestamp, const char *data, int size, uint32_t address, uint16_t port );
+
+  private:
+	FILE		*mFile;
+};
+
+class CaptureReader {
+  public:
+	struct Packet {
+		uint64_t	timestamp;
+		const char	*data;
+		int			size;
+		uint32_t	address;
+		uint16_t	port;
+	};
+
+	CaptureReader();
+	~CaptureReader();
+
+	//! Maps the file. Returns false if it can't be read or isn't a capture.
+	bool open( const std::string &path );
+	void close();
+	bool isOpen() const { return mData != NULL; }
+
+	//! Reads the next packet. Returns false at the end. \a packet's data stays valid until close().
+	bool next( Packet *packet );
+	//! Goes back to the first packet.
+	void rewind();
+
+  private:
+	const char	*mData;
+	size_t		mSize;
+	size_t		mOffset;
+#if defined( _WIN32 )
+	std::vector<char>	mBuffer;
+#endif
+};
+
+} } // namespace cinder::osc
@@ -27,12 +27,21 @@
 #include "cinder/Thread.h" 
 #include "cinder/Utilities.h"
 #include "OscListener.h"
+#include "OscCapture.h"
+#include "OscSharedMemory.h"
 #include "osc/OscTypes.h"
 #include "osc/OscPacketListener.h"
 #include "osc/OscReceivedElements.h"
 #include "ip/UdpSocket.h"
+#include "ip/PacketListener.h"
+#include "ip/NetworkingUtils.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <sstream>
+#include <vector>
 #include <assert.h>
 #include <deque>
 #include <map>
@@ -45,21 +54,66 @@ class OscListener : public ::osc::OscPacketListener {
 	OscListener();
 	~OscListener();
 	
-	void setup(int listen_port);
+	void setup(int listen_port, const std::string &multicastGroup);
+	
+	void setThreadCpu( int cpu ) { mThreadCpu = cpu; }
+	void setThreadRealtime( bool enabled ) { mThreadRealtime = enabled; }
+	void setBusyPoll( bool enabled ) { mBusyPoll = enabled; }
+	void setThreadStartedCallback( std::function<void (const char *name)> callback ) { mThreadStartedCallback = callback; }
+	std::string getThreadStatus() const;
+	Listener::WakeUpLatency getWakeUpLatency() const;
+	
+	uint64_t getNumPacketsReceived() const { return mNumPacketsReceived; }
+	uint64_t getNumDropped() const { return mNumDropped; }
+	size_t getNumWaitingMessages() const;
 	
 	bool hasWaitingMessages() const;
 	bool getNextMessage( Message * );
 
 	CallbackId	registerMessageReceived( std::function<void (const osc::Message*)> callback );
 	void		unregisterMessageReceived( CallbackId id );
+	void		setPacketProcessedCallback( std::function<void ()> callback ) { mPacketProcessedCallback = callback; }
 	
 	void shutdown();
 	
+	bool startRecording( const std::string &path );
+	void stopRecording();
+	bool isRecording() const;
+	
+	bool startReplay( const std::string &path, double speed );
+	void stopReplay();
+	bool startSteppedReplay( const std::string &path );
+	size_t advanceReplay( double seconds );
+	bool isReplaying() const;
+	
+	bool setupSharedMemory( const std::string &name, size_t capacity );
+	size_t pollSharedMemory();
+	uint64_t getNumSharedMemoryDropped() const;
+	
   protected:
+	virtual void ProcessPacket( const char *data, int size, const IpEndpointName& remoteEndpoint );
 	virtual void ProcessMessage( const ::osc::ReceivedMessage &m, const IpEndpointName& remoteEndpoint );
 	
   private:
+	//! Hands the wake-ups the shared memory writer sends to mWakeSocket back to the listener
+	class SharedMemoryWaker : public PacketListener {
+	  public:
+		explicit SharedMemoryWaker( OscListener *listener ) : mListener( listener ) {}
+		virtual void ProcessPacket( const char *data, int size, const IpEndpointName& remoteEndpoint ) { mListener->onSharedMemoryWritten(); }
+	  private:
+		OscListener *mListener;
+	};
+	
 	void threadSocket();
+	void threadReplay();
+	void recordPacket( const char *data, int size, const IpEndpointName& remoteEndpoint, unsigned long long timestamp );
+	//! Common to packets from the socket and from a replay
+	void processPacket( const char *data, int size, const IpEndpointName& remoteEndpoint, unsigned long long timestamp );
+	//! Has the socket thread read shared memory, once there is both a socket and a ring
+	void startReadingSharedMemory();
+	//! On the socket thread: empties the ring, then sleeps until the writer wakes it
+	void onSharedMemoryWritten();
+	size_t readSharedMemory();
 	
 	deque<Message*> mMessages;
 	
@@ -69,15 +123,58 @@ class OscListener : public ::osc::OscPacketListener {
 	std::shared_ptr<std::thread> mThread;
 	
 	CallbackMgr<void (const Message*)>	mMessageReceivedCbs;
+	std::function<void ()> mPacketProcessedCallback;
+	std::function<void (const char *name)> mThreadStartedCallback;
 	bool mSocketHasShutdown;
+	
+	int mThreadCpu;
+	bool mThreadRealtime;
+	bool mBusyPoll;
+	//! What the socket thread got of the above
+	std::string mThreadStatus;
+	
+	//! Kernel receive to ProcessPacket() times of the most recent packets, in nanoseconds
+	static const size_t NUM_WAKE_UP_SAMPLES = 1024;
+	uint64_t mWakeUpSamples[NUM_WAKE_UP_SAMPLES];
+	uint64_t mNumWakeUps;
+	mutable std::mutex mWakeUpMutex;
+	
+	//! Only one packet is processed at a time, whether from the socket or a replay
+	std::mutex mProcessMutex;
+	//! Arrival time of the packet being processed
+	unsigned long long mPacketTimestamp;
+	std::atomic<uint64_t> mNumPacketsReceived;
+	std::atomic<uint64_t> mNumDropped;
+	
+	CaptureWriter mRecorder;
+	mutable std::mutex mRecorderMutex;
+	
+	CaptureReader mReplayReader;
+	double mReplaySpeed;
+	std::shared_ptr<std::thread> mReplayThread;
+	std::atomic<bool> mReplayShouldStop;
+	std::atomic<bool> mReplayHasFinished;
+	//! Stepped replay: whether it is open, and the packet read but not yet due
+	bool mReplayIsStepped;
+	bool mReplayHasNextPacket;
+	CaptureReader::Packet mReplayNextPacket;
+	uint64_t mReplayFirstTimestamp;
+	
+	SharedMemoryRing mSharedMemory;
+	UdpReceiveSocket* mWakeSocket;
+	SharedMemoryWaker mSharedMemoryWaker;
+	std::atomic<bool> mSharedMemoryIsOnSocketThread;
 };
 
 OscListener::OscListener()
+	: mThreadCpu( -1 ), mThreadRealtime( false ), mBusyPoll( false ), mNumWakeUps( 0 ),
+	mPacketTimestamp( 0 ), mNumPacketsReceived( 0 ), mNumDropped( 0 ), mReplaySpeed( 1.0 ), mReplayShouldStop( false ), mReplayHasFinished( true ), mReplayIsStepped( false ), mReplayHasNextPacket( false ), mReplayFirstTimestamp( 0 ),
+	mWakeSocket( NULL ), mSharedMemoryWaker( this ), mSharedMemoryIsOnSocketThread( false )
 {
 	mListen_socket = NULL;
 }
 
-void OscListener::setup(int listen_port)
+void OscListener::setup(int listen_port, const std::string &multicastGroup)
 {
 	if (mListen_socket) {
 		shutdown();
@@ -85,9 +182,19 @@ void OscListener::setup(int listen_port)
 	
 	mSocketHasShutdown = false;
 	
-	mListen_socket = new UdpListeningReceiveSocket(IpEndpointName(IpEndpointName::ANY_ADDRESS, listen_port), this);
+	if( multicastGroup.empty() )
+		mListen_socket = new UdpListeningReceiveSocket(IpEndpointName(IpEndpointName::ANY_ADDRESS, listen_port), this);
+	else
+		mListen_socket = new UdpListeningReceiveSocket(IpEndpointName(IpEndpointName::ANY_ADDRESS, listen_port), IpEndpointName(multicastGroup.c_str()), this);
+	mListen_socket->EnableReceiveTimestamps();
+	mListen_socket->SetBusyPoll( mBusyPoll );
+	// the thread also sleeps on this, for the shared memory writer to wake it
+	mWakeSocket = new UdpReceiveSocket( IpEndpointName( 127, 0, 0, 1, IpEndpointName::ANY_PORT ) );
+	mListen_socket->AttachSocketListener( mWakeSocket, &mSharedMemoryWaker );
 
 	mThread = std::shared_ptr<std::thread>( new std::thread( &OscListener::threadSocket, this ) );
+	if( mSharedMemory.isOpen() )
+		startReadingSharedMemory();
 }
 
 void OscListener::shutdown() {
@@ -100,22 +207,88 @@ void OscListener::shutdown() {
 		
 		mThread->join();
 		
+		mSharedMemoryIsOnSocketThread = false;
+		mSharedMemory.setWakePort( 0 );
+		mListen_socket->DetachSocketListener( mWakeSocket, &mSharedMemoryWaker );
+		delete mWakeSocket;
+		mWakeSocket = NULL;
 		delete mListen_socket;
 		mListen_socket = NULL;
 	}
 }
 
 OscListener::~OscListener() {
+	stopReplay();
 	shutdown();
+	stopRecording();
+	for( deque<Message*>::iterator it = mMessages.begin(); it != mMessages.end(); ++it )
+		delete *it;
 }
 
 void OscListener::threadSocket() {
 	
+	if( mThreadStartedCallback )
+		mThreadStartedCallback( "OSC socket" );
+	
+	// ask for whatever scheduling was configured, and note what we got
+	std::stringstream status;
+	status << "cpu ";
+	if( mThreadCpu < 0 )
+		status << "any";
+	else if( SetCurrentThreadAffinity( mThreadCpu ) )
+		status << mThreadCpu;
+	else
+		status << "any (pinning to " << mThreadCpu << " failed)";
+	if( mThreadRealtime )
+		status << ( SetCurrentThreadRealtime() ? ", realtime" : ", realtime not permitted" );
+	if( mBusyPoll )
+		status << ", busy poll";
+	{
+		lock_guard<mutex> lock( mWakeUpMutex );
+		mThreadStatus = status.str();
+	}
+	
 	mListen_socket->Run();
 	mSocketHasShutdown = true;
 	
 }
 
+void OscListener::ProcessPacket( const char *data, int size, const IpEndpointName& remoteEndpoint ) {
+	// a replay stands in for the live input rather than mixing with it
+	if( ! mReplayHasFinished )
+		return;
+	unsigned long long timestamp = mListen_socket->LastReceiveTimestamp();
+	unsigned long long now = GetCurrentTimeNs();
+	{
+		lock_guard<mutex> lock( mWakeUpMutex );
+		mWakeUpSamples[mNumWakeUps++ % NUM_WAKE_UP_SAMPLES] = now > timestamp ? now - timestamp : 0;
+	}
+	recordPacket( data, size, remoteEndpoint, timestamp );
+	processPacket( data, size, remoteEndpoint, timestamp );
+}
+
+void OscListener::recordPacket( const char *data, int size, const IpEndpointName& remoteEndpoint, unsigned long long timestamp ) {
+	lock_guard<mutex> lock( mRecorderMutex );
+	if( mRecorder.isOpen() )
+		mRecorder.write( timestamp ? timestamp : GetCurrentTimeNs(), data, size, remoteEndpoint.address, remoteEndpoint.port );
+}
+
+void OscListener::processPacket( const char *data, int size, const IpEndpointName& remoteEndpoint, unsigned long long timestamp ) {
+	lock_guard<mutex> lock( mProcessMutex );
+	mPacketTimestamp = timestamp;
+	++mNumPacketsReceived;
+	// a malformed packet must not escape the socket thread and terminate the app
+	try {
+		::osc::OscPacketListener::ProcessPacket( data, size, remoteEndpoint );
+	}
+	catch( ::osc::Exception & ) {
+		// counted rather than printed, so a flood of bad packets can't stall this thread on the terminal
+		++mNumDropped;
+	}
+	if( mPacketProcessedCallback )
+		mPacketProcessedCallback();
+}
+
 void OscListener::ProcessMessage( const ::osc::ReceivedMessage &m, const IpEndpointName& remoteEndpoint ) {
 	Message* message = new Message();
 	
@@ -124,6 +297,7 @@ void OscListener::ProcessMessage( const ::osc::ReceivedMessage &m, const IpEndpo
 	char endpoint_host[IpEndpointName::ADDRESS_STRING_LENGTH];
 	remoteEndpoint.AddressAsString(endpoint_host);
 	message->setRemoteEndpoint(endpoint_host, remoteEndpoint.port);
+	message->setReceiveTimestamp(mPacketTimestamp);
 	
 	for (::osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin(); arg != m.ArgumentsEnd(); ++arg){
 		if (arg->IsInt32())
@@ -132,8 +306,17 @@ void OscListener::ProcessMessage( const ::osc::ReceivedMessage &m, const IpEndpo
 			message->addFloatArg(arg->AsFloatUnchecked());
 		else if (arg->IsString())
 			message->addStringArg(arg->AsStringUnchecked());
+		else if (arg->IsBlob()){
+			const void* data;
+			unsigned long size;
+			arg->AsBlobUnchecked(data, size);
+			message->addBlobArg(data, size);
+		}
 		else {
-			assert(false && "message argument type unknown");
+			// dropping just this argument would shift the indices of the rest
+			++mNumDropped;
+			delete message;
+			return;
 		}
 	}
 	
@@ -147,6 +330,37 @@ void OscListener::ProcessMessage( const ::osc::ReceivedMessage &m, const IpEndpo
 	}
 }
 
+std::string OscListener::getThreadStatus() const
+{
+	lock_guard<mutex> lock( mWakeUpMutex );
+	return mThreadStatus;
+}
+
+Listener::WakeUpLatency OscListener::getWakeUpLatency() const
+{
+	std::vector<uint64_t> samples;
+	{
+		lock_guard<mutex> lock( mWakeUpMutex );
+		samples.assign( mWakeUpSamples, mWakeUpSamples + std::min( mNumWakeUps, uint64_t( NUM_WAKE_UP_SAMPLES ) ) );
+	}
+	Listener::WakeUpLatency latency;
+	latency.count = samples.size();
+	latency.median = latency.p99 = latency.maximum = 0;
+	if( samples.empty() )
+		return latency;
+	std::sort( samples.begin(), samples.end() );
+	latency.median = samples[samples.size() / 2];
+	latency.p99 = samples[( samples.size() - 1 ) * 99 / 100];
+	latency.maximum = samples.back();
+	return latency;
+}
+
+size_t OscListener::getNumWaitingMessages() const
+{
+	std::lock_guard<mutex> lock( mMutex );
+	return mMessages.size();
+}
+
 bool OscListener::hasWaitingMessages() const
 {
 	std::lock_guard<mutex> lock( mMutex );
@@ -169,6 +383,172 @@ bool OscListener::getNextMessage( Message* message )
 	return true;
 }
 
+bool OscListener::startRecording( const std::string &path )
+{
+	lock_guard<mutex> lock( mRecorderMutex );
+	return mRecorder.open( path );
+}
+
+void OscListener::stopRecording()
+{
+	lock_guard<mutex> lock( mRecorderMutex );
+	mRecorder.close();
+}
+
+bool OscListener::isRecording() const
+{
+	lock_guard<mutex> lock( mRecorderMutex );
+	return mRecorder.isOpen();
+}
+
+bool OscListener::startReplay( const std::string &path, double speed )
+{
+	stopReplay();
+	if( ! mReplayReader.open( path ) )
+		return false;
+	mReplaySpeed = speed;
+	mReplayShouldStop = false;
+	mReplayHasFinished = false;
+	mReplayThread = std::shared_ptr<std::thread>( new std::thread( &OscListener::threadReplay, this ) );
+	return true;
+}
+
+void OscListener::stopReplay()
+{
+	if( mReplayThread ) {
+		mReplayShouldStop = true;
+		mReplayThread->join();
+		mReplayThread.reset();
+	}
+	mReplayReader.close();
+	mReplayIsStepped = false;
+	mReplayHasFinished = true;
+}
+
+bool OscListener::startSteppedReplay( const std::string &path )
+{
+	stopReplay();
+	if( ! mReplayReader.open( path ) )
+		return false;
+	mReplayIsStepped = true;
+	mReplayHasNextPacket = false;
+	mReplayFirstTimestamp = 0;
+	mReplayHasFinished = false;
+	return true;
+}
+
+size_t OscListener::advanceReplay( double seconds )
+{
+	if( ! mReplayIsStepped )
+		return 0;
+	size_t numFed = 0;
+	while( ! mReplayHasFinished ) {
+		if( ! mReplayHasNextPacket ) {
+			if( ! mReplayReader.next( &mReplayNextPacket ) ) {
+				mReplayHasFinished = true;
+				break;
+			}
+			if( mReplayFirstTimestamp == 0 )
+				mReplayFirstTimestamp = mReplayNextPacket.timestamp;
+			mReplayHasNextPacket = true;
+		}
+		const CaptureReader::Packet &packet = mReplayNextPacket;
+		uint64_t offset = packet.timestamp > mReplayFirstTimestamp ? packet.timestamp - mReplayFirstTimestamp : 0;
+		if( offset > (uint64_t)( seconds * 1e9 ) )
+			break;
+		processPacket( packet.data, packet.size, IpEndpointName( (unsigned long)packet.address, packet.port ), GetCurrentTimeNs() );
+		mReplayHasNextPacket = false;
+		++numFed;
+	}
+	return numFed;
+}
+
+bool OscListener::isReplaying() const
+{
+	return ! mReplayHasFinished;
+}
+
+void OscListener::threadReplay()
+{
+	using namespace std::chrono;
+	if( mThreadStartedCallback )
+		mThreadStartedCallback( "OSC replay" );
+	const steady_clock::time_point start = steady_clock::now();
+	uint64_t firstTimestamp = 0;
+	bool first = true;
+	
+	CaptureReader::Packet packet;
+	while( ! mReplayShouldStop && mReplayReader.next( &packet ) ) {
+		if( first ) {
+			firstTimestamp = packet.timestamp;
+			first = false;
+		}
+		if( mReplaySpeed > 0 ) {
+			// keep the recorded spacing, scaled by the speed
+			uint64_t offset = packet.timestamp > firstTimestamp ? packet.timestamp - firstTimestamp : 0;
+			steady_clock::time_point due = start + nanoseconds( (long long)( offset / mReplaySpeed ) );
+			// sleep in short steps so stopReplay() doesn't have to wait out long gaps
+			while( ! mReplayShouldStop && steady_clock::now() < due )
+				std::this_thread::sleep_until( std::min( due, steady_clock::now() + milliseconds( 10 ) ) );
+		}
+		// arrival time is when the packet enters the pipeline, as for a live one
+		processPacket( packet.data, packet.size, IpEndpointName( (unsigned long)packet.address, packet.port ), GetCurrentTimeNs() );
+	}
+	mReplayHasFinished = true;
+}
+
+bool OscListener::setupSharedMemory( const std::string &name, size_t capacity )
+{
+	if( ! mSharedMemory.create( name, capacity ) )
+		return false;
+	if( mListen_socket )
+		startReadingSharedMemory();
+	return true;
+}
+
+void OscListener::startReadingSharedMemory()
+{
+	const IpEndpointName wakeEndpoint = mWakeSocket->LocalEndpoint();
+	mSharedMemory.setWakePort( wakeEndpoint.port );
+	mSharedMemoryIsOnSocketThread = true;
+	// wake the thread ourselves the first time, for whatever is there already
+	const char wake = 0;
+	mWakeSocket->SendTo( wakeEndpoint, &wake, 1 );
+}
+
+void OscListener::onSharedMemoryWritten()
+{
+	if( ! mSharedMemoryIsOnSocketThread )
+		return;
+	do
+		readSharedMemory();
+	while( ! mSharedMemory.prepareToWait() );
+}
+
+size_t OscListener::pollSharedMemory()
+{
+	if( mSharedMemoryIsOnSocketThread )
+		return 0;
+	return readSharedMemory();
+}
+
+size_t OscListener::readSharedMemory()
+{
+	// packets from another local process have no remote endpoint
+	const IpEndpointName local;
+	return mSharedMemory.read( [this, &local]( const char *data, int size, uint64_t timestamp ) {
+		if( ! mReplayHasFinished )
+			return;
+		recordPacket( data, size, local, timestamp );
+		processPacket( data, size, local, timestamp );
+	} );
+}
+
+uint64_t OscListener::getNumSharedMemoryDropped() const
+{
+	return mSharedMemory.getNumDropped();
+}
+
 CallbackId OscListener::registerMessageReceived( std::function<void (const osc::Message*)> callback )
 {
 	lock_guard<mutex> lock( mMutex );
@@ -188,13 +568,97 @@ Listener::Listener() {
 }
 
 void Listener::setup(int listen_port){
-	oscListener->setup(listen_port);
+	oscListener->setup(listen_port, "");
+}
+
+void Listener::setup(int listen_port, const std::string &multicastGroup){
+	oscListener->setup(listen_port, multicastGroup);
+}
+
+void Listener::setThreadCpu( int cpu ){
+	oscListener->setThreadCpu( cpu );
+}
+
+void Listener::setThreadRealtime( bool enabled ){
+	oscListener->setThreadRealtime( enabled );
+}
+
+void Listener::setBusyPoll( bool enabled ){
+	oscListener->setBusyPoll( enabled );
+}
+
+void Listener::setThreadStartedCallback( std::function<void (const char *name)> callback ){
+	oscListener->setThreadStartedCallback( callback );
+}
+
+std::string Listener::getThreadStatus() const{
+	return oscListener->getThreadStatus();
+}
+
+Listener::WakeUpLatency Listener::getWakeUpLatency() const{
+	return oscListener->getWakeUpLatency();
 }
 
 void Listener::shutdown(){
 	oscListener->shutdown();
 }
 
+bool Listener::startRecording( const std::string &path ){
+	return oscListener->startRecording( path );
+}
+
+void Listener::stopRecording(){
+	oscListener->stopRecording();
+}
+
+bool Listener::isRecording() const {
+	return oscListener->isRecording();
+}
+
+bool Listener::startReplay( const std::string &path, double speed ){
+	return oscListener->startReplay( path, speed );
+}
+
+void Listener::stopReplay(){
+	oscListener->stopReplay();
+}
+
+bool Listener::startSteppedReplay( const std::string &path ){
+	return oscListener->startSteppedReplay( path );
+}
+
+size_t Listener::advanceReplay( double seconds ){
+	return oscListener->advanceReplay( seconds );
+}
+
+bool Listener::isReplaying() const {
+	return oscListener->isReplaying();
+}
+
+bool Listener::setupSharedMemory( const std::string &name, size_t capacity ){
+	return oscListener->setupSharedMemory( name, capacity );
+}
+
+size_t Listener::pollSharedMemory(){
+	return oscListener->pollSharedMemory();
+}
+
+uint64_t Listener::getNumSharedMemoryDropped() const {
+	return oscListener->getNumSharedMemoryDropped();
+}
+
+uint64_t Listener::getNumPacketsReceived() const {
+	return oscListener->getNumPacketsReceived();
+}
+
+uint64_t Listener::getNumDropped() const {
+	return oscListener->getNumDropped();
+}
+
+size_t Listener::getNumWaitingMessages() const {
+	return oscListener->getNumWaitingMessages();
+}
+
 bool Listener::hasWaitingMessages() const {
 	return oscListener->hasWaitingMessages();
 }
@@ -212,5 +676,10 @@ void Listener::unregisterMessageReceived( CallbackId id )
 {
 	return oscListener->unregisterMessageReceived( id );
 }
+
+void Listener::setPacketProcessedCallback( std::function<void ()> callback )
+{
+	oscListener->setPacketProcessedCallback( callback );
+}
 	
 } } // namespace cinder::osc
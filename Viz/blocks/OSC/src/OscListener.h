@@ -31,6 +31,7 @@
 
 #include "OscMessage.h"
 #include "OscArg.h"
+#include <string>
 
 
 namespace cinder { namespace osc {
@@ -40,8 +41,62 @@ class Listener {
 	Listener();
 	
 	void setup(int listen_port);
+	//! Also receives what is sent to \a multicastGroup (e.g. "239.255.0.1") on \a listen_port, so one send reaches every listener in the group. Other listeners on the same machine can share the port, though unicast datagrams to it may only reach one of them. Throws std::runtime_error if the group can't be joined.
+	void setup(int listen_port, const std::string &multicastGroup);
 	void shutdown();
 	
+	// Socket thread scheduling, set before setup()
+	//! Pins the socket thread to CPU \a cpu, or -1 (the default) for any. On OS X this is only a hint to the scheduler.
+	void setThreadCpu( int cpu );
+	//! Asks for realtime scheduling of the socket thread: SCHED_FIFO, or time critical priority on Windows. Usually needs extra privileges, see getThreadStatus().
+	void setThreadRealtime( bool enabled );
+	//! Polls the socket without blocking in a loop rather than sleeping until a packet arrives, so there is no wake-up delay. Occupies a whole CPU, so best combined with setThreadCpu().
+	void setBusyPoll( bool enabled );
+	//! What the socket thread actually got, e.g. "cpu 3, realtime, busy poll".
+	std::string getThreadStatus() const;
+	//! Calls \a callback with a name for the thread ("OSC socket" or "OSC replay") once, as the socket thread and each replay thread start, e.g. to label them in a profiler. The name is a literal.
+	void setThreadStartedCallback( std::function<void (const char *name)> callback );
+	
+	struct WakeUpLatency {
+		size_t		count;		//!< packets measured, at most the last 1024
+		uint64_t	median;		//!< nanoseconds
+		uint64_t	p99;
+		uint64_t	maximum;
+	};
+	//! Time from the kernel receiving a packet to the socket thread getting to it. Needs kernel receive timestamps (Linux, OS X); elsewhere it is close to 0.
+	WakeUpLatency getWakeUpLatency() const;
+	
+	// Counters, for monitoring
+	//! Packets processed since launch, from the socket, a replay or shared memory.
+	uint64_t getNumPacketsReceived() const;
+	//! Packets dropped as malformed, and messages dropped for having an unsupported argument type.
+	uint64_t getNumDropped() const;
+	//! Messages queued for getNextMessage().
+	size_t getNumWaitingMessages() const;
+	
+	// Capture and replay (see OscCapture.h for the file format)
+	//! Appends every packet received on the socket, with its arrival time, to a new capture file at \a path. Returns false if the file can't be created.
+	bool startRecording( const std::string &path );
+	void stopRecording();
+	bool isRecording() const;
+	//! Feeds the packets of a capture file through this listener from a background thread, bypassing the socket, so setup() isn't needed. Until it finishes, packets from the socket and shared memory are dropped so they don't mix with it. \a speed 1 replays in real time, 2 at twice the speed and so on, 0 as fast as possible. Returns false if the file can't be read.
+	bool startReplay( const std::string &path, double speed = 1.0 );
+	void stopReplay();
+	//! Opens a capture file to be fed through this listener by advanceReplay(), on the calling thread, instead of by a background thread keeping to the clock. For rendering offline, where the same packets must arrive at the same frames every time. Returns false if the file can't be read.
+	bool startSteppedReplay( const std::string &path );
+	//! Feeds the packets of a stepped replay recorded up to \a seconds after its first one. Returns the number fed.
+	size_t advanceReplay( double seconds );
+	//! Whether a replay is still feeding packets.
+	bool isReplaying() const;
+	
+	// Shared memory transport (see OscSharedMemory.h), read alongside the socket
+	//! Creates the shared memory ring \a name (e.g. "/ensemble_viz") for a Sender on the same machine to write into. Returns false if it can't be created. Once setup() has made the socket thread, that thread reads the ring too, sleeping until the writer wakes it.
+	bool setupSharedMemory( const std::string &name, size_t capacity = 1 << 20 );
+	//! Without setup(), moves packets waiting in the shared memory ring into the message queue, on the calling thread and without system calls. Call before reading messages. Returns the number of packets, always 0 once the socket thread reads the ring.
+	size_t pollSharedMemory();
+	//! Packets the writer dropped because the ring was full.
+	uint64_t getNumSharedMemoryDropped() const;
+	
 	// Callback methods
 	//! Registers an asynchronous callback which fires whenever a new message is received.
 	CallbackId	registerMessageReceived( std::function<void (const osc::Message*)> callback );
@@ -50,6 +105,8 @@ class Listener {
 	CallbackId	registerMessageReceived( T *obj, void (T::*cb)(const osc::Message*) ) { return registerMessageReceived( std::bind1st( std::mem_fun( cb ), obj ) ); }
 	//! Unregisters an asynchronous callback previously registered with registerMessageReceived()
 	void		unregisterMessageReceived( CallbackId id );
+	//! Sets a callback which fires once all of a packet's messages have been passed to the message received callbacks, on the same thread, so that a receiver can act once per packet rather than once per message.
+	void		setPacketProcessedCallback( std::function<void ()> callback );
 
 	//! Returns whether the are messages waiting to be processed via getNextMessage(). Always \c false if callbacks have been registered using registerMessageReceived().
 	bool hasWaitingMessages() const;
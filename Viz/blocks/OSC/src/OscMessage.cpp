@@ -99,6 +99,13 @@ std::string Message::getArgAsString( int index, bool typeConvert ) const{
         return ((ArgString*)args[index])->get();
 }
 
+const std::vector<char>& Message::getArgAsBlob( int index ) const{
+	if (getArgType(index) != TYPE_BLOB)
+		throw OscExcInvalidArgumentType();
+	else
+		return ((ArgBlob*)args[index])->get();
+}
+
 void Message::addIntArg( int32_t argument ){
 	args.push_back( new ArgInt32( argument ) );
 }
@@ -110,13 +117,22 @@ void Message::addFloatArg( float argument ){
 void Message::addStringArg( std::string argument ){
 	args.push_back( new ArgString( argument ) );
 }
+
+void Message::addBlobArg( const void* data, size_t size ){
+	args.push_back( new ArgBlob( data, size ) );
+}
 	
 Message& Message::copy( const Message& other ){
 
+	if( this == &other )
+		return *this;
+	// replaces any arguments, so assigning to a message used before works
+	clear();
 	address = other.address;
 	
 	remote_host = other.remote_host;
 	remote_port = other.remote_port;
+	receive_timestamp = other.receive_timestamp;
 	
 	for ( int i=0; i<(int)other.args.size(); ++i ){
 		ArgType argType = other.getArgType( i );
@@ -126,6 +142,10 @@ Message& Message::copy( const Message& other ){
 			args.push_back( new ArgFloat( other.getArgAsFloat( i ) ) );
 		else if ( argType == TYPE_STRING )
 			args.push_back( new ArgString( other.getArgAsString( i ) ) );
+		else if ( argType == TYPE_BLOB ){
+			const std::vector<char>& blob = other.getArgAsBlob( i );
+			args.push_back( new ArgBlob( blob.empty() ? NULL : &blob[0], blob.size() ) );
+		}
 		else
 		{
 			throw OscExcInvalidArgumentType();
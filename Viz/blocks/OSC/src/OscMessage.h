@@ -37,7 +37,7 @@ namespace cinder { namespace osc {
 	
 	class Message {
 	public:
-		Message() {}
+		Message() : remote_port( 0 ), receive_timestamp( 0 ) {}
 		~Message();
 		Message( const Message& other ){ copy ( other ); }
 		Message& operator= ( const Message& other ) { return copy( other ); }
@@ -50,6 +50,9 @@ namespace cinder { namespace osc {
 		int getRemotePort() const { return remote_port; }
 		void setAddress( std::string _address ) { address = _address; };
 		void setRemoteEndpoint( std::string host, int port ) { remote_host = host; remote_port = port; }
+		//! Arrival time on the socket in nanoseconds since the unix epoch (see GetCurrentTimeNs() in ip/NetworkingUtils.h), or 0 if unknown.
+		unsigned long long getReceiveTimestamp() const { return receive_timestamp; }
+		void setReceiveTimestamp( unsigned long long nanoseconds ) { receive_timestamp = nanoseconds; }
 		
 		int getNumArgs() const;
 		ArgType getArgType( int index ) const;
@@ -58,10 +61,13 @@ namespace cinder { namespace osc {
 		int32_t getArgAsInt32( int index, bool typeConvert = false ) const;
 		float getArgAsFloat( int index, bool typeConvert = false ) const;
 		std::string getArgAsString( int index, bool typeConvert = false ) const;
+		//! Returns a reference to the blob's bytes, valid until the message is cleared or destroyed.
+		const std::vector<char>& getArgAsBlob( int index ) const;
 		
 		void addIntArg( int32_t argument );
 		void addFloatArg( float argument );
 		void addStringArg( std::string argument );
+		void addBlobArg( const void* data, size_t size );
 		
 	protected:
 		std::string address;
@@ -69,6 +75,7 @@ namespace cinder { namespace osc {
 		
 		std::string remote_host;
 		int remote_port;	
+		unsigned long long receive_timestamp;
 	};
 	
 	class OscExc : public Exception {
@@ -26,12 +26,16 @@
 
 
 #include "OscSender.h"
+#include "OscSharedMemory.h"
 
 #include "osc/OscOutboundPacketStream.h"
 #include "osc/OscTypes.h"
 #include "ip/UdpSocket.h"
 
+#include "cinder/Thread.h"
+
 #include <assert.h>
+#include <vector>
 namespace cinder { namespace osc {
 	
 	class OscSender  {
@@ -40,27 +44,85 @@ namespace cinder { namespace osc {
 		~OscSender();
 		
 		void setup( std::string hostname, int port, bool multicast );
+		void addDestination( std::string hostname, int port );
+		bool setupSharedMemory( const std::string &name );
 		
 		void sendMessage( const Message &message );
 		void sendBundle( const Bundle &bundle );
 		
+		void setBatching( bool enabled, int maxPacketSize );
+		bool isBatching() const { return batching; }
+		void flush();
+		
 		void shutdown();
 	private:
 		
 		void appendBundle( const Bundle &bundle, ::osc::OutboundPacketStream &p );
 		void appendMessage( const Message &message, ::osc::OutboundPacketStream &p );
 		
+		//! Sends one datagram to every destination
+		void sendPacket( const char *data, int size );
+		//! Packs \a messages into as few bundles of at most maxPacketSize bytes as possible and sends them
+		void sendBatch( const std::vector<Message> &messages );
+		void threadBatch();
+		void stopBatchThread();
+		
 		UdpTransmitSocket* socket;
+		//! Unconnected socket used once there is more than one destination
+		UdpSocket* multiSocket;
+		std::vector<IpEndpointName> destinations;
+		//! Used instead of the sockets once open
+		SharedMemoryRing sharedMemory;
+		std::mutex socketMutex;
 		
+		bool batching;
+		int maxPacketSize;
+		//! Messages queued by sendMessage() since the last flush(). Only touched by the caller's thread.
+		std::vector<Message> pending;
+		//! Messages handed over by flush(), waiting for the batch thread
+		std::vector<Message> outgoing;
+		std::vector<char> batchBuffer;
+		std::mutex batchMutex;
+		std::condition_variable batchCondition;
+		std::shared_ptr<std::thread> batchThread;
+		bool batchThreadShouldQuit;
 	};
 	
 	
+//! Number of bytes \a message takes once encoded, not counting the size prefix it gets inside a bundle
+static unsigned long encodedSize( const Message &message )
+{
+	unsigned long size = ( ( message.getAddress().size() + 1 + 3 ) & ~3 );
+	// ',' + one tag per argument + terminator
+	size += ( ( 1 + message.getNumArgs() + 1 + 3 ) & ~3 );
+	for( int i = 0; i < message.getNumArgs(); ++i ) {
+		if( message.getArgType(i) == TYPE_STRING )
+			size += ( ( message.getArgAsString(i).size() + 1 + 3 ) & ~3 );
+		else if( message.getArgType(i) == TYPE_BLOB )
+			size += 4 + ( ( message.getArgAsBlob(i).size() + 3 ) & ~3 );
+		else
+			size += 4;
+	}
+	return size;
+}
+
+// "#bundle\0" and the time tag
+static const unsigned long BUNDLE_HEADER_SIZE = 16;
+// each bundle element is prefixed with its size
+static const unsigned long BUNDLE_ELEMENT_SIZE_PREFIX = 4;
+
 
 OscSender::OscSender(){
 	socket = NULL;
+	multiSocket = NULL;
+	batching = false;
+	maxPacketSize = 1472;
+	batchThreadShouldQuit = false;
 }
 
 OscSender::~OscSender(){
+	flush();
+	stopBatchThread();
 	if (socket)
 		shutdown();
 }
@@ -69,13 +131,47 @@ void OscSender::setup( std::string hostname, int port, bool multicast )
 {
 	if( socket )
 		shutdown();
-	socket = new UdpTransmitSocket( IpEndpointName(hostname.c_str(), port), multicast );
+	std::lock_guard<std::mutex> lock( socketMutex );
+	IpEndpointName endpoint( hostname.c_str(), port );
+	socket = new UdpTransmitSocket( endpoint, multicast );
+	destinations.clear();
+	destinations.push_back( endpoint );
+}
+
+void OscSender::addDestination( std::string hostname, int port )
+{
+	std::lock_guard<std::mutex> lock( socketMutex );
+	destinations.push_back( IpEndpointName( hostname.c_str(), port ) );
+	if( ! multiSocket )
+		multiSocket = new UdpSocket();
+}
+
+bool OscSender::setupSharedMemory( const std::string &name )
+{
+	std::lock_guard<std::mutex> lock( socketMutex );
+	return sharedMemory.open( name );
 }
 
 void OscSender::shutdown(){
+	std::lock_guard<std::mutex> lock( socketMutex );
 	if (socket)
 		delete socket;
 	socket = NULL;
+	if (multiSocket)
+		delete multiSocket;
+	multiSocket = NULL;
+	destinations.clear();
+}
+
+void OscSender::sendPacket( const char *data, int size )
+{
+	std::lock_guard<std::mutex> lock( socketMutex );
+	if( sharedMemory.isOpen() )
+		sharedMemory.write( data, size, GetCurrentTimeNs() );
+	else if( destinations.size() > 1 )
+		multiSocket->SendToMultiple( &destinations[0], (int)destinations.size(), data, size );
+	else if( socket )
+		socket->Send( data, size );
 }
 
 void OscSender::sendBundle( const Bundle &bundle ){
@@ -86,11 +182,16 @@ void OscSender::sendBundle( const Bundle &bundle ){
 	
 	appendBundle( bundle, p );
 	
-	socket->Send(p.Data(), p.Size());
+	sendPacket(p.Data(), p.Size());
 }
 
 void OscSender::sendMessage( const Message &message )
 {
+	if( batching ) {
+		pending.push_back( message );
+		return;
+	}
+
 	static const int OUTPUT_BUFFER_SIZE = 16384;
 	char buffer[OUTPUT_BUFFER_SIZE];
 	::osc::OutboundPacketStream p(buffer, OUTPUT_BUFFER_SIZE);
@@ -99,7 +200,100 @@ void OscSender::sendMessage( const Message &message )
 	appendMessage(message, p);
 	p << ::osc::EndBundle;
 	
-	socket->Send(p.Data(), p.Size());
+	sendPacket(p.Data(), p.Size());
+}
+
+void OscSender::setBatching( bool enabled, int maxPacketSize_ )
+{
+	maxPacketSize = maxPacketSize_;
+	if( enabled == batching )
+		return;
+	if( enabled ) {
+		batchThreadShouldQuit = false;
+		batchThread = std::shared_ptr<std::thread>( new std::thread( &OscSender::threadBatch, this ) );
+	}
+	else {
+		flush();
+		stopBatchThread();
+	}
+	batching = enabled;
+}
+
+void OscSender::flush()
+{
+	if( ! batching || pending.empty() )
+		return;
+	{
+		std::lock_guard<std::mutex> lock( batchMutex );
+		if( outgoing.empty() )
+			outgoing.swap( pending );
+		else {
+			// the batch thread has fallen behind; send these along with the last lot
+			outgoing.insert( outgoing.end(), pending.begin(), pending.end() );
+			pending.clear();
+		}
+	}
+	batchCondition.notify_one();
+}
+
+void OscSender::stopBatchThread()
+{
+	if( ! batchThread )
+		return;
+	{
+		std::lock_guard<std::mutex> lock( batchMutex );
+		batchThreadShouldQuit = true;
+	}
+	batchCondition.notify_one();
+	batchThread->join();
+	batchThread.reset();
+}
+
+void OscSender::threadBatch()
+{
+	std::vector<Message> sending;
+	while( true ) {
+		{
+			std::unique_lock<std::mutex> lock( batchMutex );
+			while( outgoing.empty() && ! batchThreadShouldQuit )
+				batchCondition.wait( lock );
+			if( outgoing.empty() && batchThreadShouldQuit )
+				return;
+			sending.swap( outgoing );
+		}
+		sendBatch( sending );
+		sending.clear();
+	}
+}
+
+void OscSender::sendBatch( const std::vector<Message> &messages )
+{
+	size_t first = 0;
+	while( first < messages.size() ) {
+		// take as many messages as fit, but always at least one
+		unsigned long size = BUNDLE_HEADER_SIZE;
+		size_t last = first;
+		while( last < messages.size() ) {
+			unsigned long elementSize = BUNDLE_ELEMENT_SIZE_PREFIX + encodedSize( messages[last] );
+			if( last > first && size + elementSize > (unsigned long)maxPacketSize )
+				break;
+			size += elementSize;
+			++last;
+		}
+		
+		// OutboundPacketStream keeps the type tags of the message being built at the end
+		// of the buffer, so it needs more room than the finished packet
+		if( batchBuffer.size() < 2 * size )
+			batchBuffer.resize( 2 * size );
+		::osc::OutboundPacketStream p( &batchBuffer[0], batchBuffer.size() );
+		p << ::osc::BeginBundleImmediate;
+		for( size_t i = first; i < last; ++i )
+			appendMessage( messages[i], p );
+		p << ::osc::EndBundle;
+		
+		sendPacket( p.Data(), p.Size() );
+		first = last;
+	}
 }
 
 void OscSender::appendBundle( const Bundle &bundle, ::osc::OutboundPacketStream& p )
@@ -124,6 +318,9 @@ void OscSender::appendMessage( const Message& message, ::osc::OutboundPacketStre
 			p << message.getArgAsFloat(i);
 		}else if (message.getArgType(i) == TYPE_STRING){
 			p << message.getArgAsString(i).c_str();
+		}else if (message.getArgType(i) == TYPE_BLOB){
+			const std::vector<char>& blob = message.getArgAsBlob(i);
+			p << ::osc::Blob( blob.empty() ? NULL : &blob[0], blob.size() );
 		}else {
 			throw OscExcInvalidArgumentType();
 		}
@@ -147,10 +344,35 @@ void Sender::sendMessage( const Message& message )
 	oscSender->sendMessage(message);
 }
 
+void Sender::addDestination( std::string hostname, int port )
+{
+	oscSender->addDestination( hostname, port );
+}
+
+bool Sender::setupSharedMemory( const std::string &name )
+{
+	return oscSender->setupSharedMemory( name );
+}
+
 void Sender::sendBundle( const Bundle& bundle )
 {
 	oscSender->sendBundle( bundle );
 }
+
+void Sender::setBatching( bool enabled, int maxPacketSize )
+{
+	oscSender->setBatching( enabled, maxPacketSize );
+}
+
+bool Sender::isBatching() const
+{
+	return oscSender->isBatching();
+}
+
+void Sender::flush()
+{
+	oscSender->flush();
+}
 	
 }// namespace cinder
 }// namespace osc
\ No newline at end of file
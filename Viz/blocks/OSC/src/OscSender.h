@@ -38,9 +38,19 @@ class Sender  {
 	Sender();
 	
 	void setup( std::string hostname, int port, bool multicast = false );
+	//! Adds another destination. Everything sent also goes there; on Linux all destinations are sent to with one sendmmsg() call.
+	void addDestination( std::string hostname, int port );
+	//! Sends through the shared memory ring that a Listener on this machine made with Listener::setupSharedMemory() instead of over UDP. Returns false if there is no such ring yet.
+	bool setupSharedMemory( const std::string &name );
 	
 	void sendMessage( const Message& message );
 	void sendBundle( const Bundle& bundle );
+
+	//! Enables batched sending. sendMessage() then only queues the message, and flush() hands the queue to a background thread which packs it into as few bundles of at most \a maxPacketSize bytes as possible.
+	void setBatching( bool enabled, int maxPacketSize = 1472 );
+	bool isBatching() const;
+	//! Sends the messages queued since the last flush(). Call once per frame. Does nothing unless batching is enabled.
+	void flush();
 	
   private:
 	 std::shared_ptr<class OscSender>   oscSender;
@@ -0,0 +1,270 @@
+#include "OscSharedMemory.h"
+
+#include <atomic>
+#include <cstring>
+
+#if ! defined( _WIN32 )
+	#include <arpa/inet.h>
+	#include <fcntl.h>
+	#include <netinet/in.h>
+	#include <sys/mman.h>
+	#include <sys/socket.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace cinder { namespace osc {
+
+static const char SHARED_MEMORY_MAGIC[8] = { 'O', 'S', 'C', 'S', 'H', 'M', '2', '\0' };
+
+//! Each packet is a RecordHeader followed by its bytes, padded so the next
+//! record starts on a 16 byte boundary. A record with size WRAP_MARKER means
+//! the rest of the buffer is unused and the next record is at the start.
+struct RecordHeader {
+	uint32_t	size;
+	uint32_t	reserved;
+	uint64_t	timestamp;
+};
+static const uint32_t WRAP_MARKER = 0xffffffff;
+static const size_t RECORD_ALIGNMENT = 16;
+
+//! Start of the segment. The two positions count bytes ever written and
+//! read, and live on separate cache lines so the two ends don't share one.
+//! The reader's line also says whether and where it wants waking.
+struct SharedMemoryRing::Header {
+	char					magic[8];
+	uint64_t				capacity;
+	char					padding0[64 - 16];
+	std::atomic<uint64_t>	writePosition;
+	std::atomic<uint64_t>	dropped;
+	char					padding1[64 - 16];
+	std::atomic<uint64_t>	readPosition;
+	std::atomic<uint32_t>	readerIsWaiting;
+	std::atomic<uint32_t>	wakePort;
+	char					padding2[64 - 16];
+};
+
+static size_t recordSize( size_t packetSize )
+{
+	return sizeof( RecordHeader ) + ( ( packetSize + RECORD_ALIGNMENT - 1 ) & ~( RECORD_ALIGNMENT - 1 ) );
+}
+
+SharedMemoryRing::SharedMemoryRing()
+	: mHeader( NULL ), mRecords( NULL ), mMappedSize( 0 ), mWakeSocket( -1 )
+{
+}
+
+SharedMemoryRing::~SharedMemoryRing()
+{
+	close();
+}
+
+#if defined( _WIN32 )
+
+bool SharedMemoryRing::create( const std::string &name, size_t capacity ) { return false; }
+bool SharedMemoryRing::open( const std::string &name ) { return false; }
+void SharedMemoryRing::close() {}
+bool SharedMemoryRing::map( int fd, size_t size ) { return false; }
+void SharedMemoryRing::wakeReader() {}
+
+#else
+
+bool SharedMemoryRing::create( const std::string &name, size_t capacity )
+{
+	close();
+	size_t roundedCapacity = RECORD_ALIGNMENT * 2;
+	while( roundedCapacity < capacity )
+		roundedCapacity *= 2;
+
+	int fd = shm_open( name.c_str(), O_RDWR | O_CREAT, 0666 );
+	if( fd < 0 )
+		return false;
+	const size_t size = sizeof( Header ) + roundedCapacity;
+	struct stat info;
+	if( fstat( fd, &info ) != 0 || ( size_t( info.st_size ) != size && ftruncate( fd, size ) != 0 ) ) {
+		::close( fd );
+		return false;
+	}
+	bool mapped = map( fd, size );
+	::close( fd );
+	if( ! mapped )
+		return false;
+
+	if( memcmp( mHeader->magic, SHARED_MEMORY_MAGIC, sizeof( mHeader->magic ) ) == 0 && mHeader->capacity == roundedCapacity ) {
+		// left over from an earlier run, and a writer may be attached: skip whatever is stale
+		mHeader->readPosition.store( mHeader->writePosition.load( std::memory_order_acquire ), std::memory_order_release );
+		mHeader->readerIsWaiting.store( 0 );
+		mHeader->wakePort.store( 0 );
+	}
+	else {
+		memset( mHeader->magic, 0, sizeof( mHeader->magic ) );
+		mHeader->capacity = roundedCapacity;
+		mHeader->writePosition.store( 0 );
+		mHeader->dropped.store( 0 );
+		mHeader->readPosition.store( 0 );
+		mHeader->readerIsWaiting.store( 0 );
+		mHeader->wakePort.store( 0 );
+		std::atomic_thread_fence( std::memory_order_release );
+		// writers only attach once the magic is there
+		memcpy( mHeader->magic, SHARED_MEMORY_MAGIC, sizeof( mHeader->magic ) );
+	}
+	mName = name;
+	return true;
+}
+
+bool SharedMemoryRing::open( const std::string &name )
+{
+	close();
+	int fd = shm_open( name.c_str(), O_RDWR, 0 );
+	if( fd < 0 )
+		return false;
+	struct stat info;
+	if( fstat( fd, &info ) != 0 || size_t( info.st_size ) < sizeof( Header ) + RECORD_ALIGNMENT * 2 ) {
+		::close( fd );
+		return false;
+	}
+	bool mapped = map( fd, info.st_size );
+	::close( fd );
+	if( ! mapped )
+		return false;
+
+	std::atomic_thread_fence( std::memory_order_acquire );
+	if( memcmp( mHeader->magic, SHARED_MEMORY_MAGIC, sizeof( mHeader->magic ) ) != 0
+		|| sizeof( Header ) + mHeader->capacity != mMappedSize ) {
+		close();
+		return false;
+	}
+	mName = name;
+	return true;
+}
+
+bool SharedMemoryRing::map( int fd, size_t size )
+{
+	void *memory = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	if( memory == MAP_FAILED )
+		return false;
+	mHeader = static_cast<Header*>( memory );
+	mRecords = static_cast<char*>( memory ) + sizeof( Header );
+	mMappedSize = size;
+	return true;
+}
+
+void SharedMemoryRing::close()
+{
+	if( mWakeSocket >= 0 )
+		::close( mWakeSocket );
+	mWakeSocket = -1;
+	if( mHeader )
+		munmap( mHeader, mMappedSize );
+	mHeader = NULL;
+	mRecords = NULL;
+	mMappedSize = 0;
+	mName.clear();
+}
+
+void SharedMemoryRing::wakeReader()
+{
+	const uint32_t port = mHeader->wakePort.load( std::memory_order_relaxed );
+	if( port == 0 )
+		return;
+	if( mWakeSocket < 0 )
+		mWakeSocket = socket( AF_INET, SOCK_DGRAM, 0 );
+	struct sockaddr_in address;
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	address.sin_port = htons( uint16_t( port ) );
+	const char wake = 0;
+	// nothing to do if it fails: the reader will find the packet when it next wakes
+	sendto( mWakeSocket, &wake, 1, MSG_DONTWAIT, (struct sockaddr *)&address, sizeof( address ) );
+}
+
+#endif
+
+bool SharedMemoryRing::write( const char *data, int size, uint64_t timestamp )
+{
+	if( ! mHeader || size < 0 )
+		return false;
+	const uint64_t capacity = mHeader->capacity;
+	const size_t needed = recordSize( size );
+	const uint64_t writePosition = mHeader->writePosition.load( std::memory_order_relaxed );
+	const uint64_t readPosition = mHeader->readPosition.load( std::memory_order_acquire );
+
+	uint64_t offset = writePosition & ( capacity - 1 );
+	const uint64_t untilEnd = capacity - offset;
+	const uint64_t skip = untilEnd < needed ? untilEnd : 0;
+	if( needed > capacity / 2 || skip + needed > capacity - ( writePosition - readPosition ) ) {
+		mHeader->dropped.fetch_add( 1, std::memory_order_relaxed );
+		return false;
+	}
+
+	if( skip ) {
+		reinterpret_cast<RecordHeader*>( mRecords + offset )->size = WRAP_MARKER;
+		offset = 0;
+	}
+	RecordHeader *record = reinterpret_cast<RecordHeader*>( mRecords + offset );
+	record->size = uint32_t( size );
+	record->reserved = 0;
+	record->timestamp = timestamp;
+	memcpy( record + 1, data, size );
+
+	// publish the record only once its bytes are in place
+	mHeader->writePosition.store( writePosition + skip + needed, std::memory_order_release );
+
+	// pairs with the fence in prepareToWait(): either the reader sees this
+	// record before it sleeps, or this sees that it is waiting
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if( mHeader->readerIsWaiting.load( std::memory_order_relaxed ) && mHeader->readerIsWaiting.exchange( 0 ) )
+		wakeReader();
+	return true;
+}
+
+size_t SharedMemoryRing::read( const std::function<void (const char *data, int size, uint64_t timestamp)> &callback )
+{
+	if( ! mHeader )
+		return 0;
+	const uint64_t capacity = mHeader->capacity;
+	uint64_t readPosition = mHeader->readPosition.load( std::memory_order_relaxed );
+	const uint64_t writePosition = mHeader->writePosition.load( std::memory_order_acquire );
+
+	size_t count = 0;
+	while( readPosition != writePosition ) {
+		const uint64_t offset = readPosition & ( capacity - 1 );
+		const RecordHeader *record = reinterpret_cast<const RecordHeader*>( mRecords + offset );
+		if( record->size == WRAP_MARKER ) {
+			readPosition += capacity - offset;
+			continue;
+		}
+		callback( reinterpret_cast<const char*>( record + 1 ), int( record->size ), record->timestamp );
+		readPosition += recordSize( record->size );
+		++count;
+	}
+	// hand the space back to the writer
+	mHeader->readPosition.store( readPosition, std::memory_order_release );
+	return count;
+}
+
+void SharedMemoryRing::setWakePort( int port )
+{
+	if( mHeader )
+		mHeader->wakePort.store( uint32_t( port ) );
+}
+
+bool SharedMemoryRing::prepareToWait()
+{
+	if( ! mHeader )
+		return true;
+	mHeader->readerIsWaiting.store( 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	if( mHeader->writePosition.load( std::memory_order_relaxed ) == mHeader->readPosition.load( std::memory_order_relaxed ) )
+		return true;
+	mHeader->readerIsWaiting.store( 0, std::memory_order_relaxed );
+	return false;
+}
+
+uint64_t SharedMemoryRing::getNumDropped() const
+{
+	return mHeader ? mHeader->dropped.load( std::memory_order_relaxed ) : 0;
+}
+
+} } // namespace cinder::osc
@@ -0,0 +1,66 @@
+/*
+ Shared memory transport for OSC packets between processes on the same
+ machine, avoiding the UDP loopback stack.
+
+ A named POSIX shared memory segment (shm_open) holds a single producer,
+ single consumer ring of packets. Both ends only touch memory and atomics,
+ so reading and writing cost no system calls. The reader owns the segment
+ and creates it; the writer attaches to it. The writer never blocks: if the
+ ring is full the packet is dropped and counted.
+
+ A reader that would rather sleep than poll gives the ring a UDP port on
+ the loopback interface and calls prepareToWait() once it has emptied the
+ ring. The writer then sends a one byte datagram to that port with the
+ next packet it writes, so the reader can block on a socket, and costs a
+ system call only for that first packet after the reader went idle.
+
+ Not available on Windows, where create() and open() return false.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+namespace cinder { namespace osc {
+
+class SharedMemoryRing {
+  public:
+	SharedMemoryRing();
+	~SharedMemoryRing();
+
+	//! Reader side. Creates the segment called \a name (e.g. "/ensemble_viz") with room for \a capacity bytes of packets, rounded up to a power of two, or reuses an existing one. Packets must be smaller than half the capacity.
+	bool create( const std::string &name, size_t capacity = 1 << 20 );
+	//! Writer side. Attaches to a segment made by create(). Returns false if there isn't one yet.
+	bool open( const std::string &name );
+	void close();
+	bool isOpen() const { return mHeader != NULL; }
+	const std::string& getName() const { return mName; }
+
+	//! Writer side. Appends a packet. Returns false, counting a drop, if there isn't room.
+	bool write( const char *data, int size, uint64_t timestamp );
+	//! Reader side. Calls \a callback for every waiting packet, oldest first, and returns how many there were.
+	size_t read( const std::function<void (const char *data, int size, uint64_t timestamp)> &callback );
+	//! Reader side. Where on 127.0.0.1 the writer sends its wake-up datagrams, 0 for nowhere.
+	void setWakePort( int port );
+	//! Reader side. Asks the writer for a wake-up datagram with its next packet. Call once read() has emptied the ring, before sleeping. Returns false if a packet has come in meanwhile, to be read() rather than slept on.
+	bool prepareToWait();
+
+	//! Packets the writer has had to drop because the reader fell behind.
+	uint64_t getNumDropped() const;
+
+  private:
+	bool map( int fd, size_t size );
+	void wakeReader();
+
+	struct Header;
+	Header		*mHeader;
+	char		*mRecords;
+	size_t		mMappedSize;
+	std::string	mName;
+	//! Writer side. Sends the wake-up datagrams, opened on first use.
+	int			mWakeSocket;
+};
+
+} } // namespace cinder::osc
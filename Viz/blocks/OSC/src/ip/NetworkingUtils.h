@@ -46,4 +46,23 @@ public:
 unsigned long GetHostByName( const char *name );
 
 
+// wall clock time in nanoseconds since the unix epoch. this is the clock
+// that UdpSocket receive timestamps are taken from, so the two can be
+// subtracted.
+unsigned long long GetCurrentTimeNs();
+
+
+// scheduling of the calling thread, for socket threads that need to wake
+// up promptly. both return false if the system doesn't support it or the
+// process isn't permitted to.
+
+// run only on the given cpu (on OS X this is just a hint to keep the
+// thread apart from others)
+bool SetCurrentThreadAffinity( int cpu );
+
+// realtime scheduling: SCHED_FIFO on posix, time critical priority on
+// windows
+bool SetCurrentThreadRealtime();
+
+
 #endif /* INCLUDED_NETWORKINGUTILS_H */
@@ -65,6 +65,10 @@ public:
             int initialDelayMilliseconds, int periodMilliseconds, TimerListener *listener );
     void DetachPeriodicTimerListener( TimerListener *listener );  
 
+	// Instead of sleeping until a socket is readable, poll the sockets
+	// without blocking in a loop. Lowest latency, but takes a whole CPU.
+	void SetBusyPoll( bool enabled );
+
     void Run();      // loop and block processing messages indefinitely
 	void RunUntilSigInt();
     void Break();    // call this from a listener to exit once the listener returns
@@ -101,13 +105,42 @@ public:
 	void Send( const char *data, int size );
     void SendTo( const IpEndpointName& remoteEndpoint, const char *data, int size );
 
+	// Send the same datagram to several endpoints. On Linux this is
+	// a single sendmmsg() call, elsewhere it falls back to SendTo().
+	void SendToMultiple( const IpEndpointName *remoteEndpoints, int count, const char *data, int size );
+
 
 	// Bind a local endpoint to receive incoming data. Endpoint
 	// can be 'any' for the system to choose an endpoint
 	void Bind( const IpEndpointName& localEndpoint );
 	bool IsBound() const;
 
+	// The address and port bound, e.g. the port the system chose for
+	// one bound to 'any'
+	IpEndpointName LocalEndpoint() const;
+
+	// Let other sockets bind the same port, so several receivers on one
+	// machine can listen to a multicast group. Each gets every datagram
+	// sent to the group, but on Linux one sent straight to the port only
+	// reaches one of them. Call before Bind().
+	void SetReuseAddress();
+
+	// Receive datagrams sent to a multicast group (e.g. 239.255.0.1) on
+	// the bound port. Interface can be 'any' for the system's default.
+	// Throws std::runtime_error if the group can't be joined.
+	void JoinMulticastGroup( const IpEndpointName& group,
+			const IpEndpointName& localInterface = IpEndpointName() );
+
 	int ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size );
+
+	// Ask the kernel to timestamp incoming datagrams (SO_TIMESTAMPNS
+	// where available). Without kernel support the time is taken just
+	// after the datagram is read.
+	void EnableReceiveTimestamps();
+
+	// Arrival time of the datagram last returned by ReceiveFrom(), in
+	// GetCurrentTimeNs() nanoseconds. 0 unless timestamps are enabled.
+	unsigned long long LastReceiveTimestamp() const;
 };
 
 
@@ -144,10 +177,28 @@ public:
         mux_.AttachSocketListener( this, listener_ );
     }
 
+    // Listens on the port of localEndpoint for datagrams sent to
+    // multicastGroup as well as those sent directly to this machine
+    UdpListeningReceiveSocket( const IpEndpointName& localEndpoint,
+            const IpEndpointName& multicastGroup, PacketListener *listener )
+        : listener_( listener )
+    {
+        SetReuseAddress();
+        Bind( IpEndpointName( IpEndpointName::ANY_ADDRESS, localEndpoint.port ) );
+        JoinMulticastGroup( multicastGroup, IpEndpointName( localEndpoint.address, IpEndpointName::ANY_PORT ) );
+        mux_.AttachSocketListener( this, listener_ );
+    }
+
     ~UdpListeningReceiveSocket()
         { mux_.DetachSocketListener( this, listener_ ); }
 
     // see SocketReceiveMultiplexer above for the behaviour of these methods...
+    void SetBusyPoll( bool enabled ) { mux_.SetBusyPoll( enabled ); }
+    // e.g. a second socket the same thread should wait on
+    void AttachSocketListener( UdpSocket *socket, PacketListener *listener )
+        { mux_.AttachSocketListener( socket, listener ); }
+    void DetachSocketListener( UdpSocket *socket, PacketListener *listener )
+        { mux_.DetachSocketListener( socket, listener ); }
     void Run() { mux_.Run(); }
 	void RunUntilSigInt() { mux_.RunUntilSigInt(); }
     void Break() { mux_.Break(); }
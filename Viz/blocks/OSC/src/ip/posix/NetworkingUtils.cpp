@@ -34,6 +34,15 @@
 #include <netinet/in.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#endif
 
 
 
@@ -55,3 +64,47 @@ unsigned long GetHostByName( const char *name )
 
     return result;
 }
+
+
+unsigned long long GetCurrentTimeNs()
+{
+#if defined(CLOCK_REALTIME)
+    struct timespec t;
+    clock_gettime( CLOCK_REALTIME, &t );
+    return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+#else
+    struct timeval t;
+    gettimeofday( &t, 0 );
+    return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_usec * 1000ULL;
+#endif
+}
+
+
+bool SetCurrentThreadAffinity( int cpu )
+{
+    if( cpu < 0 )
+        return false;
+#if defined(__APPLE__)
+    // threads with different tags are kept on different cores where possible
+    thread_affinity_policy_data_t policy = { cpu + 1 };
+    return thread_policy_set( pthread_mach_thread_np( pthread_self() ), THREAD_AFFINITY_POLICY,
+            (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT ) == KERN_SUCCESS;
+#elif defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO( &cpus );
+    CPU_SET( cpu, &cpus );
+    return pthread_setaffinity_np( pthread_self(), sizeof(cpus), &cpus ) == 0;
+#else
+    return false;
+#endif
+}
+
+
+bool SetCurrentThreadRealtime()
+{
+    // the lowest realtime priority is still above every normal thread
+    struct sched_param param;
+    memset( &param, 0, sizeof(param) );
+    param.sched_priority = sched_get_priority_min( SCHED_FIFO );
+    return pthread_setschedparam( pthread_self(), SCHED_FIFO, &param ) == 0;
+}
@@ -96,12 +96,17 @@ class UdpSocket::Implementation{
 	struct sockaddr_in connectedAddr_;
 	struct sockaddr_in sendToAddr_;
 
+	bool timestampsEnabled_;
+	unsigned long long lastReceiveTimestamp_;
+
 public:
 
 	Implementation()
 		: isBound_( false )
 		, isConnected_( false )
 		, socket_( -1 )
+		, timestampsEnabled_( false )
+		, lastReceiveTimestamp_( 0 )
 	{
 		if( (socket_ = socket( AF_INET, SOCK_DGRAM, 0 )) == -1 ){
             throw std::runtime_error("unable to create udp socket\n");
@@ -192,6 +197,35 @@ public:
         sendto( socket_, data, size, 0, (sockaddr*)&sendToAddr_, sizeof(sendToAddr_) );
 	}
 
+	void SendToMultiple( const IpEndpointName *remoteEndpoints, int count, const char *data, int size )
+	{
+#if defined(__linux__)
+		std::vector< struct sockaddr_in > addrs( count );
+		std::vector< struct mmsghdr > msgs( count );
+		struct iovec iov;
+		iov.iov_base = (void*)data;
+		iov.iov_len = size;
+		for( int i=0; i < count; ++i ){
+			SockaddrFromIpEndpointName( addrs[i], remoteEndpoints[i] );
+			memset( &msgs[i], 0, sizeof(msgs[i]) );
+			msgs[i].msg_hdr.msg_name = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+			msgs[i].msg_hdr.msg_iov = &iov;
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		int sent = 0;
+		while( sent < count ){
+			int result = sendmmsg( socket_, &msgs[sent], count - sent, 0 );
+			if( result <= 0 )
+				break;
+			sent += result;
+		}
+#else
+		for( int i=0; i < count; ++i )
+			SendTo( remoteEndpoints[i], data, size );
+#endif
+	}
+
 	void Bind( const IpEndpointName& localEndpoint )
 	{
 		struct sockaddr_in bindSockAddr;
@@ -206,10 +240,53 @@ public:
 
 	bool IsBound() const { return isBound_; }
 
+	IpEndpointName LocalEndpoint() const
+	{
+		assert( isBound_ );
+
+        struct sockaddr_in sockAddr;
+        memset( (char *)&sockAddr, 0, sizeof(sockAddr ) );
+        socklen_t length = sizeof(sockAddr);
+        if (getsockname(socket_, (struct sockaddr *)&sockAddr, &length) < 0) {
+            throw std::runtime_error("unable to getsockname\n");
+        }
+
+		return IpEndpointNameFromSockaddr( sockAddr );
+	}
+
+	void SetReuseAddress()
+	{
+		int enable = 1;
+		setsockopt( socket_, SOL_SOCKET, SO_REUSEADDR, (const char*)&enable, sizeof(enable) );
+#if defined(SO_REUSEPORT)
+		// BSD and OS X only let a second socket bind a port it already
+		// shares with SO_REUSEPORT as well
+		setsockopt( socket_, SOL_SOCKET, SO_REUSEPORT, (const char*)&enable, sizeof(enable) );
+#endif
+	}
+
+	void JoinMulticastGroup( const IpEndpointName& group, const IpEndpointName& localInterface )
+	{
+		struct ip_mreq request;
+		memset( &request, 0, sizeof(request) );
+		request.imr_multiaddr.s_addr = htonl( group.address );
+		request.imr_interface.s_addr =
+			(localInterface.address == IpEndpointName::ANY_ADDRESS)
+			? htonl( INADDR_ANY )
+			: htonl( localInterface.address );
+
+		if (setsockopt(socket_, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&request, sizeof(request)) < 0) {
+			throw std::runtime_error("unable to join multicast group\n");
+		}
+	}
+
     int ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size )
 	{
 		assert( isBound_ );
 
+		if( timestampsEnabled_ )
+			return ReceiveFromWithTimestamp( remoteEndpoint, data, size );
+
 		struct sockaddr_in fromAddr;
         socklen_t fromAddrLen = sizeof(fromAddr);
              	 
@@ -224,6 +301,74 @@ public:
 		return result;
 	}
 
+	void EnableReceiveTimestamps()
+	{
+		int enable = 1;
+#if defined(SO_TIMESTAMPNS)
+		setsockopt( socket_, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable) );
+#elif defined(SO_TIMESTAMP)
+		setsockopt( socket_, SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable) );
+#endif
+		timestampsEnabled_ = true;
+	}
+
+	unsigned long long LastReceiveTimestamp() const { return lastReceiveTimestamp_; }
+
+	// recvmsg() version of ReceiveFrom() which also picks up the kernel's
+	// receive timestamp from the control data
+	int ReceiveFromWithTimestamp( IpEndpointName& remoteEndpoint, char *data, int size )
+	{
+		struct sockaddr_in fromAddr;
+		struct iovec iov;
+		iov.iov_base = data;
+		iov.iov_len = size;
+		union {
+			char buffer[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(struct timeval))];
+			struct cmsghdr align;
+		} control;
+
+		struct msghdr message;
+		memset( &message, 0, sizeof(message) );
+		message.msg_name = &fromAddr;
+		message.msg_namelen = sizeof(fromAddr);
+		message.msg_iov = &iov;
+		message.msg_iovlen = 1;
+		message.msg_control = control.buffer;
+		message.msg_controllen = sizeof(control.buffer);
+
+		int result = (int)recvmsg( socket_, &message, 0 );
+		if( result < 0 )
+			return 0;
+
+		lastReceiveTimestamp_ = 0;
+		for( struct cmsghdr *c = CMSG_FIRSTHDR(&message); c != 0; c = CMSG_NXTHDR(&message, c) ){
+			if( c->cmsg_level != SOL_SOCKET )
+				continue;
+#if defined(SCM_TIMESTAMPNS)
+			if( c->cmsg_type == SCM_TIMESTAMPNS ){
+				struct timespec t;
+				memcpy( &t, CMSG_DATA(c), sizeof(t) );
+				lastReceiveTimestamp_ = (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+			}
+#endif
+#if defined(SCM_TIMESTAMP)
+			if( c->cmsg_type == SCM_TIMESTAMP ){
+				struct timeval t;
+				memcpy( &t, CMSG_DATA(c), sizeof(t) );
+				lastReceiveTimestamp_ = (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_usec * 1000ULL;
+			}
+#endif
+		}
+		// no kernel support, so the best we can do is now
+		if( lastReceiveTimestamp_ == 0 )
+			lastReceiveTimestamp_ = GetCurrentTimeNs();
+
+		remoteEndpoint.address = ntohl(fromAddr.sin_addr.s_addr);
+		remoteEndpoint.port = ntohs(fromAddr.sin_port);
+
+		return result;
+	}
+
 	int Socket() { return socket_; }
 };
 
@@ -242,6 +387,11 @@ IpEndpointName UdpSocket::LocalEndpointFor( const IpEndpointName& remoteEndpoint
 	return impl_->LocalEndpointFor( remoteEndpoint );
 }
 
+IpEndpointName UdpSocket::LocalEndpoint() const
+{
+	return impl_->LocalEndpoint();
+}
+
 void UdpSocket::Connect( const IpEndpointName& remoteEndpoint, bool multicast )
 {
 	impl_->Connect( remoteEndpoint, multicast );
@@ -257,6 +407,11 @@ void UdpSocket::SendTo( const IpEndpointName& remoteEndpoint, const char *data,
 	impl_->SendTo( remoteEndpoint, data, size );
 }
 
+void UdpSocket::SendToMultiple( const IpEndpointName *remoteEndpoints, int count, const char *data, int size )
+{
+	impl_->SendToMultiple( remoteEndpoints, count, data, size );
+}
+
 void UdpSocket::Bind( const IpEndpointName& localEndpoint )
 {
 	impl_->Bind( localEndpoint );
@@ -267,11 +422,31 @@ bool UdpSocket::IsBound() const
 	return impl_->IsBound();
 }
 
+void UdpSocket::SetReuseAddress()
+{
+	impl_->SetReuseAddress();
+}
+
+void UdpSocket::JoinMulticastGroup( const IpEndpointName& group, const IpEndpointName& localInterface )
+{
+	impl_->JoinMulticastGroup( group, localInterface );
+}
+
 int UdpSocket::ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size )
 {
 	return impl_->ReceiveFrom( remoteEndpoint, data, size );
 }
 
+void UdpSocket::EnableReceiveTimestamps()
+{
+	impl_->EnableReceiveTimestamps();
+}
+
+unsigned long long UdpSocket::LastReceiveTimestamp() const
+{
+	return impl_->LastReceiveTimestamp();
+}
+
 
 struct AttachedTimerListener{
 	AttachedTimerListener( int id, int p, TimerListener *tl )
@@ -306,6 +481,7 @@ class SocketReceiveMultiplexer::Implementation{
 	std::vector< AttachedTimerListener > timerListeners_;
 
 	volatile bool break_;
+	bool busyPoll_;
 	int breakPipe_[2]; // [0] is the reader descriptor and [1] the writer
 
 	double GetCurrentTimeMs() const
@@ -319,6 +495,7 @@ class SocketReceiveMultiplexer::Implementation{
 
 public:
     Implementation()
+		: busyPoll_( false )
 	{
 		if( pipe(breakPipe_) != 0 )
 			throw std::runtime_error( "creation of asynchronous break pipes failed\n" );
@@ -425,6 +602,12 @@ public:
 				timeout.tv_usec = (long)((timeoutMs - (timeout.tv_sec * 1000)) * 1000);
 				timeoutPtr = &timeout;
 			}
+			if( busyPoll_ ){
+				// return straight away whether or not anything has arrived
+				timeout.tv_sec = 0;
+				timeout.tv_usec = 0;
+				timeoutPtr = &timeout;
+			}
 
 			if( select( fdmax + 1, &tempfds, 0, 0, timeoutPtr ) < 0 && errno != EINTR ){
    				throw std::runtime_error("select failed\n");
@@ -473,6 +656,8 @@ public:
 		delete [] data;
 	}
 
+	void SetBusyPoll( bool enabled ) { busyPoll_ = enabled; }
+
     void Break()
 	{
 		break_ = true;
@@ -524,6 +709,11 @@ void SocketReceiveMultiplexer::DetachPeriodicTimerListener( TimerListener *liste
 	impl_->DetachPeriodicTimerListener( listener );
 }
 
+void SocketReceiveMultiplexer::SetBusyPoll( bool enabled )
+{
+	impl_->SetBusyPoll( enabled );
+}
+
 void SocketReceiveMultiplexer::Run()
 {
 	impl_->Run();
@@ -86,3 +86,28 @@ unsigned long GetHostByName( const char *name )
 
     return result;
 }
+
+
+unsigned long long GetCurrentTimeNs()
+{
+    // FILETIME counts 100ns intervals since 1601-01-01
+    FILETIME fileTime;
+    GetSystemTimeAsFileTime( &fileTime );
+    unsigned long long t = ((unsigned long long)fileTime.dwHighDateTime << 32) | fileTime.dwLowDateTime;
+    const unsigned long long UNIX_EPOCH_IN_FILETIME = 116444736000000000ULL;
+    return (t - UNIX_EPOCH_IN_FILETIME) * 100ULL;
+}
+
+
+bool SetCurrentThreadAffinity( int cpu )
+{
+    if( cpu < 0 || cpu >= (int)(sizeof(DWORD_PTR) * 8) )
+        return false;
+    return SetThreadAffinityMask( GetCurrentThread(), (DWORD_PTR)1 << cpu ) != 0;
+}
+
+
+bool SetCurrentThreadRealtime()
+{
+    return SetThreadPriority( GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL ) != 0;
+}
@@ -32,6 +32,7 @@
 #include "ip/UdpSocket.h"
 
 #include <winsock2.h>   // this must come first to prevent errors with MSVC7
+#include <ws2tcpip.h>   // for ip_mreq
 #include <windows.h>
 #include <mmsystem.h>   // for timeGetTime()
 
@@ -89,12 +90,17 @@ class UdpSocket::Implementation{
 	struct sockaddr_in connectedAddr_;
 	struct sockaddr_in sendToAddr_;
 
+	bool timestampsEnabled_;
+	unsigned long long lastReceiveTimestamp_;
+
 public:
 
 	Implementation()
 		: isBound_( false )
 		, isConnected_( false )
 		, socket_( INVALID_SOCKET )
+		, timestampsEnabled_( false )
+		, lastReceiveTimestamp_( 0 )
 	{
 		if( (socket_ = socket( AF_INET, SOCK_DGRAM, 0 )) == INVALID_SOCKET ){
             throw std::runtime_error("unable to create udp socket\n");
@@ -184,6 +190,12 @@ public:
         sendto( socket_, data, size, 0, (sockaddr*)&sendToAddr_, sizeof(sendToAddr_) );
 	}
 
+	void SendToMultiple( const IpEndpointName *remoteEndpoints, int count, const char *data, int size )
+	{
+		for( int i=0; i < count; ++i )
+			SendTo( remoteEndpoints[i], data, size );
+	}
+
 	void Bind( const IpEndpointName& localEndpoint )
 	{
 		struct sockaddr_in bindSockAddr;
@@ -198,6 +210,41 @@ public:
 
 	bool IsBound() const { return isBound_; }
 
+	IpEndpointName LocalEndpoint() const
+	{
+		assert( isBound_ );
+
+        struct sockaddr_in sockAddr;
+        memset( (char *)&sockAddr, 0, sizeof(sockAddr ) );
+        socklen_t length = sizeof(sockAddr);
+        if (getsockname(socket_, (struct sockaddr *)&sockAddr, &length) < 0) {
+            throw std::runtime_error("unable to getsockname\n");
+        }
+
+		return IpEndpointNameFromSockaddr( sockAddr );
+	}
+
+	void SetReuseAddress()
+	{
+		int enable = 1;
+		setsockopt( socket_, SOL_SOCKET, SO_REUSEADDR, (const char*)&enable, sizeof(enable) );
+	}
+
+	void JoinMulticastGroup( const IpEndpointName& group, const IpEndpointName& localInterface )
+	{
+		struct ip_mreq request;
+		memset( &request, 0, sizeof(request) );
+		request.imr_multiaddr.s_addr = htonl( group.address );
+		request.imr_interface.s_addr =
+			(localInterface.address == IpEndpointName::ANY_ADDRESS)
+			? htonl( INADDR_ANY )
+			: htonl( localInterface.address );
+
+		if (setsockopt(socket_, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&request, sizeof(request)) < 0) {
+			throw std::runtime_error("unable to join multicast group\n");
+		}
+	}
+
     int ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size )
 	{
 		assert( isBound_ );
@@ -210,12 +257,19 @@ public:
 		if( result < 0 )
 			return 0;
 
+		// winsock has no kernel receive timestamps for udp
+		if( timestampsEnabled_ )
+			lastReceiveTimestamp_ = GetCurrentTimeNs();
+
 		remoteEndpoint.address = ntohl(fromAddr.sin_addr.s_addr);
 		remoteEndpoint.port = ntohs(fromAddr.sin_port);
 
 		return result;
 	}
 
+	void EnableReceiveTimestamps() { timestampsEnabled_ = true; }
+	unsigned long long LastReceiveTimestamp() const { return lastReceiveTimestamp_; }
+
 	SOCKET& Socket() { return socket_; }
 };
 
@@ -234,6 +288,11 @@ IpEndpointName UdpSocket::LocalEndpointFor( const IpEndpointName& remoteEndpoint
 	return impl_->LocalEndpointFor( remoteEndpoint );
 }
 
+IpEndpointName UdpSocket::LocalEndpoint() const
+{
+	return impl_->LocalEndpoint();
+}
+
 void UdpSocket::Connect( const IpEndpointName& remoteEndpoint, bool multicast )
 {
 	impl_->Connect( remoteEndpoint, multicast );
@@ -249,6 +308,11 @@ void UdpSocket::SendTo( const IpEndpointName& remoteEndpoint, const char *data,
 	impl_->SendTo( remoteEndpoint, data, size );
 }
 
+void UdpSocket::SendToMultiple( const IpEndpointName *remoteEndpoints, int count, const char *data, int size )
+{
+	impl_->SendToMultiple( remoteEndpoints, count, data, size );
+}
+
 void UdpSocket::Bind( const IpEndpointName& localEndpoint )
 {
 	impl_->Bind( localEndpoint );
@@ -259,11 +323,31 @@ bool UdpSocket::IsBound() const
 	return impl_->IsBound();
 }
 
+void UdpSocket::SetReuseAddress()
+{
+	impl_->SetReuseAddress();
+}
+
+void UdpSocket::JoinMulticastGroup( const IpEndpointName& group, const IpEndpointName& localInterface )
+{
+	impl_->JoinMulticastGroup( group, localInterface );
+}
+
 int UdpSocket::ReceiveFrom( IpEndpointName& remoteEndpoint, char *data, int size )
 {
 	return impl_->ReceiveFrom( remoteEndpoint, data, size );
 }
 
+void UdpSocket::EnableReceiveTimestamps()
+{
+	impl_->EnableReceiveTimestamps();
+}
+
+unsigned long long UdpSocket::LastReceiveTimestamp() const
+{
+	return impl_->LastReceiveTimestamp();
+}
+
 
 struct AttachedTimerListener{
 	AttachedTimerListener( int id, int p, TimerListener *tl )
@@ -300,6 +384,7 @@ class SocketReceiveMultiplexer::Implementation{
 	std::vector< AttachedTimerListener > timerListeners_;
 
 	volatile bool break_;
+	bool busyPoll_;
 	HANDLE breakEvent_;
 
 	double GetCurrentTimeMs() const
@@ -309,6 +394,7 @@ class SocketReceiveMultiplexer::Implementation{
 
 public:
     Implementation()
+		: busyPoll_( false )
 	{
 		breakEvent_ = CreateEvent( NULL, FALSE, FALSE, NULL );
 	}
@@ -405,13 +491,17 @@ public:
                             ? timerQueue_.front().first - currentTimeMs
                             : 0 );
             }
+			if( busyPoll_ )
+				waitTime = 0; // return straight away whether or not anything has arrived
 
 			DWORD waitResult = WaitForMultipleObjects( (DWORD)socketListeners_.size() + 1, &events[0], FALSE, waitTime );
 			if( break_ )
 				break;
 
-			if( waitResult != WAIT_TIMEOUT ){
-				for( int i = waitResult - WAIT_OBJECT_0; i < (int)socketListeners_.size(); ++i ){
+			if( waitResult != WAIT_TIMEOUT || busyPoll_ ){
+				// the sockets are non-blocking, so when busy polling just try them all
+				int first = (waitResult == WAIT_TIMEOUT) ? 0 : (int)(waitResult - WAIT_OBJECT_0);
+				for( int i = first; i < (int)socketListeners_.size(); ++i ){
 					int size = socketListeners_[i].second->ReceiveFrom( remoteEndpoint, data, MAX_BUFFER_SIZE );
 					if( size > 0 ){
 						socketListeners_[i].first->ProcessPacket( data, size, remoteEndpoint );
@@ -452,6 +542,8 @@ public:
 		}
 	}
 
+	void SetBusyPoll( bool enabled ) { busyPoll_ = enabled; }
+
     void Break()
 	{
 		break_ = true;
@@ -501,6 +593,11 @@ void SocketReceiveMultiplexer::DetachPeriodicTimerListener( TimerListener *liste
 	impl_->DetachPeriodicTimerListener( listener );
 }
 
+void SocketReceiveMultiplexer::SetBusyPoll( bool enabled )
+{
+	impl_->SetBusyPoll( enabled );
+}
+
 void SocketReceiveMultiplexer::Run()
 {
 	impl_->Run();
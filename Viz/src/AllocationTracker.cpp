@@ -0,0 +1,296 @@
+//
+//  AllocationTracker.cpp
+//  EnsembleVisualization
+//
+
+// This module
+#include "AllocationTracker.h"
+
+// Project
+#include "Log.h"
+
+// C++ std
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+using namespace std;
+
+
+namespace
+{
+    struct Counts
+    {
+        unsigned long long count;
+        unsigned long long bytes;
+    };
+
+    /// Read on every allocation, so plain thread locals with constant
+    /// initializers that need no setting up
+    thread_local int tTag = ALLOC_OTHER;
+    thread_local bool tIsFrameThread = false;
+
+    /// Only touched by the frame thread
+    Counts gThisFrame[NUM_ALLOCATION_TAGS];
+    Counts gLastFrame[NUM_ALLOCATION_TAGS];
+    Counts gAllFrames[NUM_ALLOCATION_TAGS];
+    unsigned long long gNumFrames = 0;
+
+    atomic<unsigned long long> gOtherThreadsCount(0);
+    atomic<unsigned long long> gOtherThreadsBytes(0);
+
+    bool gExpectNoAllocations = false;
+    /// Frames before this are warming up
+    unsigned long long gFirstCheckedFrame = 0;
+
+#if defined(VIZ_TRACK_ALLOCATIONS)
+    inline void countAllocation(std::size_t size)
+    {
+        if (tIsFrameThread)
+        {
+            ++gThisFrame[tTag].count;
+            gThisFrame[tTag].bytes += size;
+        }
+        else
+        {
+            gOtherThreadsCount.fetch_add(1, memory_order_relaxed);
+            gOtherThreadsBytes.fetch_add(size, memory_order_relaxed);
+        }
+    }
+
+#if defined(__cpp_aligned_new)
+    void* alignedMalloc(std::size_t size, std::align_val_t alignment)
+    {
+        std::size_t align = std::size_t(alignment);
+        if (align < sizeof(void*))
+            align = sizeof(void*);
+#if defined(_MSC_VER)
+        return _aligned_malloc(size ? size : 1, align);
+#else
+        void* p = NULL;
+        return posix_memalign(&p, align, size ? size : 1) == 0? p : NULL;
+#endif
+    }
+
+    void alignedFree(void* p)
+    {
+#if defined(_MSC_VER)
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+#endif
+#endif
+
+    void writeCounts(ostream& out, double count, double bytes)
+    {
+        out << std::setw(8) << count << " (" << std::setw(8) << bytes / 1024 << " kB)";
+    }
+}
+
+
+#if defined(VIZ_TRACK_ALLOCATIONS)
+void* operator new(std::size_t size)
+{
+    countAllocation(size);
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) throw()
+{
+    countAllocation(size);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) throw()
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) throw()
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::nothrow_t const&) throw()
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::nothrow_t const&) throw()
+{
+    std::free(p);
+}
+
+// What C++14 calls when it knows the size
+void operator delete(void* p, std::size_t) throw()
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) throw()
+{
+    std::free(p);
+}
+
+// What C++17 calls for types aligned beyond what malloc guarantees
+#if defined(__cpp_aligned_new)
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    countAllocation(size);
+    void* p = alignedMalloc(size, alignment);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{
+    countAllocation(size);
+    return alignedMalloc(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{
+    return operator new(size, alignment, std::nothrow);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+    alignedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t, std::nothrow_t const&) noexcept
+{
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t, std::nothrow_t const&) noexcept
+{
+    alignedFree(p);
+}
+#endif
+#endif
+
+
+bool AllocationTracker::isCompiledIn()
+{
+#if defined(VIZ_TRACK_ALLOCATIONS)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AllocationTracker::setFrameThread()
+{
+    tIsFrameThread = true;
+}
+
+void AllocationTracker::frameEnded()
+{
+    bool allocated = false;
+    for (int i=0; i<NUM_ALLOCATION_TAGS; ++i)
+    {
+        gLastFrame[i] = gThisFrame[i];
+        gAllFrames[i].count += gThisFrame[i].count;
+        gAllFrames[i].bytes += gThisFrame[i].bytes;
+        allocated = allocated || gThisFrame[i].count > 0;
+        gThisFrame[i].count = gThisFrame[i].bytes = 0;
+    }
+    ++gNumFrames;
+
+    if (gExpectNoAllocations && allocated && gNumFrames >= gFirstCheckedFrame)
+    {
+        VIZ_LOG("ERROR: frame " << gNumFrames << " allocated in the steady state\n" << status());
+        Log::flush();
+        std::abort();
+    }
+}
+
+void AllocationTracker::setExpectNoAllocations(bool enabled, int warmUpFrames)
+{
+    gExpectNoAllocations = enabled;
+    gFirstCheckedFrame = gNumFrames + warmUpFrames;
+}
+
+std::string AllocationTracker::status()
+{
+    if (!isCompiledIn())
+        return "Allocation tracking off (build with VIZ_TRACK_ALLOCATIONS)";
+
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    ss << std::left << std::setw(10) << "allocs" << std::right
+       << std::setw(22) << "last frame" << std::setw(22) << "per frame";
+    for (int i=0; i<NUM_ALLOCATION_TAGS; ++i)
+    {
+        ss << "\n" << std::left << std::setw(10) << tagName(AllocationTag(i)) << std::right;
+        writeCounts(ss, double(gLastFrame[i].count), double(gLastFrame[i].bytes));
+        if (gNumFrames > 0)
+            writeCounts(ss, double(gAllFrames[i].count) / gNumFrames, double(gAllFrames[i].bytes) / gNumFrames);
+    }
+    ss << "\nother threads " << gOtherThreadsCount.load() << " since launch ("
+       << gOtherThreadsBytes.load() / 1024 / 1024. << " MB)";
+    return ss.str();
+}
+
+const char* AllocationTracker::tagName(AllocationTag tag)
+{
+    switch (tag)
+    {
+        case ALLOC_OTHER: return "other";
+        case ALLOC_RENDERER: return "renderer";
+        case ALLOC_OSC: return "OSC";
+        case ALLOC_EDITOR: return "editor";
+        case ALLOC_STATE: return "state";
+        default: return "?";
+    }
+}
+
+
+AllocationScope::AllocationScope(AllocationTag tag)
+: mPrevious(AllocationTag(tTag))
+{
+    tTag = tag;
+}
+
+AllocationScope::~AllocationScope()
+{
+    tTag = mPrevious;
+}
@@ -0,0 +1,68 @@
+//
+//  AllocationTracker.h
+//  EnsembleVisualization
+//
+//  Counts heap allocations made on the render thread each frame, split by
+//  the subsystem that made them, to find what allocates in the frame loop.
+//
+//  Opt-in: counting needs the global operator new replaced, which is only
+//  done when the project is built with VIZ_TRACK_ALLOCATIONS defined, as
+//  the Debug configurations are.
+//  Without it the tags below cost next to nothing and status() says so.
+//
+//      void Renderer::draw(float elapsedTime)
+//      {
+//          AllocationScope allocations(ALLOC_RENDERER);
+//          ...
+//
+
+#pragma once
+#include <string>
+
+
+enum AllocationTag
+{
+    ALLOC_OTHER,
+    ALLOC_RENDERER,
+    ALLOC_OSC,
+    ALLOC_EDITOR,
+    ALLOC_STATE,
+    NUM_ALLOCATION_TAGS
+};
+
+
+class AllocationTracker
+{
+public:
+    /// Whether this build counts allocations (VIZ_TRACK_ALLOCATIONS)
+    static bool isCompiledIn();
+
+    /// Make the calling thread the render thread, whose allocations are
+    /// counted per frame. Other threads only get a running total.
+    static void setFrameThread();
+    /// Call on the render thread at the end of each frame
+    static void frameEnded();
+
+    /// Test mode: once warmUpFrames frames have gone, any allocation in a
+    /// frame is logged with its breakdown and the app aborted, so a steady
+    /// state frame loop can be checked to make no allocations at all
+    static void setExpectNoAllocations(bool enabled, int warmUpFrames=300);
+
+    /// Last frame and average per frame, by tag. Render thread only.
+    static std::string status();
+
+    static const char* tagName(AllocationTag tag);
+};
+
+
+/// Attributes allocations on this thread to a tag until it goes out of
+/// scope. Scopes nest.
+class AllocationScope
+{
+public:
+    explicit AllocationScope(AllocationTag tag);
+    ~AllocationScope();
+
+private:
+    AllocationTag mPrevious;
+};
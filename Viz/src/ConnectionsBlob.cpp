@@ -0,0 +1,226 @@
+//
+//  ConnectionsBlob.cpp
+//  EnsembleVisualization
+//
+
+#include "ConnectionsBlob.h"
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+
+namespace
+{
+    unsigned int readUInt32(char const* p)
+    {
+        unsigned char const* u = reinterpret_cast<unsigned char const*>(p);
+        return (unsigned int)u[0]<<24 | (unsigned int)u[1]<<16 | (unsigned int)u[2]<<8 | (unsigned int)u[3];
+    }
+
+    unsigned short readUInt16(char const* p)
+    {
+        unsigned char const* u = reinterpret_cast<unsigned char const*>(p);
+        return (unsigned short)(u[0]<<8 | u[1]);
+    }
+
+    float readFloat32(char const* p)
+    {
+        unsigned int bits = readUInt32(p);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    void writeUInt16(vector<char>& out, unsigned short value)
+    {
+        out.push_back(char(value>>8));
+        out.push_back(char(value & 0xff));
+    }
+
+    void writeFloat32(vector<char>& out, float value)
+    {
+        unsigned int bits;
+        memcpy(&bits, &value, sizeof(bits));
+        out.push_back(char(bits>>24));
+        out.push_back(char((bits>>16) & 0xff));
+        out.push_back(char((bits>>8) & 0xff));
+        out.push_back(char(bits & 0xff));
+    }
+}
+
+
+unsigned short floatToHalf(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned int sign = (bits >> 16) & 0x8000;
+    int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff)
+        // Inf or NaN (keep NaNs NaN)
+        return (unsigned short)(sign | 0x7c00 | (mantissa? 0x200 : 0));
+    if (exponent >= 31)
+        // too big, round to infinity
+        return (unsigned short)(sign | 0x7c00);
+    if (exponent <= 0)
+    {
+        // subnormal or zero
+        if (exponent < -10)
+            return (unsigned short)sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        unsigned int half = mantissa >> shift;
+        unsigned int remainder = mantissa & ((1u << shift) - 1);
+        unsigned int halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            ++half;
+        return (unsigned short)(sign | half);
+    }
+    unsigned int half = sign | (unsigned int)exponent << 10 | mantissa >> 13;
+    unsigned int remainder = mantissa & 0x1fff;
+    // a carry out of the mantissa correctly bumps the exponent
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        ++half;
+    return (unsigned short)half;
+}
+
+float halfToFloat(unsigned short half)
+{
+    unsigned int sign = (unsigned int)(half & 0x8000) << 16;
+    unsigned int exponent = (half >> 10) & 0x1f;
+    unsigned int mantissa = half & 0x3ff;
+    unsigned int bits;
+    if (exponent == 0x1f)
+    {
+        bits = sign | 0x7f800000 | mantissa << 13;
+    }
+    else if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // subnormal: normalise it
+            int e = -1;
+            do
+            {
+                ++e;
+                mantissa <<= 1;
+            } while ((mantissa & 0x400) == 0);
+            bits = sign | (unsigned int)(127 - 15 - e) << 23 | (mantissa & 0x3ff) << 13;
+        }
+    }
+    else
+    {
+        bits = sign | (exponent + 127 - 15) << 23 | mantissa << 13;
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+bool decodeConnectionsBlob(int numInstruments, int encoding, std::vector<char> const& blob, State& o_state, std::string& o_error)
+{
+    std::ostringstream error;
+    if (numInstruments < 0 || numInstruments > (int)o_state.instruments.size())
+    {
+        error << "blob declares "<<numInstruments<<" instruments but we are only setup to work with "<<o_state.instruments.size();
+        o_error = error.str();
+        return false;
+    }
+    const int n = numInstruments;
+    char const* data = blob.empty()? NULL : &blob[0];
+
+    switch (encoding)
+    {
+        case CONNECTIONS_FLOAT32:
+        case CONNECTIONS_FLOAT16:
+        {
+            const size_t valueSize = encoding==CONNECTIONS_FLOAT32? 4 : 2;
+            if (blob.size() != n*n*valueSize)
+            {
+                error << "blob declares "<<n<<" instruments so should have "<<n*n*valueSize<<" bytes but has "<<blob.size();
+                o_error = error.str();
+                return false;
+            }
+            for (int i=0; i<n; i++)
+            {
+                vector<float>& connections = o_state.instruments[i].connections;
+                for (int j=0; j<n; j++)
+                {
+                    char const* p = data + (i*n + j)*valueSize;
+                    connections[j] = encoding==CONNECTIONS_FLOAT32
+                        ? readFloat32(p)
+                        : halfToFloat(readUInt16(p));
+                }
+            }
+            return true;
+        }
+        case CONNECTIONS_SPARSE_DELTA:
+        {
+            if (blob.size() % 4 != 0)
+            {
+                error << "sparse blob has "<<blob.size()<<" bytes, which is not a whole number of entries";
+                o_error = error.str();
+                return false;
+            }
+            const size_t numEntries = blob.size() / 4;
+            // check every index before changing anything
+            for (size_t k=0; k<numEntries; k++)
+            {
+                int index = readUInt16(data + 4*k);
+                if (index >= n*n)
+                {
+                    error << "sparse blob entry "<<k<<" has index "<<index<<" which is out of bounds for "<<n<<" instruments";
+                    o_error = error.str();
+                    return false;
+                }
+            }
+            for (size_t k=0; k<numEntries; k++)
+            {
+                int index = readUInt16(data + 4*k);
+                o_state.instruments[index / n].connections[index % n] = halfToFloat(readUInt16(data + 4*k + 2));
+            }
+            return true;
+        }
+        default:
+            error << "unknown encoding "<<encoding;
+            o_error = error.str();
+            return false;
+    }
+}
+
+void encodeConnectionsBlob(State const& state, int numInstruments, ConnectionsEncoding encoding, std::vector<char>& o_blob, State const* previous)
+{
+    const int n = numInstruments;
+    o_blob.clear();
+    for (int i=0; i<n; i++)
+    {
+        vector<float> const& connections = state.instruments.at(i).connections;
+        for (int j=0; j<n; j++)
+        {
+            float v = connections.at(j);
+            if (encoding == CONNECTIONS_FLOAT32)
+            {
+                writeFloat32(o_blob, v);
+            }
+            else if (encoding == CONNECTIONS_FLOAT16)
+            {
+                writeUInt16(o_blob, floatToHalf(v));
+            }
+            else
+            {
+                unsigned short half = floatToHalf(v);
+                if (previous != NULL && half == floatToHalf(previous->instruments.at(i).connections.at(j)))
+                    continue;
+                writeUInt16(o_blob, (unsigned short)(i*n + j));
+                writeUInt16(o_blob, half);
+            }
+        }
+    }
+}
@@ -0,0 +1,46 @@
+//
+//  ConnectionsBlob.h
+//  EnsembleVisualization
+//
+//  Compact binary encoding of the connection matrix, sent as
+//  /viz/connections_blob <int numInstruments> <int encoding> <blob payload>
+//  instead of one float argument per connection.
+//
+//  All values in the payload are big-endian, like the rest of OSC.
+//  Dense encodings store the matrix row-major: entry i*numInstruments+j is
+//  the connection from instrument i to instrument j (same order as the
+//  arguments of /viz/connections).
+//
+
+#pragma once
+#include <vector>
+#include <string>
+
+#include "State.h"
+
+enum ConnectionsEncoding
+{
+    /// numInstruments^2 32-bit floats
+    CONNECTIONS_FLOAT32 = 0,
+    /// numInstruments^2 16-bit (IEEE half precision) floats
+    CONNECTIONS_FLOAT16 = 1,
+    /// Only the entries that changed since the previous frame, each as a
+    /// 16-bit matrix index followed by a 16-bit float. Entries not listed
+    /// keep their current value, so senders should send a dense frame
+    /// every so often in case a packet was lost.
+    CONNECTIONS_SPARSE_DELTA = 2
+};
+
+/// Writes the connections of a /viz/connections_blob payload straight into
+/// the instruments of o_state. On a malformed payload returns false, sets
+/// o_error and leaves o_state untouched.
+bool decodeConnectionsBlob(int numInstruments, int encoding, std::vector<char> const& blob, State& o_state, std::string& o_error);
+
+/// Encodes the first numInstruments instruments' connections of state.
+/// For CONNECTIONS_SPARSE_DELTA only entries that differ from previous are
+/// written; pass NULL to write them all.
+void encodeConnectionsBlob(State const& state, int numInstruments, ConnectionsEncoding encoding, std::vector<char>& o_blob, State const* previous=NULL);
+
+/// IEEE 754 half precision conversion (round to nearest even)
+unsigned short floatToHalf(float value);
+float halfToFloat(unsigned short half);
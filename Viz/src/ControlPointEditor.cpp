@@ -9,15 +9,16 @@
 // This module
 #include "ControlPointEditor.h"
 
+// Project
+#include "Homography.h"
+#include "Log.h"
+#include "Trace.h"
+
 // TMB
 using tmb::Quad;
 
-// OpenCV
-#include <opencv/cv.hpp>
-
 // Cinder
 #include <cinder/Utilities.h>
-#include <cinder/ImageIo.h>
 //#include <cinder/Matrix.h>
 using namespace ci;
 
@@ -33,63 +34,38 @@ using namespace ci;
 using namespace std;
 
 
-// + Helpers pulled out of Cinder OpenCV block {{{
-//#include "CinderOpenCV.h"
-
-class ImageTargetCvMat : public ImageTarget {
-  public:
-	static std::shared_ptr<ImageTargetCvMat> createRef( cv::Mat *mat ) { return std::shared_ptr<ImageTargetCvMat>( new ImageTargetCvMat( mat ) ); }
-
-	virtual bool hasAlpha() const { return mMat->channels() == 4; }	
-	virtual void*	getRowPointer( int32_t row ) { return reinterpret_cast<void*>( reinterpret_cast<uint8_t*>(mMat->data) + row * mMat->step ); }
-	
-  protected:
-	ImageTargetCvMat( cv::Mat *mat );
-	
-	cv::Mat		*mMat;
-};
-
-inline cv::Mat toOcv(ci::ImageSourceRef sourceRef, int type = -1)
-{
-	if( type == -1 )
-    {
-		int depth = CV_8U;
-		if( sourceRef->getDataType() == ImageIo::UINT16 )
-			depth = CV_16U;
-		else if( sourceRef->getDataType() == ImageIo::FLOAT32 )
-			depth = CV_32F;
-		int channels = ImageIo::channelOrderNumChannels( sourceRef->getChannelOrder() );
-		type = CV_MAKETYPE( depth, channels );
-	}
-	
-	cv::Mat result( sourceRef->getHeight(), sourceRef->getWidth(), type );
-	ImageTargetRef target = ImageTargetCvMat::createRef( &result );
-	sourceRef->load( target );
-	return result;
-}
-
-inline cv::Scalar toOcv( const Color &color )
-{
-	return CV_RGB( color.r * 255, color.g * 255, color.b * 255 );
-}
-
-inline cv::Point2f toOcv( const Vec2f &point )
+namespace
 {
-	return cv::Point2f( point.x, point.y );
-}
+    /// Mesh points each way of a mesh added in the warp editor
+    const int DEFAULT_MESH_SIZE = 5;
 
-inline cv::Point toOcv( const Vec2i &point )
-{
-	return cv::Point( point.x, point.y );
-}
+    /// Catmull-Rom through p[1] and p[2], t from 0 to 1 between them
+    Vec2f catmullRom(Vec2f const p[4], float t)
+    {
+        return Renderer::hermiteSpline(p[1], (p[2] - p[0]) * 0.5f, p[2], (p[3] - p[1]) * 0.5f, t);
+    }
 
-inline cv::Rect toOcv( const ci::Area &r )
-{
-	return cv::Rect( r.x1, r.y1, r.getWidth(), r.getHeight() );
+    /// A head's mesh offset at column u and row v of its mesh, smoothly
+    /// interpolated between the mesh points
+    Vec2f meshOffset(ControlPointEditor::Head const& head, float u, float v)
+    {
+        Vec2i size = head.meshSize;
+        int column = min(int(u), size.x - 2);
+        int row = min(int(v), size.y - 2);
+        // along each of the four rows around, then across them
+        Vec2f across[4];
+        for (int i=0; i<4; i++)
+        {
+            int r = max(0, min(size.y - 1, row - 1 + i));
+            Vec2f along[4];
+            for (int j=0; j<4; j++)
+                along[j] = head.meshOffsets[r * size.x + max(0, min(size.x - 1, column - 1 + j))];
+            across[i] = catmullRom(along, u - column);
+        }
+        return catmullRom(across, v - row);
+    }
 }
 
-// + }}}
-
 
 ControlPointEditor::ControlPointEditor()
     : mRenderer(NULL)
@@ -97,12 +73,22 @@ ControlPointEditor::ControlPointEditor()
     , mInstrumentVisibility(NUM_INSTRUMENTS, true)
     , mIsInWarpMode(false)
     , mOriginalQuad(Vec2f(-1, 1),Vec2f(1, 1),Vec2f(1, -1),Vec2f(-1, -1))
-    , mEnableSecondHead(true)
-    , mCurrentlyEditingSecondHead(false)
+    , mHeads(2)
+    , mCurrentHead(0)
+    , mDraggedMeshPoint(-1)
+    , mWarpRevision(0)
     , mRenderResolution(1080, 1080)
-    , mHeadResolution(400, 400)
-    , mIsSecondHeadRotated180(true)
     , mRotation(0)
+    , mDecodeOscOnNetworkThread(false)
+    , mOscThreadCpu(-1)
+    , mOscThreadRealtime(false)
+    , mOscBusyPoll(false)
+    , mTraceSeconds(10)
+    , mStatsInterval(1)
+    , mMonitorPort(1123)
+    , mCaptureThreads(2)
+    , mNoiseFieldResolution(0)
+    , mNoiseFieldInterval(1 / 30.f)
 {
     for (int i=0; i<NUM_INSTRUMENTS; i++)
     {
@@ -114,11 +100,13 @@ ControlPointEditor::ControlPointEditor()
     }
     mEditingInstruments[0] = NONE;
     mEditingInstruments[1] = NONE;
-    for (int i=0; i<2; i++)
-    {
-        mWarpQuad[i] = Quad(Vec2f(-1, 1), Vec2f(1, 1), Vec2f(1, -1), Vec2f(-1, -1));
+}
 
-    }
+ControlPointEditor::Head::Head()
+    : resolution(400, 400)
+    , rotation(0)
+    , meshSize(0, 0)
+{
 }
 
 ControlPointEditor::~ControlPointEditor()
@@ -176,6 +164,7 @@ void ControlPointEditor::setup(Renderer* renderer)
 
 void ControlPointEditor::save()
 {
+    TRACE_SCOPE("save control points");
     using namespace Json;
     using ci::toString;
     Value jRoot;
@@ -188,20 +177,58 @@ void ControlPointEditor::save()
                 for (int l=0; l<mControlPoints[i][j][k].DIM; l++)
                     jPoints[i][j][k][l] = mControlPoints[i][j][k][l];
         }
-    Value& jWarpQuads = jRoot["warp quads"];
-    for (int i=0; i<2; i++)
-    {
-        Value& jWarpQuad = jWarpQuads[i];
-        jWarpQuad["top left"] = toString(mWarpQuad[i].tl);
-        jWarpQuad["top right"] = toString(mWarpQuad[i].tr);
-        jWarpQuad["bottom right"] = toString(mWarpQuad[i].br);
-        jWarpQuad["bottom left"] = toString(mWarpQuad[i].bl);
+    Value& jHeads = jRoot["heads"];
+    for (int i=0; i<numHeads(); i++)
+    {
+        Value& jHead = jHeads[i];
+        jHead["top left"] = toString(mHeads[i].warpQuad.tl);
+        jHead["top right"] = toString(mHeads[i].warpQuad.tr);
+        jHead["bottom right"] = toString(mHeads[i].warpQuad.br);
+        jHead["bottom left"] = toString(mHeads[i].warpQuad.bl);
+        jHead["resolution"] = toString(mHeads[i].resolution);
+        jHead["rotation"] = mHeads[i].rotation;
+        if (mHeads[i].hasMesh())
+        {
+            jHead["mesh size"] = toString(mHeads[i].meshSize);
+            Value& jOffsets = jHead["mesh offsets"];
+            for (int k=0; k<mHeads[i].meshOffsets.size(); k++)
+                for (int l=0; l<ci::Vec2f::DIM; l++)
+                    jOffsets[k][l] = mHeads[i].meshOffsets[k][l];
+        }
     }
     jRoot["render resolution"] = toString(mRenderResolution);
-    jRoot["head resolution"] = toString(mHeadResolution);
-    jRoot["enable second head"] = mEnableSecondHead;
     jRoot["rotation"] = mRotation;
     jRoot["host name"] = mHostName;
+    if (!mSharedMemoryName.empty())
+        jRoot["shared memory name"] = mSharedMemoryName;
+    if (!mMulticastGroup.empty())
+        jRoot["multicast group"] = mMulticastGroup;
+    if (mDecodeOscOnNetworkThread)
+        jRoot["decode osc on network thread"] = mDecodeOscOnNetworkThread;
+    if (mOscThreadCpu >= 0)
+        jRoot["osc thread cpu"] = mOscThreadCpu;
+    if (mOscThreadRealtime)
+        jRoot["osc thread realtime"] = mOscThreadRealtime;
+    if (mOscBusyPoll)
+        jRoot["osc busy poll"] = mOscBusyPoll;
+    if (mTraceSeconds != 10)
+        jRoot["trace seconds"] = mTraceSeconds;
+    if (mStatsInterval != 1)
+        jRoot["stats interval"] = mStatsInterval;
+    if (!mMonitorHost.empty())
+    {
+        jRoot["monitor host"] = mMonitorHost;
+        jRoot["monitor port"] = mMonitorPort;
+    }
+    if (mCaptureThreads != 2)
+        jRoot["capture threads"] = mCaptureThreads;
+    if (!mFrameExportName.empty())
+        jRoot["frame export name"] = mFrameExportName;
+    if (mNoiseFieldResolution > 0)
+    {
+        jRoot["noise field resolution"] = mNoiseFieldResolution;
+        jRoot["noise field interval"] = mNoiseFieldInterval;
+    }
     ofstream out;
     out.open(mJsonFilename.c_str());
     if (out.good())
@@ -221,6 +248,7 @@ void ControlPointEditor::save()
 
 void ControlPointEditor::load()
 {
+    TRACE_SCOPE("load control points");
     cout << "Loading "<<mJsonFilename<<"..."<<endl;
     using namespace Json;
     Value jRoot;
@@ -245,6 +273,21 @@ void ControlPointEditor::load()
         mHostName = jHostName.asString();
         cout << "Loaded hostname: "<<mHostName<<endl;
     }
+    // optional
+    mSharedMemoryName = jRoot.get("shared memory name", "").asString();
+    mMulticastGroup = jRoot.get("multicast group", "").asString();
+    mDecodeOscOnNetworkThread = jRoot.get("decode osc on network thread", false).asBool();
+    mOscThreadCpu = jRoot.get("osc thread cpu", -1).asInt();
+    mOscThreadRealtime = jRoot.get("osc thread realtime", false).asBool();
+    mOscBusyPoll = jRoot.get("osc busy poll", false).asBool();
+    mTraceSeconds = jRoot.get("trace seconds", 10).asFloat();
+    mStatsInterval = jRoot.get("stats interval", 1).asFloat();
+    mMonitorHost = jRoot.get("monitor host", "").asString();
+    mMonitorPort = jRoot.get("monitor port", 1123).asInt();
+    mCaptureThreads = jRoot.get("capture threads", 2).asInt();
+    mFrameExportName = jRoot.get("frame export name", "").asString();
+    mNoiseFieldResolution = jRoot.get("noise field resolution", 0).asInt();
+    mNoiseFieldInterval = jRoot.get("noise field interval", 1 / 30.).asFloat();
     Value& jRenderResolution = jRoot["render resolution"];
     if (jRenderResolution.isNull())
     {
@@ -255,26 +298,6 @@ void ControlPointEditor::load()
     {
         success = success && (jRenderResolution.asString() >> mRenderResolution);
     }
-    Value& jHeadResolution = jRoot["head resolution"];
-    if (jHeadResolution.isNull())
-    {
-        cout << "WARNING: Could not find 'head resolution' element"<<endl;
-        success = false;
-    }
-    else
-    {
-        success = success && (jHeadResolution.asString() >> mHeadResolution);
-    }
-    Value& jEnableSecondHead = jRoot["enable second head"];
-    if (!jEnableSecondHead.isBool())
-    {
-        cout << "WARNING: Could not find boolean 'enable second head' element"<<endl;
-        success = false;
-    }
-    else
-    {
-        mEnableSecondHead = jEnableSecondHead.asBool();
-    }
     Value& jRotation = jRoot["rotation"];
     if (!jRotation.isNumeric())
     {
@@ -286,32 +309,75 @@ void ControlPointEditor::load()
         mRotation = jRotation.asDouble();
     }
 
-    Value& jWarpQuads = jRoot["warp quads"];
-    if (jWarpQuads.isNull())
+    // Before "heads", there were up to two, their quads under "warp quads"
+    // and their shared size under "head resolution"
+    bool isLegacy = jRoot["heads"].isNull();
+    Value& jHeads = isLegacy? jRoot["warp quads"] : jRoot["heads"];
+    if (!jHeads.isArray() || jHeads.size() == 0)
     {
-        cout << "WARNING: Could not find 'warp quads' element"<<endl;
+        cout << "WARNING: Could not find 'heads' element"<<endl;
         success = false;
     }
     else
     {
-        bool warpSuccess = true;
-        for (int i=0; i<2; i++)
+        int n = jHeads.size();
+        Vec2i legacyResolution = Head().resolution;
+        if (isLegacy)
         {
+            Value& jEnableSecondHead = jRoot["enable second head"];
+            n = min(n, jEnableSecondHead.asBool()? 2 : 1);
+            if (!(jRoot["head resolution"].asString() >> legacyResolution))
+            {
+                cout << "WARNING: Could not find 'head resolution' element"<<endl;
+                success = false;
+            }
+        }
+        mHeads.assign(n, Head());
+        mCurrentHead = min(mCurrentHead, n - 1);
+        for (int i=0; i<n; i++)
+        {
+            Value& jHead = jHeads[i];
             Vec2f tl, tr, br, bl;
-            warpSuccess =
-            (jWarpQuads[i]["top left"].asString()>>tl)
-            && (jWarpQuads[i]["top right"].asString()>>tr)
-            && (jWarpQuads[i]["bottom right"].asString()>>br)
-            && (jWarpQuads[i]["bottom left"].asString()>> bl);
+            bool warpSuccess =
+            (jHead["top left"].asString()>>tl)
+            && (jHead["top right"].asString()>>tr)
+            && (jHead["bottom right"].asString()>>br)
+            && (jHead["bottom left"].asString()>> bl);
             if (warpSuccess)
             {
-                mWarpQuad[i] = tmb::Quad(tl, tr, br, bl);
+                mHeads[i].warpQuad = tmb::Quad(tl, tr, br, bl);
             }
             else
             {
-                cout << "WARNING: Failed to parse 'warp quad' element "<<i<<"."<<endl;
+                cout << "WARNING: Failed to parse the quad of head "<<i<<"."<<endl;
                 success = false;
             }
+            if (isLegacy)
+                mHeads[i].resolution = legacyResolution;
+            else if (!(jHead["resolution"].asString() >> mHeads[i].resolution))
+            {
+                cout << "WARNING: Failed to parse the resolution of head "<<i<<"."<<endl;
+                success = false;
+            }
+            mHeads[i].rotation = jHead.get("rotation", 0).asFloat();
+            Value& jMeshSize = jHead["mesh size"];
+            if (!jMeshSize.isNull())
+            {
+                Vec2i meshSize;
+                Value& jOffsets = jHead["mesh offsets"];
+                if (!(jMeshSize.asString() >> meshSize) || meshSize.x < 2 || meshSize.y < 2
+                    || !jOffsets.isArray() || jOffsets.size() != meshSize.x * meshSize.y)
+                {
+                    cout << "WARNING: Failed to parse the mesh of head "<<i<<"."<<endl;
+                    success = false;
+                    continue;
+                }
+                mHeads[i].meshSize = meshSize;
+                mHeads[i].meshOffsets.resize(jOffsets.size());
+                for (int k=0; k<jOffsets.size(); k++)
+                    for (int l=0; l<ci::Vec2f::DIM; l++)
+                        mHeads[i].meshOffsets[k][l] = (float) jOffsets[k][l].asDouble();
+            }
         }
     }
     updateWarpTransform();
@@ -490,6 +556,16 @@ void ControlPointEditor::draw(float elapsedTime)
         gl::drawSolidCircle(mOriginalQuad.tr, radius, 20);
         gl::drawSolidCircle(mOriginalQuad.br, radius, 20);
         gl::drawSolidCircle(mOriginalQuad.bl, radius, 20);
+        // and the mesh points of the head being edited, where they are in
+        // the render
+        Head const& head = mHeads.at(mCurrentHead);
+        gl::color(1,.6,0,0.9);
+        for (int i=0; i<head.meshOffsets.size(); i++)
+        {
+            int column = i % head.meshSize.x;
+            int row = i / head.meshSize.x;
+            gl::drawSolidCircle(Vec2f(column / float(head.meshSize.x - 1) * 2 - 1, 1 - row / float(head.meshSize.y - 1) * 2), 0.04, 12);
+        }
     }
 
     // status text
@@ -533,20 +609,42 @@ void ControlPointEditor::keyPressed(ci::app::KeyEvent event)
             }
             else if (mIsInWarpMode)
             {
-                if (key=='0')
-                    mCurrentlyEditingSecondHead = false;
-                else if (key=='1')
-                    mCurrentlyEditingSecondHead = true;
+                if (0 <= inst && inst < numHeads())
+                    mCurrentHead = inst;
             }
         }
+        else if (mIsInWarpMode && (key=='[' || key==']'))
+        {
+            // the number keys only reach the first 8 heads
+            mCurrentHead = (mCurrentHead + (key==']'? 1 : numHeads() - 1)) % numHeads();
+            VIZ_LOG("Warping head " << mCurrentHead);
+        }
         else if (mIsInSetupMode && event.getCode()==cinder::app::KeyEvent::KEY_BACKSPACE && ctrlPressed)
         {
             clearPoints();
         }
         else if (mIsInWarpMode && event.getCode()==cinder::app::KeyEvent::KEY_BACKSPACE && ctrlPressed)
         {
-            mWarpQuad[0] = mOriginalQuad;
-            mWarpQuad[1] = mOriginalQuad;
+            for (size_t i=0; i<mHeads.size(); i++)
+            {
+                mHeads[i].warpQuad = mOriginalQuad;
+                mHeads[i].meshOffsets.assign(mHeads[i].meshOffsets.size(), Vec2f(0, 0));
+            }
+            updateWarpTransform();
+        }
+        else if (mIsInWarpMode && key=='g')
+        {
+            Head& head = mHeads.at(mCurrentHead);
+            if (head.hasMesh())
+            {
+                head.meshOffsets.clear();
+                head.meshSize = Vec2i(0, 0);
+            }
+            else
+            {
+                head.meshSize = Vec2i(DEFAULT_MESH_SIZE, DEFAULT_MESH_SIZE);
+                head.meshOffsets.assign(DEFAULT_MESH_SIZE * DEFAULT_MESH_SIZE, Vec2f(0, 0));
+            }
             updateWarpTransform();
         }
         else if (key=='e')
@@ -605,34 +703,28 @@ void ControlPointEditor::clearPoints()
 
 void ControlPointEditor::mouseDragged(ci::Vec2f const& pos, int button)
 {
-    cout << "pos "<<pos<<endl;
+    VIZ_LOG_RATE_LIMITED(10, "pos "<<pos);
     if (mIsInWarpMode)
     {
-        Vec2f p = pos;
-        if (mEnableSecondHead)
-        {
-            if (mCurrentlyEditingSecondHead)
-                // [0,1] to [-1, 1]
-                p.x = p.x * 2 - 1;
-            else
-                // [-1, 0] to [-1, 1]
-                p.x = p.x * 2 + 1;
-        }
-        p -= mDragOffset;
-        int headIndex = mCurrentlyEditingSecondHead? 1 : 0;
+        Vec2f p = toCurrentHead(pos) - mDragOffset;
+        Head& head = mHeads.at(mCurrentHead);
+        tmb::Quad& quad = head.warpQuad;
         switch (mCurrentlyBeingDragged)
         {
+            case MESH_POINT:
+                head.meshOffsets.at(mDraggedMeshPoint) = p - meshPointBase(head, mDraggedMeshPoint);
+                break;
             case TL:
-                mWarpQuad[headIndex].tl = p;
+                quad.tl = p;
                 break;
             case TR:
-                mWarpQuad[headIndex].tr = p;
+                quad.tr = p;
                 break;
             case BR:
-                mWarpQuad[headIndex].br = p;
+                quad.br = p;
                 break;
             case BL:
-                mWarpQuad[headIndex].bl = p;
+                quad.bl = p;
                 break;
             default:
                 break;
@@ -644,53 +736,91 @@ void ControlPointEditor::mouseDragged(ci::Vec2f const& pos, int button)
 
 void ControlPointEditor::updateWarpTransform()
 {
-    cout << "left warp quad "<<mWarpQuad[0]<<endl;
-    cout << "right warp quad "<<mWarpQuad[1]<<endl;
+    // called for every mouse drag event
+    VIZ_LOG_RATE_LIMITED(10, "warp quad "<<mCurrentHead<<" "<<mHeads.at(mCurrentHead).warpQuad);
 
-    using namespace cv;
     // quad warping drawing on http://forum.openframeworks.cc/index.php/topic,509.msg2429.html#msg2429
-    for (int i=0; i<2; i++)
-    {
-        vector<Point2f> src = boost::assign::list_of
-            (toOcv(mOriginalQuad.tl))
-            (toOcv(mOriginalQuad.tr))
-            (toOcv(mOriginalQuad.br))
-            (toOcv(mOriginalQuad.bl));
-        vector<Point2f> dst = boost::assign::list_of
-            (toOcv(mWarpQuad[i].tl))
-            (toOcv(mWarpQuad[i].tr))
-            (toOcv(mWarpQuad[i].br))
-            (toOcv(mWarpQuad[i].bl));
-        Mat transform(findHomography(src, dst));
-        assert(transform.type()==CV_64F);
-        vector<double> glTransform(16, 0.f);
-        // [From oF theo:]
-        //we need to copy these values
-        //from the 3x3 2D openCV matrix which is row ordered
-        //
-        // ie:   [0][1][2] x
-        //       [3][4][5] y
-        //       [6][7][8] w
-
-        //to openGL's 4x4 3D column ordered matrix
-        //        x  y  z  w
-        // ie:   [0][3][ ][6]
-        //       [1][4][ ][7]
-        //       [ ][ ][ ][ ]
-        //       [2][5][ ][9]
-        //
-        mWarpTransform[i].m[0] = transform.at<double>(0);
-        mWarpTransform[i].m[4] = transform.at<double>(1);
-        mWarpTransform[i].m[12] = transform.at<double>(2);
-
-        mWarpTransform[i].m[1] = transform.at<double>(3);
-        mWarpTransform[i].m[5] = transform.at<double>(4);
-        mWarpTransform[i].m[13] = transform.at<double>(5);
-
-        mWarpTransform[i].m[3] = transform.at<double>(6);
-        mWarpTransform[i].m[7] = transform.at<double>(7);
-        mWarpTransform[i].m[15] = transform.at<double>(8);
+    for (int i=0; i<numHeads(); i++)
+    {
+        Head& head = mHeads[i];
+        vector<Vec2f> src = boost::assign::list_of
+            (mOriginalQuad.tl)
+            (mOriginalQuad.tr)
+            (mOriginalQuad.br)
+            (mOriginalQuad.bl);
+        vector<Vec2f> dst = boost::assign::list_of
+            (head.warpQuad.tl)
+            (head.warpQuad.tr)
+            (head.warpQuad.br)
+            (head.warpQuad.bl);
+        Matrix44d warp;
+        if (!homography::find(src, dst, warp))
+        {
+            // e.g. mid-drag, with three corners in a line
+            VIZ_LOG_RATE_LIMITED(1, "WARNING: warp quad "<<i<<" is degenerate, keeping the last warp");
+            continue;
+        }
+        // the picture is turned before it is warped
+        head.warpTransform = warp * Matrix44d::createRotation(Vec3d::zAxis(), head.rotation);
+    }
+
+    // Done once per change, so drawing the mesh costs nothing more than a quad
+    for (int i=0; i<numHeads(); i++)
+    {
+        Head& head = mHeads[i];
+        head.meshVertices.clear();
+        if (!head.hasMesh())
+            continue;
+        Vec2i count = head.meshVertexCount();
+        for (int row=0; row<count.y; row++)
+            for (int column=0; column<count.x; column++)
+            {
+                Vec2f render(column / float(count.x - 1) * 2 - 1, 1 - row / float(count.y - 1) * 2);
+                Vec4d p = head.warpTransform * Vec4d(render.x, render.y, 0, 1);
+                Vec2f offset = meshOffset(head, column / float(Head::MESH_SUBDIVISIONS), row / float(Head::MESH_SUBDIVISIONS));
+                head.meshVertices.push_back(Vec2f(p.x / p.w, p.y / p.w) + offset);
+            }
+    }
+    ++mWarpRevision;
+}
+
+ci::Vec2f ControlPointEditor::meshPointBase(Head const& head, int index) const
+{
+    int column = index % head.meshSize.x;
+    int row = index / head.meshSize.x;
+    Vec2f render(column / float(head.meshSize.x - 1) * 2 - 1, 1 - row / float(head.meshSize.y - 1) * 2);
+    Vec4d p = head.warpTransform * Vec4d(render.x, render.y, 0, 1);
+    return Vec2f(p.x / p.w, p.y / p.w);
+}
+
+ci::Vec2i ControlPointEditor::windowSize() const
+{
+    Vec2i size(0, 0);
+    for (size_t i=0; i<mHeads.size(); i++)
+    {
+        size.x += mHeads[i].resolution.x;
+        size.y = max(size.y, mHeads[i].resolution.y);
     }
+    return size;
+}
+
+ci::Rectf ControlPointEditor::headBounds(int headNo) const
+{
+    Vec2f window = windowSize();
+    int x = 0;
+    for (int i=0; i<headNo; i++)
+        x += mHeads.at(i).resolution.x;
+    Vec2f resolution = mHeads.at(headNo).resolution;
+    return Rectf(x / window.x * 2 - 1,
+                 1 - resolution.y / window.y * 2,
+                 (x + resolution.x) / window.x * 2 - 1,
+                 1);
+}
+
+ci::Vec2f ControlPointEditor::toCurrentHead(ci::Vec2f const& pos) const
+{
+    Rectf bounds = headBounds(mCurrentHead);
+    return (pos - bounds.getCenter()) / (bounds.getSize() / 2);
 }
 
 void ControlPointEditor::mouseReleased(int button)
@@ -727,7 +857,7 @@ void ControlPointEditor::mousePressed(ci::Vec2f const& pos, int button)
             }
             else
             {
-                cout << "Cannot add control point as the maximum number ("<<MAX_CONTROL_POINTS<<") has been reached."<<endl;
+                VIZ_LOG_RATE_LIMITED(1, "Cannot add control point as the maximum number ("<<MAX_CONTROL_POINTS<<") has been reached.");
             }
         }
         else if (button==RIGHT)
@@ -740,39 +870,49 @@ void ControlPointEditor::mousePressed(ci::Vec2f const& pos, int button)
     }
     else if (mIsInWarpMode && button==LEFT)
     {
-        Vec2f p = pos;
-        cout << "orig pos " << pos << endl;
-        if (mEnableSecondHead)
-        {
-            if (mCurrentlyEditingSecondHead)
-                // [0,1] to [-1, 1]
-                p.x = p.x * 2 - 1;
-            else
-                // [-1, 0] to [-1, 1]
-                p.x = p.x * 2 + 1;
-        }
-        cout << "p " << p << endl;
-        int headIndex = mCurrentlyEditingSecondHead? 1 : 0;
+        Vec2f p = toCurrentHead(pos);
+        VIZ_LOG_RATE_LIMITED(10, "orig pos "<<pos<<" p "<<p);
+        tmb::Quad const& quad = mHeads.at(mCurrentHead).warpQuad;
         const float radius = 0.2;
-        if (p.distance(mWarpQuad[headIndex].tl) < radius)
+        if (p.distance(quad.tl) < radius)
         {
             mCurrentlyBeingDragged = TL;
-            mDragOffset = p - mWarpQuad[headIndex].tl;
+            mDragOffset = p - quad.tl;
         }
-        else if (p.distance(mWarpQuad[headIndex].tr) < radius)
+        else if (p.distance(quad.tr) < radius)
         {
             mCurrentlyBeingDragged = TR;
-            mDragOffset = p - mWarpQuad[headIndex].tr;
+            mDragOffset = p - quad.tr;
         }
-        else if (p.distance(mWarpQuad[headIndex].bl) < radius)
+        else if (p.distance(quad.bl) < radius)
         {
             mCurrentlyBeingDragged = BL;
-            mDragOffset = p - mWarpQuad[headIndex].bl;
+            mDragOffset = p - quad.bl;
         }
-        else if (p.distance(mWarpQuad[headIndex].br) < radius)
+        else if (p.distance(quad.br) < radius)
         {
             mCurrentlyBeingDragged = BR;
-            mDragOffset = p - mWarpQuad[headIndex].br;
+            mDragOffset = p - quad.br;
+        }
+        else if (mHeads.at(mCurrentHead).hasMesh())
+        {
+            // the nearest mesh point, if near enough
+            Head const& head = mHeads.at(mCurrentHead);
+            const float meshRadius = 0.1;
+            float nearest = meshRadius;
+            mCurrentlyBeingDragged = NONE;
+            mDragOffset = Vec2f(0,0);
+            for (int i=0; i<head.meshOffsets.size(); i++)
+            {
+                Vec2f point = meshPointBase(head, i) + head.meshOffsets[i];
+                if (p.distance(point) < nearest)
+                {
+                    nearest = p.distance(point);
+                    mCurrentlyBeingDragged = MESH_POINT;
+                    mDraggedMeshPoint = i;
+                    mDragOffset = p - point;
+                }
+            }
         }
         else
         {
@@ -798,9 +938,8 @@ void ControlPointEditor::notify()
         + "\n(use '-' for no/all instrument(s)), d to deselect, Ctrl Backspace to clear all control points\nStart points at low-numbered instrument";
     if (mIsInWarpMode)
     {
-        mStatus += "\nWarp editor: Currently editing ";
-        mStatus += mCurrentlyEditingSecondHead? "RIGHT" : "LEFT";
-        mStatus += " head.\nCtrl Backspace to reset the warp quad Drag the corners to warp the screen.\n0 to edit left head, 1 to edit right head.";
+        mStatus += "\nWarp editor: Currently editing head " + toString(mCurrentHead) + " of " + toString(numHeads());
+        mStatus += ".\nCtrl Backspace to reset the warp quads Drag the corners to warp the screen.\n<num> to choose the head to edit, from 0 on the left.\nG to add or remove a mesh on the head, for finer correction; drag its points.";
     }
 }
 
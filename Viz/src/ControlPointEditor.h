@@ -26,9 +26,13 @@ public:
 
     void save();
     void load();
+    /// Save and load somewhere other than the file loadSettings() found
+    void setJsonFilename(std::string const& path) { mJsonFilename = path; }
 
     void setEnableSetupMode(bool enabled);
 
+    /// In warp mode 0-7 pick a head to warp, and [ and ] step through
+    /// them all
     void keyPressed(ci::app::KeyEvent event);
     /// Pos is in normalized coordinates
     /// button is 0 for LEFT, 2 for RIGHT
@@ -38,16 +42,87 @@ public:
     void mouseDragged(ci::Vec2f const& pos, int button);
     void mouseReleased(int button);
 
-    ci::Matrix44d warpTransform(bool getRightHead) const { return mWarpTransform[(int) getRightHead]; }
+    /// An output, e.g. a projector. Heads sit side by side in the window,
+    /// left to right in order, top aligned.
+    struct Head
+    {
+        Head();
+        /// Where the render lands, in the head's normalized coordinates
+        tmb::Quad warpQuad;
+        ci::Vec2i resolution;
+        /// Of the picture within the head, in radians (e.g. pi for a
+        /// projector hung upside down)
+        float rotation;
+        /// Render to head normalized coordinates, from warpQuad and rotation
+        ci::Matrix44d warpTransform;
+
+        /// Optional finer correction on top of the quad, e.g. for a curved
+        /// screen: meshSize.x by meshSize.y points spread evenly over the
+        /// render, row by row from the top left, each moved by its offset
+        /// (in head normalized coordinates) from where warpTransform takes
+        /// it. Empty for none.
+        std::vector<ci::Vec2f> meshOffsets;
+        ci::Vec2i meshSize;
+        bool hasMesh() const { return !meshOffsets.empty(); }
+        /// Precomputed from the above when there's a mesh: where each vertex
+        /// of a grid of meshVertexCount() points spread evenly over the
+        /// render ends up, in head normalized coordinates, row by row from
+        /// the top left. The offsets are interpolated smoothly between the
+        /// mesh points.
+        std::vector<ci::Vec2f> meshVertices;
+        ci::Vec2i meshVertexCount() const { return (meshSize - ci::Vec2i(1, 1)) * MESH_SUBDIVISIONS + ci::Vec2i(1, 1); }
+        /// Of each mesh cell, each way, into meshVertices
+        static const int MESH_SUBDIVISIONS = 8;
+    };
+    int numHeads() const { return int(mHeads.size()); }
+    Head const& head(int headNo) const { return mHeads.at(headNo); }
+    ci::Matrix44d warpTransform(int headNo) const { return mHeads.at(headNo).warpTransform; }
+    ci::Vec2i headResolution(int headNo) const { return mHeads.at(headNo).resolution; }
+    /// Size of all the heads side by side
+    ci::Vec2i windowSize() const;
+    /// Where a head goes in the window, in the window's normalized
+    /// coordinates (-1 to +1, y up)
+    ci::Rectf headBounds(int headNo) const;
+    /// Goes up whenever a head's warp changes, so what is made from them
+    /// need only be remade then
+    int warpRevision() const { return mWarpRevision; }
     ci::Vec2i renderResolution() const { return mRenderResolution; }
-    ci::Vec2i headResolution() const { return mHeadResolution; }
-    bool isSecondHeadEnabled() const { return mEnableSecondHead; }
-    int numHeads() const { return isSecondHeadEnabled()? 2 : 1; }
-    bool isSecondHeadRotated180() const { return mIsSecondHeadRotated180; }
     /// How much the instruments should be rotated
     float rotation() const { return mRotation; }
     /// Hostname of the stabilizer
     std::string hostName() const { return mHostName; }
+    /// Name of the shared memory segment a stabilizer on this machine can
+    /// send through instead of UDP. Empty (the default) to not create one.
+    std::string sharedMemoryName() const { return mSharedMemoryName; }
+    /// Multicast group (e.g. "239.255.0.1") shared by all the displays of an
+    /// install, so the stabilizer sends each update once. Empty for unicast.
+    std::string multicastGroup() const { return mMulticastGroup; }
+    /// Apply OSC messages to the state on the network thread rather than
+    /// before each frame (see OscReceiver::setDecodeOnNetworkThread())
+    bool decodeOscOnNetworkThread() const { return mDecodeOscOnNetworkThread; }
+    /// Scheduling of the OSC socket thread (see
+    /// OscReceiver::setSocketThreadOptions()). CPU -1 for any.
+    int oscThreadCpu() const { return mOscThreadCpu; }
+    bool oscThreadRealtime() const { return mOscThreadRealtime; }
+    bool oscBusyPoll() const { return mOscBusyPoll; }
+    /// How far back a trace dump goes (see Trace::dump())
+    float traceSeconds() const { return mTraceSeconds; }
+    /// /viz/stats period, 0 for none, and where to send it if not to the
+    /// stabilizer (see OscReceiver::setStatsPublishing())
+    float statsInterval() const { return mStatsInterval; }
+    std::string monitorHost() const { return mMonitorHost; }
+    int monitorPort() const { return mMonitorPort; }
+    /// Threads encoding screenshots and recorded frames (see FrameCapture)
+    int captureThreads() const { return mCaptureThreads; }
+    /// Shared memory segment the heads' output is published to for other
+    /// processes (see FrameExport), e.g. "/ensemble_viz_frames". Empty (the
+    /// default) for none.
+    std::string frameExportName() const { return mFrameExportName; }
+    /// Points along each side of the grid the particles take their noise
+    /// offsets from, and seconds between evaluating it (see
+    /// Renderer::setNoiseField()). Resolution 0 (the default) for none.
+    int noiseFieldResolution() const { return mNoiseFieldResolution; }
+    float noiseFieldInterval() const { return mNoiseFieldInterval; }
 
 private:
     /// Call to update stuff when something changes
@@ -61,24 +136,28 @@ private:
     std::map<int, std::map<int, std::vector<ci::Vec2f> > > mControlPoints;
 
     ci::Vec2i mRenderResolution;
-    ci::Vec2i mHeadResolution;
 
     // warp editor
-    /// we can have two warp quads, one for each head
-    bool mEnableSecondHead;
-    bool mIsSecondHeadRotated180;
-    /// the quad things get drawn to
-    tmb::Quad mWarpQuad[2];
+    /// at least one
+    std::vector<Head> mHeads;
     /// the noramlized coordinate quad (-1 to +1)
     tmb::Quad mOriginalQuad;
-    enum Corner_ { TL, TR, BR, BL };
+    enum Corner_ { TL, TR, BR, BL, MESH_POINT };
     typedef int Corner;
     Corner mCurrentlyBeingDragged;
-    bool mCurrentlyEditingSecondHead;
+    /// Of meshOffsets, when dragging a MESH_POINT
+    int mDraggedMeshPoint;
+    int mCurrentHead;
     ci::Vec2f mDragOffset;
-    ci::Matrix44d mWarpTransform[2];
-    /// Set mWarpTransform based on mWarpQuad
+    /// Set each head's warpTransform based on its warpQuad and rotation,
+    /// and its meshVertices
     void updateWarpTransform();
+    int mWarpRevision;
+    /// Where warpTransform alone takes a mesh point, in head normalized
+    /// coordinates
+    ci::Vec2f meshPointBase(Head const& head, int index) const;
+    /// Window normalized coordinates to those of the head being edited
+    ci::Vec2f toCurrentHead(ci::Vec2f const& pos) const;
     float mRotation; ///< In radians
 
     std::string mStatus;
@@ -97,5 +176,19 @@ private:
     void push_front(std::vector<T>& dest, T const& value);
 
     std::string mHostName;
+    std::string mSharedMemoryName;
+    std::string mMulticastGroup;
+    bool mDecodeOscOnNetworkThread;
+    int mOscThreadCpu;
+    bool mOscThreadRealtime;
+    bool mOscBusyPoll;
+    float mTraceSeconds;
+    float mStatsInterval;
+    std::string mMonitorHost;
+    int mMonitorPort;
+    int mCaptureThreads;
+    std::string mFrameExportName;
+    int mNoiseFieldResolution;
+    float mNoiseFieldInterval;
 };
 
@@ -0,0 +1,287 @@
+//
+//  FrameCapture.cpp
+//  EnsembleVisualization
+//
+
+// This module
+#include "FrameCapture.h"
+
+// Project
+#include "Log.h"
+#include "Trace.h"
+
+// Cinder
+#include <cinder/gl/gl.h>
+#include <cinder/ImageIo.h>
+#include <cinder/Surface.h>
+using namespace ci;
+
+// C++ std
+#include <cstring>
+#include <sstream>
+using namespace std;
+
+
+namespace
+{
+    /// Readbacks in flight at once
+    const int NUM_READBACKS = 3;
+    /// Frames a readback is given before it is mapped. Mapping sooner
+    /// would wait for the GPU to catch up.
+    const unsigned long READBACK_FRAMES = 2;
+    /// Frames that can be read back and waiting to be encoded, each the
+    /// size of the framebuffer
+    const int MAX_BACKLOG = 8;
+}
+
+
+FrameCapture::FrameCapture()
+: mNextReadback(0)
+, mFrame(0)
+, mNumCaptured(0)
+, mNumPixelBuffers(0)
+, mNumDropped(0)
+, mNumWritten(0)
+, mStopping(false)
+, mWaitWhenBacklogged(false)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+    {
+        lock_guard<mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mJobAdded.notify_all();
+    for (size_t i=0; i<mEncoders.size(); ++i)
+        mEncoders[i].join();
+    // Pixel buffer objects go with the GL context
+    for (size_t i=0; i<mFreePixels.size(); ++i)
+        delete mFreePixels[i];
+    for (size_t i=0; i<mReadbacks.size(); ++i)
+        delete mReadbacks[i].pixels;
+}
+
+void FrameCapture::setup(int numThreads)
+{
+    for (int i=0; i<numThreads; ++i)
+        mEncoders.push_back(thread(&FrameCapture::runEncoder, this));
+}
+
+void FrameCapture::capture(ci::gl::Fbo& fbo, ci::fs::path const& path)
+{
+    TRACE_SCOPE("capture frame");
+    ++mNumCaptured;
+    if (mEncoders.empty())
+        setup(1);
+    if (fbo.getSize() != mSize)
+    {
+        flush();
+        createPixelBuffers(fbo.getSize());
+    }
+
+    // The oldest readback, if still in flight, has to make way
+    Readback& readback = mReadbacks[mNextReadback];
+    if (readback.pixels)
+        handOn(readback);
+
+    // Reserve somewhere to copy the pixels to now, so that a backlogged
+    // frame costs no readback
+    {
+        unique_lock<mutex> lock(mMutex);
+        // At most NUM_READBACKS - 1 are held by readbacks now, so the
+        // encoders have the rest and will give one back
+        while (mWaitWhenBacklogged && mFreePixels.empty() && mNumPixelBuffers >= MAX_BACKLOG)
+            mPixelsFreed.wait(lock);
+        if (!mFreePixels.empty())
+        {
+            readback.pixels = mFreePixels.back();
+            mFreePixels.pop_back();
+        }
+        else if (mNumPixelBuffers < MAX_BACKLOG)
+        {
+            readback.pixels = new vector<unsigned char>(mSize.x * mSize.y * 4);
+            ++mNumPixelBuffers;
+        }
+        else
+            ++mNumDropped;
+    }
+    if (!readback.pixels)
+    {
+        VIZ_LOG_RATE_LIMITED(1, "WARNING: frame capture backlogged, dropped " << path);
+        return;
+    }
+    readback.path = path;
+    readback.frame = mFrame;
+    mNextReadback = (mNextReadback + 1) % NUM_READBACKS;
+
+    fbo.bindFramebuffer();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    glReadPixels(0, 0, mSize.x, mSize.y, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fbo.unbindFramebuffer();
+}
+
+void FrameCapture::update()
+{
+    ++mFrame;
+    // Oldest first, so frames reach the encoders in order
+    for (int i=0; i<int(mReadbacks.size()); ++i)
+    {
+        Readback& readback = mReadbacks[(mNextReadback + i) % NUM_READBACKS];
+        if (readback.pixels && mFrame - readback.frame >= READBACK_FRAMES)
+            handOn(readback);
+    }
+}
+
+void FrameCapture::flush()
+{
+    for (int i=0; i<int(mReadbacks.size()); ++i)
+    {
+        Readback& readback = mReadbacks[(mNextReadback + i) % NUM_READBACKS];
+        if (readback.pixels)
+            handOn(readback);
+    }
+}
+
+void FrameCapture::waitUntilWritten()
+{
+    // Pixels held by readbacks don't come back until they are handed on
+    int numReadingBack = 0;
+    for (size_t i=0; i<mReadbacks.size(); ++i)
+        if (mReadbacks[i].pixels)
+            ++numReadingBack;
+    unique_lock<mutex> lock(mMutex);
+    while (mNumPixelBuffers - int(mFreePixels.size()) > numReadingBack)
+        mPixelsFreed.wait(lock);
+}
+
+void FrameCapture::createPixelBuffers(ci::Vec2i size)
+{
+    if (mReadbacks.empty())
+    {
+        mReadbacks.resize(NUM_READBACKS);
+        for (int i=0; i<NUM_READBACKS; ++i)
+            glGenBuffers(1, &mReadbacks[i].pbo);
+    }
+    for (int i=0; i<NUM_READBACKS; ++i)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, mReadbacks[i].pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size.x * size.y * 4, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // Pixels of the old size are no use. Those queued are freed by the
+    // encoders once written.
+    lock_guard<mutex> lock(mMutex);
+    for (size_t i=0; i<mFreePixels.size(); ++i)
+        delete mFreePixels[i];
+    mNumPixelBuffers -= int(mFreePixels.size());
+    mFreePixels.clear();
+    mSize = size;
+}
+
+void FrameCapture::handOn(Readback& readback)
+{
+    TRACE_SCOPE("map captured frame");
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    const unsigned char* mapped = (const unsigned char*) glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (mapped)
+    {
+        // GL's rows go bottom to top
+        const size_t rowBytes = mSize.x * 4;
+        for (int y=0; y<mSize.y; ++y)
+            memcpy(&(*readback.pixels)[y * rowBytes], mapped + (mSize.y - 1 - y) * rowBytes, rowBytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    lock_guard<mutex> lock(mMutex);
+    if (mapped)
+    {
+        Job job = { readback.pixels, mSize, readback.path };
+        mJobs.push_back(job);
+        mJobAdded.notify_one();
+    }
+    else
+    {
+        VIZ_LOG("ERROR: could not map the pixels of " << readback.path);
+        mFreePixels.push_back(readback.pixels);
+        ++mNumDropped;
+    }
+    readback.pixels = NULL;
+}
+
+void FrameCapture::runEncoder()
+{
+    Trace::setThreadName("frame encoder");
+    unique_lock<mutex> lock(mMutex);
+    for (;;)
+    {
+        while (mJobs.empty() && !mStopping)
+            mJobAdded.wait(lock);
+        if (mJobs.empty())
+            return;
+        Job job = mJobs.front();
+        mJobs.pop_front();
+        lock.unlock();
+
+        bool written = false;
+        {
+            TRACE_SCOPE("encode frame");
+            Surface8u surface(&(*job.pixels)[0], job.size.x, job.size.y, job.size.x * 4, SurfaceChannelOrder::RGBA);
+            try
+            {
+                writeImage(job.path, surface);
+                written = true;
+            }
+            catch (std::exception const& e)
+            {
+                VIZ_LOG_RATE_LIMITED(1, "ERROR: could not write " << job.path << ": " << e.what());
+            }
+        }
+
+        lock.lock();
+        if (written)
+            ++mNumWritten;
+        else
+            ++mNumDropped;
+        // Unless the framebuffer has changed size since
+        if (job.size == mSize)
+            mFreePixels.push_back(job.pixels);
+        else
+        {
+            delete job.pixels;
+            --mNumPixelBuffers;
+        }
+        mPixelsFreed.notify_all();
+    }
+}
+
+unsigned long FrameCapture::numDropped() const
+{
+    lock_guard<mutex> lock(mMutex);
+    return mNumDropped;
+}
+
+unsigned long FrameCapture::numWritten() const
+{
+    lock_guard<mutex> lock(mMutex);
+    return mNumWritten;
+}
+
+int FrameCapture::backlog() const
+{
+    lock_guard<mutex> lock(mMutex);
+    return mNumPixelBuffers - int(mFreePixels.size());
+}
+
+std::string FrameCapture::status() const
+{
+    lock_guard<mutex> lock(mMutex);
+    std::stringstream ss;
+    ss << "capture " << mNumCaptured << " frames, " << mNumWritten << " written, "
+       << mNumDropped << " dropped, " << mNumPixelBuffers - int(mFreePixels.size()) << " backlogged";
+    return ss.str();
+}
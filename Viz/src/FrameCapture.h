@@ -0,0 +1,109 @@
+//
+//  FrameCapture.h
+//  EnsembleVisualization
+//
+//  Saves frames to image files without stalling the render thread, so a
+//  show can be recorded at full frame rate.
+//
+//  capture() only queues a read of the framebuffer into one of a ring of
+//  pixel buffer objects, which the GPU fills in the background. A couple of
+//  frames later update() maps it, copies the pixels out and hands them to a
+//  pool of encoder threads that compress and write the files. Frames are
+//  held in a bounded set of buffers: when the encoders fall that far behind,
+//  new frames are dropped and counted rather than waited for.
+//
+//      mCapture.capture(mFbo, path);   // in draw(), after rendering to mFbo
+//      ...
+//      mCapture.update();              // once a frame
+//
+
+#pragma once
+#include <cinder/Filesystem.h>
+#include <cinder/Vector.h>
+#include <cinder/gl/Fbo.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class FrameCapture
+{
+public:
+    FrameCapture();
+    /// Waits for the encoders to write what they have been given. Frames
+    /// still in pixel buffers are lost unless flush() was called.
+    ~FrameCapture();
+
+    /// Start the encoder threads. Pixel buffers are made on first capture.
+    void setup(int numThreads);
+    /// Have capture() wait for the encoders to catch up rather than drop
+    /// frames, for rendering offline where every frame is wanted
+    void setWaitWhenBacklogged(bool enabled) { mWaitWhenBacklogged = enabled; }
+
+    /// Queue fbo's pixels to be written to path (any format writeImage()
+    /// knows from the extension). Returns straight away; if the encoders
+    /// are too far behind the frame is dropped. GL thread only.
+    void capture(ci::gl::Fbo& fbo, ci::fs::path const& path);
+    /// Hand on frames whose readback has had time to finish. Call once a
+    /// frame on the GL thread.
+    void update();
+    /// Hand on every frame still being read back, waiting for the GPU.
+    /// Call before quitting.
+    void flush();
+    /// Wait for the encoders to write every frame handed on to them
+    void waitUntilWritten();
+
+    /// Frames passed to capture() since launch
+    unsigned long numCaptured() const { return mNumCaptured; }
+    unsigned long numDropped() const;
+    unsigned long numWritten() const;
+    /// Frames held: being read back, waiting for an encoder or encoding
+    int backlog() const;
+    std::string status() const;
+
+private:
+    /// One in flight readback
+    struct Readback
+    {
+        Readback() : pbo(0), pixels(NULL), frame(0) {}
+        unsigned pbo;
+        /// From the pool, reserved at capture. NULL when not in flight.
+        std::vector<unsigned char>* pixels;
+        ci::fs::path path;
+        unsigned long frame;
+    };
+    struct Job
+    {
+        std::vector<unsigned char>* pixels;
+        ci::Vec2i size;
+        ci::fs::path path;
+    };
+
+    void createPixelBuffers(ci::Vec2i size);
+    /// Copy a readback's pixels out and queue them for an encoder
+    void handOn(Readback& readback);
+    void runEncoder();
+
+    ci::Vec2i mSize;
+    std::vector<Readback> mReadbacks;
+    /// The next readback to use, and so the oldest still in flight
+    int mNextReadback;
+    /// Counted by update()
+    unsigned long mFrame;
+    unsigned long mNumCaptured;
+
+    std::vector<std::thread> mEncoders;
+    /// Guards everything below
+    mutable std::mutex mMutex;
+    std::condition_variable mJobAdded;
+    std::condition_variable mPixelsFreed;
+    std::deque<Job> mJobs;
+    std::vector<std::vector<unsigned char>*> mFreePixels;
+    int mNumPixelBuffers;
+    unsigned long mNumDropped;
+    unsigned long mNumWritten;
+    bool mStopping;
+    bool mWaitWhenBacklogged;
+};
@@ -0,0 +1,281 @@
+//
+//  FrameExport.cpp
+//  EnsembleVisualization
+//
+
+// This module
+#include "FrameExport.h"
+
+// Project
+#include "Log.h"
+#include "Trace.h"
+#include "ip/NetworkingUtils.h"
+
+// Cinder
+#include <cinder/gl/gl.h>
+using namespace ci;
+
+// C++ std
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+using namespace std;
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace
+{
+    const char MAGIC[8] = { 'V', 'I', 'Z', 'F', 'R', 'M', '1', '\0' };
+    /// Slot headers and pixel rows start on cache lines
+    const size_t ALIGNMENT = 64;
+
+    size_t slotStride(std::vector<ci::Vec2i> const& sizes)
+    {
+        size_t pixels = 0;
+        for (size_t i=0; i<sizes.size(); ++i)
+            pixels = max(pixels, size_t(sizes[i].x) * sizes[i].y);
+        size_t bytes = sizeof(FrameExportSlot) + pixels * 4;
+        return (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+}
+
+
+FrameExport::FrameExport()
+: mHeader(NULL)
+, mMappedSize(0)
+, mNumExported(0)
+{
+}
+
+FrameExport::~FrameExport()
+{
+    // Pixel buffer objects go with the GL context
+    close();
+}
+
+#if defined(_WIN32)
+
+bool FrameExport::create(std::string const&, std::vector<ci::Vec2i> const&, int) { return false; }
+bool FrameExport::open(std::string const&) { return false; }
+void FrameExport::close() {}
+bool FrameExport::map(int, size_t) { return false; }
+
+#else
+
+bool FrameExport::create(std::string const& name, std::vector<ci::Vec2i> const& headSizes, int numSlots)
+{
+    close();
+    const int numHeads = int(headSizes.size());
+    if (numHeads < 1 || numHeads > FrameExportHeader::MAX_HEADS || numSlots < 2)
+        return false;
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0)
+        return false;
+    const size_t stride = slotStride(headSizes);
+    const size_t size = sizeof(FrameExportHeader) + numHeads * numSlots * stride;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t(info.st_size) != size && ftruncate(fd, size) != 0))
+    {
+        ::close(fd);
+        return false;
+    }
+    bool mapped = map(fd, size);
+    ::close(fd);
+    if (!mapped)
+        return false;
+
+    // Consumers still attached to a segment of another layout see the
+    // magic go and must open() again
+    memset(mHeader->magic, 0, sizeof(mHeader->magic));
+    atomic_thread_fence(memory_order_release);
+    mHeader->numHeads = numHeads;
+    mHeader->numSlots = numSlots;
+    mHeader->slotStride = stride;
+    for (int head=0; head<FrameExportHeader::MAX_HEADS; ++head)
+        mHeader->latest[head].store(0);
+    for (int head=0; head<numHeads; ++head)
+        for (int i=0; i<numSlots; ++i)
+        {
+            FrameExportSlot* s = slot(head, i);
+            s->sequence.store(0);
+            s->width = headSizes[head].x;
+            s->height = headSizes[head].y;
+            s->rowBytes = headSizes[head].x * 4;
+            s->format = FRAME_FORMAT_RGBA8;
+            s->head = head;
+        }
+    atomic_thread_fence(memory_order_release);
+    memcpy(mHeader->magic, MAGIC, sizeof(mHeader->magic));
+
+    mName = name;
+    mHeadSizes = headSizes;
+    mReadbacks.assign(numHeads, Readback());
+    mNumWritten.assign(numHeads, 0);
+    mNumExported = 0;
+    return true;
+}
+
+bool FrameExport::open(std::string const& name)
+{
+    close();
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(FrameExportHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+    bool mapped = map(fd, info.st_size);
+    ::close(fd);
+    if (!mapped)
+        return false;
+
+    atomic_thread_fence(memory_order_acquire);
+    if (memcmp(mHeader->magic, MAGIC, sizeof(mHeader->magic)) != 0
+        || sizeof(FrameExportHeader) + mHeader->numHeads * mHeader->numSlots * mHeader->slotStride > mMappedSize)
+    {
+        close();
+        return false;
+    }
+    mName = name;
+    return true;
+}
+
+bool FrameExport::map(int fd, size_t size)
+{
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED)
+        return false;
+    mHeader = static_cast<FrameExportHeader*>(memory);
+    mMappedSize = size;
+    return true;
+}
+
+void FrameExport::close()
+{
+    if (mHeader)
+        munmap(mHeader, mMappedSize);
+    mHeader = NULL;
+    mMappedSize = 0;
+    mName.clear();
+}
+
+#endif
+
+FrameExportSlot* FrameExport::slot(int head, uint64_t index) const
+{
+    char* slots = reinterpret_cast<char*>(mHeader) + sizeof(FrameExportHeader);
+    const uint64_t i = head * mHeader->numSlots + index % mHeader->numSlots;
+    return reinterpret_cast<FrameExportSlot*>(slots + i * mHeader->slotStride);
+}
+
+void FrameExport::exportHead(int head, ci::gl::Fbo& fbo, uint64_t frameNumber)
+{
+    if (!mHeader || head < 0 || head >= int(mReadbacks.size()) || fbo.getSize() != mHeadSizes[head])
+        return;
+    const Vec2i size = mHeadSizes[head];
+    TRACE_SCOPE("export frame");
+    Readback& readback = mReadbacks[head];
+    if (readback.isPending)
+        publish(head);
+    if (!readback.pbo)
+    {
+        glGenBuffers(1, &readback.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size.x * size.y * 4, NULL, GL_STREAM_READ);
+    }
+    else
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+
+    fbo.bindFramebuffer();
+    glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    fbo.unbindFramebuffer();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.isPending = true;
+    readback.frameNumber = frameNumber;
+    readback.timestamp = GetCurrentTimeNs();
+}
+
+void FrameExport::publish(int head)
+{
+    Readback& readback = mReadbacks[head];
+    readback.isPending = false;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    const unsigned char* mapped = (const unsigned char*) glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (!mapped)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        VIZ_LOG_RATE_LIMITED(1, "ERROR: could not map head " << head << " for export");
+        return;
+    }
+
+    const uint64_t index = mNumWritten[head];
+    FrameExportSlot* s = slot(head, index);
+    const uint64_t sequence = s->sequence.load(memory_order_relaxed);
+    s->sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    s->frameNumber = readback.frameNumber;
+    s->timestamp = readback.timestamp;
+    // GL's rows go bottom to top
+    unsigned char* pixels = reinterpret_cast<unsigned char*>(s) + sizeof(FrameExportSlot);
+    const Vec2i size = mHeadSizes[head];
+    const size_t rowBytes = size.x * 4;
+    for (int y=0; y<size.y; ++y)
+        memcpy(pixels + y * rowBytes, mapped + (size.y - 1 - y) * rowBytes, rowBytes);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    s->sequence.store(sequence + 2, memory_order_release);
+    mNumWritten[head] = index + 1;
+    mHeader->latest[head].store(index + 1, memory_order_release);
+    ++mNumExported;
+}
+
+FrameExport::View FrameExport::latest(int head) const
+{
+    View view;
+    memset(&view, 0, sizeof(view));
+    if (!mHeader || head < 0 || head >= int(mHeader->numHeads))
+        return view;
+    const uint64_t latest = mHeader->latest[head].load(memory_order_acquire);
+    if (latest == 0)
+        return view;
+    const FrameExportSlot* s = slot(head, latest - 1);
+    view.sequence = s->sequence.load(memory_order_acquire);
+    // Being written: the producer has gone all the way round since
+    if (view.sequence & 1)
+        return view;
+    view.slot = s;
+    view.frameNumber = s->frameNumber;
+    view.timestamp = s->timestamp;
+    view.width = s->width;
+    view.height = s->height;
+    view.rowBytes = s->rowBytes;
+    view.pixels = reinterpret_cast<const unsigned char*>(s) + sizeof(FrameExportSlot);
+    return view;
+}
+
+bool FrameExport::isValid(View const& view) const
+{
+    if (!view.pixels)
+        return false;
+    atomic_thread_fence(memory_order_acquire);
+    return view.slot->sequence.load(memory_order_relaxed) == view.sequence;
+}
+
+std::string FrameExport::status() const
+{
+    std::stringstream ss;
+    ss << "export " << mName << ": " << mNumExported << " frames";
+    return ss.str();
+}
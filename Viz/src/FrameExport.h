@@ -0,0 +1,141 @@
+//
+//  FrameExport.h
+//  EnsembleVisualization
+//
+//  Publishes the warped output of each head into named POSIX shared memory,
+//  for a media server on the same machine to composite or stream.
+//
+//  Each head has a ring of a few slots, each a FrameExportSlot header
+//  followed by the pixels (RGBA, 8 bits a channel, top row first). The
+//  producer fills the oldest slot and then points FrameExportHeader::latest
+//  at it, never waiting for readers. A slot's sequence is odd while it is
+//  being written, so a consumer reads the pixels in place, without copying
+//  them, and afterwards checks that the sequence hasn't changed:
+//
+//      FrameExport in;
+//      in.open("/ensemble_viz_frames");
+//      FrameExport::View view = in.latest(0);
+//      if (view.pixels)
+//      {
+//          upload(view.pixels, view.width, view.height);
+//          if (!in.isValid(view))
+//              ; // overwritten meanwhile: try again, or make more slots
+//      }
+//
+//  Not available on Windows, where create() and open() return false.
+//
+
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <cinder/Vector.h>
+#include <cinder/gl/Fbo.h>
+
+
+enum FrameExportFormat
+{
+    FRAME_FORMAT_RGBA8 = 1
+};
+
+/// Start of the segment
+struct FrameExportHeader
+{
+    static const int MAX_HEADS = 8;
+
+    char magic[8];              ///< "VIZFRM1\0", written last
+    uint32_t numHeads;
+    uint32_t numSlots;          ///< per head
+    uint64_t slotStride;        ///< bytes from one slot header to the next, fitting the largest head
+    char padding0[64 - 24];
+    /// Per head, 1 + the index of the newest complete slot counting every
+    /// slot ever written (so % numSlots gives its place in the ring), or 0
+    /// before the first frame
+    std::atomic<uint64_t> latest[MAX_HEADS];
+};
+
+/// Precedes each slot's pixels. Slots of head h start at
+/// sizeof(FrameExportHeader) + (h * numSlots + i) * slotStride.
+struct FrameExportSlot
+{
+    /// Odd while being written
+    std::atomic<uint64_t> sequence;
+    uint64_t frameNumber;
+    /// When the frame was drawn, nanoseconds since the unix epoch
+    uint64_t timestamp;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowBytes;
+    uint32_t format;            ///< FrameExportFormat
+    uint32_t head;
+    char padding[64 - 44];
+};
+
+
+class FrameExport
+{
+public:
+    FrameExport();
+    ~FrameExport();
+
+    /// Producer side. Creates (or reuses) the segment called name (e.g.
+    /// "/ensemble_viz_frames") for heads of the given sizes.
+    bool create(std::string const& name, std::vector<ci::Vec2i> const& headSizes, int numSlots=3);
+    /// Consumer side. Attaches to a segment made by create().
+    bool open(std::string const& name);
+    void close();
+    bool isOpen() const { return mHeader != NULL; }
+
+    /// Producer side, on the GL thread. Reads the head's framebuffer back
+    /// in the background; it is published on the next call for that head,
+    /// when the readback has had a frame to finish.
+    void exportHead(int head, ci::gl::Fbo& fbo, uint64_t frameNumber);
+    /// Frames published since create()
+    uint64_t numExported() const { return mNumExported; }
+    std::string status() const;
+
+    /// Consumer side. A frame read in place.
+    struct View
+    {
+        /// NULL if the head has no frame yet
+        const unsigned char* pixels;
+        uint64_t frameNumber;
+        uint64_t timestamp;
+        int width;
+        int height;
+        int rowBytes;
+        const FrameExportSlot* slot;
+        uint64_t sequence;
+    };
+    /// The newest complete frame of a head
+    View latest(int head) const;
+    /// Whether nothing has overwritten the view's pixels yet. Check after
+    /// using them.
+    bool isValid(View const& view) const;
+
+private:
+    bool map(int fd, size_t size);
+    FrameExportSlot* slot(int head, uint64_t index) const;
+    /// Copy a finished readback into the head's next slot
+    void publish(int head);
+
+    FrameExportHeader* mHeader;
+    size_t mMappedSize;
+    std::string mName;
+    std::vector<ci::Vec2i> mHeadSizes;
+
+    /// A readback in flight per head
+    struct Readback
+    {
+        Readback() : pbo(0), isPending(false), frameNumber(0), timestamp(0) {}
+        unsigned pbo;
+        bool isPending;
+        uint64_t frameNumber;
+        uint64_t timestamp;
+    };
+    std::vector<Readback> mReadbacks;
+    /// Slots written per head, the producer's copy of latest
+    std::vector<uint64_t> mNumWritten;
+    uint64_t mNumExported;
+};
@@ -0,0 +1,120 @@
+//
+//  FrameStats.cpp
+//  EnsembleVisualization
+//
+
+#include "FrameStats.h"
+#include "Trace.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <cinder/gl/gl.h>
+
+using namespace std;
+
+
+FrameStats::FrameStats()
+: mHasStartedFrame(false)
+, mFinishGlPerStage(false)
+{
+}
+
+void FrameStats::record(FrameStage stage, float seconds)
+{
+    Ring& ring = mRings[stage];
+    ring.samples[ring.next] = seconds * 1000.f;
+    ring.next = (ring.next + 1) % RING_SIZE;
+    ring.count = std::min(ring.count + 1, int(RING_SIZE));
+}
+
+void FrameStats::frameStarted()
+{
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (mHasStartedFrame)
+        record(STAGE_FRAME, std::chrono::duration<float>(now - mLastFrameStart).count());
+    mLastFrameStart = now;
+    mHasStartedFrame = true;
+}
+
+FrameStats::Summary FrameStats::summary(FrameStage stage) const
+{
+    Ring const& ring = mRings[stage];
+    Summary s;
+    s.count = ring.count;
+    s.min = s.mean = s.p50 = s.p99 = 0;
+    if (ring.count == 0)
+        return s;
+
+    float sorted[RING_SIZE];
+    std::copy(ring.samples, ring.samples + ring.count, sorted);
+    std::sort(sorted, sorted + ring.count);
+    float total = 0;
+    for (int i=0; i<ring.count; ++i)
+        total += sorted[i];
+    s.min = sorted[0];
+    s.mean = total / ring.count;
+    s.p50 = sorted[(ring.count - 1) / 2];
+    s.p99 = sorted[(ring.count - 1) * 99 / 100];
+    return s;
+}
+
+const char* FrameStats::stageName(FrameStage stage)
+{
+    switch (stage)
+    {
+        case STAGE_OSC_DRAIN: return "OSC drain";
+        case STAGE_STATE_UPDATE: return "State::update";
+        case STAGE_SET_STATE: return "setState";
+        case STAGE_RENDERER_BUILD: return "Renderer build";
+        case STAGE_PARTICLE_RENDER: return "particle render";
+        case STAGE_EDITOR_OVERLAY: return "editor overlay";
+        case STAGE_COMPOSITE: return "warp composite";
+        case STAGE_EXPORT_HEADS: return "export heads";
+        case STAGE_FRAME: return "whole frame";
+        default: return "?";
+    }
+}
+
+std::string FrameStats::status() const
+{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << std::left << std::setw(16) << "stage (ms)" << std::right
+       << std::setw(8) << "min" << std::setw(8) << "mean" << std::setw(8) << "p50" << std::setw(8) << "p99";
+    if (mFinishGlPerStage)
+        ss << "  (glFinish per stage)";
+    for (int i=0; i<NUM_FRAME_STAGES; ++i)
+    {
+        Summary s = summary(FrameStage(i));
+        ss << "\n" << std::left << std::setw(16) << stageName(FrameStage(i)) << std::right;
+        if (s.count == 0)
+            ss << std::setw(8) << "-";
+        else
+            ss << std::setw(8) << s.min << std::setw(8) << s.mean << std::setw(8) << s.p50 << std::setw(8) << s.p99;
+    }
+    return ss.str();
+}
+
+
+ScopedStageTimer::ScopedStageTimer(FrameStats* stats, FrameStage stage)
+: mStats(stats)
+, mStage(stage)
+, mIsStopped(false)
+{
+    if (mStats && mStats->finishGlPerStage())
+        glFinish();
+    mStart = std::chrono::steady_clock::now();
+}
+
+void ScopedStageTimer::stop()
+{
+    if (mIsStopped)
+        return;
+    mIsStopped = true;
+    if (mStats && mStats->finishGlPerStage())
+        glFinish();
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    Trace::record(FrameStats::stageName(mStage), mStart, end);
+    if (mStats)
+        mStats->record(mStage, std::chrono::duration<float>(end - mStart).count());
+}
@@ -0,0 +1,100 @@
+//
+//  FrameStats.h
+//  EnsembleVisualization
+//
+//  Per-stage timing of update() and draw(), to see which stage is eating
+//  the frame budget. Each stage keeps its last few hundred durations in a
+//  fixed ring, from which rolling min/mean/p50/p99 are worked out on demand.
+//
+//  Times are CPU wall clock. GL calls mostly return before the GPU has done
+//  the work, so GPU stages only show their submission cost unless
+//  setFinishGlPerStage() is on, which waits for the GPU at every stage
+//  boundary (accurate per stage, but slows the whole frame down).
+//
+
+#pragma once
+#include <chrono>
+#include <string>
+
+
+enum FrameStage
+{
+    STAGE_OSC_DRAIN,
+    STAGE_STATE_UPDATE,
+    STAGE_SET_STATE,
+    STAGE_RENDERER_BUILD,
+    STAGE_PARTICLE_RENDER,
+    STAGE_EDITOR_OVERLAY,
+    STAGE_COMPOSITE,
+    STAGE_EXPORT_HEADS,
+    /// Time between the starts of successive frames
+    STAGE_FRAME,
+    NUM_FRAME_STAGES
+};
+
+
+class FrameStats
+{
+public:
+    /// Number of most recent samples the statistics cover
+    static const int RING_SIZE = 240;
+
+    struct Summary
+    {
+        int count;
+        /// milliseconds
+        float min;
+        float mean;
+        float p50;
+        float p99;
+    };
+
+    FrameStats();
+
+    void record(FrameStage stage, float seconds);
+    /// Call at the start of each update(), to time whole frames
+    void frameStarted();
+
+    Summary summary(FrameStage stage) const;
+    static const char* stageName(FrameStage stage);
+    /// One line per stage
+    std::string status() const;
+
+    /// Wait for the GPU to finish at every stage boundary, so GPU time is
+    /// charged to the stage that caused it
+    void setFinishGlPerStage(bool enabled) { mFinishGlPerStage = enabled; }
+    bool finishGlPerStage() const { return mFinishGlPerStage; }
+
+private:
+    struct Ring
+    {
+        float samples[RING_SIZE];
+        int count;
+        int next;
+        Ring() : count(0), next(0) {}
+    };
+    Ring mRings[NUM_FRAME_STAGES];
+    std::chrono::steady_clock::time_point mLastFrameStart;
+    bool mHasStartedFrame;
+    bool mFinishGlPerStage;
+};
+
+
+/// Times its own lifetime, or until stop(), into a stage, and records it as
+/// a span in the trace. stats may be NULL, so modules can be timed without
+/// requiring a FrameStats.
+class ScopedStageTimer
+{
+public:
+    ScopedStageTimer(FrameStats* stats, FrameStage stage);
+    ~ScopedStageTimer() { stop(); }
+
+    /// Record now rather than at the end of the scope
+    void stop();
+
+private:
+    FrameStats* mStats;
+    FrameStage mStage;
+    std::chrono::steady_clock::time_point mStart;
+    bool mIsStopped;
+};
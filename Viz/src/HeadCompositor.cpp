@@ -0,0 +1,153 @@
+//
+//  HeadCompositor.cpp
+//  EnsembleVisualization
+//
+
+// This module
+#include "HeadCompositor.h"
+
+// Cinder
+#include <cinder/gl/gl.h>
+using namespace ci;
+
+// C++ std
+#include <cassert>
+using namespace std;
+
+
+namespace
+{
+    struct Vertex
+    {
+        Vec4d position;
+        Vec2d texCoord;
+    };
+
+    /// Sutherland-Hodgman: keeps the part of the polygon where
+    /// plane.dot(position) >= 0. Clip coordinates are linear, so the texture
+    /// coordinates are too.
+    void clip(std::vector<Vertex>& polygon, Vec4d const& plane, std::vector<Vertex>& scratch)
+    {
+        scratch.clear();
+        for (size_t i=0; i<polygon.size(); ++i)
+        {
+            Vertex const& a = polygon[i];
+            Vertex const& b = polygon[(i + 1) % polygon.size()];
+            const double da = plane.dot(a.position);
+            const double db = plane.dot(b.position);
+            if (da >= 0)
+                scratch.push_back(a);
+            if ((da >= 0) != (db >= 0))
+            {
+                const double t = da / (da - db);
+                Vertex v;
+                v.position = a.position + (b.position - a.position) * t;
+                v.texCoord = a.texCoord + (b.texCoord - a.texCoord) * t;
+                scratch.push_back(v);
+            }
+        }
+        polygon.swap(scratch);
+    }
+
+    /// Clips the polygon, in the window's clip coordinates, to bounds and
+    /// appends it as triangles
+    void addClipped(std::vector<Vertex>& polygon, ci::Rectf const& bounds,
+                    std::vector<ci::Vec4f>& positions, std::vector<ci::Vec2f>& texCoords)
+    {
+        // x1 w <= x <= x2 w and the same for y, which also leaves out w <= 0
+        std::vector<Vertex> scratch;
+        clip(polygon, Vec4d(1, 0, 0, -bounds.x1), scratch);
+        clip(polygon, Vec4d(-1, 0, 0, bounds.x2), scratch);
+        clip(polygon, Vec4d(0, 1, 0, -bounds.y1), scratch);
+        clip(polygon, Vec4d(0, -1, 0, bounds.y2), scratch);
+
+        // As a fan
+        for (size_t i=1; i+1<polygon.size(); ++i)
+        {
+            const size_t triangle[3] = { 0, i, i + 1 };
+            for (int j=0; j<3; ++j)
+            {
+                Vertex const& v = polygon[triangle[j]];
+                positions.push_back(Vec4f(v.position.x, v.position.y, v.position.z, v.position.w));
+                texCoords.push_back(Vec2f(v.texCoord.x, v.texCoord.y));
+            }
+        }
+    }
+}
+
+
+void HeadCompositor::clear()
+{
+    mPositions.clear();
+    mTexCoords.clear();
+}
+
+void HeadCompositor::addHead(ci::Matrix44d const& warpTransform, ci::Rectf const& bounds)
+{
+    // The render quad, as drawn by the warp before
+    const Vec2d corners[4] = { Vec2d(-1, 1), Vec2d(1, 1), Vec2d(1, -1), Vec2d(-1, -1) };
+    const Vec2d texCoords[4] = { Vec2d(0, 1), Vec2d(1, 1), Vec2d(1, 0), Vec2d(0, 0) };
+    const Vec2d scale(bounds.getWidth() / 2, bounds.getHeight() / 2);
+    const Vec2d centre(bounds.getCenter().x, bounds.getCenter().y);
+
+    std::vector<Vertex> polygon;
+    for (int i=0; i<4; ++i)
+    {
+        Vertex v;
+        v.position = warpTransform * Vec4d(corners[i].x, corners[i].y, 0, 1);
+        // From the head's clip coordinates to the window's
+        v.position.x = v.position.x * scale.x + centre.x * v.position.w;
+        v.position.y = v.position.y * scale.y + centre.y * v.position.w;
+        v.position.z = 0;
+        v.texCoord = texCoords[i];
+        polygon.push_back(v);
+    }
+
+    addClipped(polygon, bounds, mPositions, mTexCoords);
+}
+
+void HeadCompositor::addMesh(std::vector<ci::Vec2f> const& vertices, ci::Vec2i count, ci::Rectf const& bounds)
+{
+    assert(int(vertices.size()) == count.x * count.y && count.x >= 2 && count.y >= 2);
+    const Vec2d scale(bounds.getWidth() / 2, bounds.getHeight() / 2);
+    const Vec2d centre(bounds.getCenter().x, bounds.getCenter().y);
+    std::vector<Vertex> polygon;
+    for (int row=0; row+1<count.y; ++row)
+        for (int column=0; column+1<count.x; ++column)
+        {
+            // Two triangles a cell, each clipped on its own
+            const int corners[2][3][2] = {
+                { { column, row }, { column + 1, row }, { column + 1, row + 1 } },
+                { { column, row }, { column + 1, row + 1 }, { column, row + 1 } }
+            };
+            for (int t=0; t<2; ++t)
+            {
+                polygon.clear();
+                for (int i=0; i<3; ++i)
+                {
+                    const int c = corners[t][i][0];
+                    const int r = corners[t][i][1];
+                    Vec2f const& p = vertices[r * count.x + c];
+                    Vertex v;
+                    v.position = Vec4d(p.x * scale.x + centre.x, p.y * scale.y + centre.y, 0, 1);
+                    // The top row is the top of the render
+                    v.texCoord = Vec2d(c / double(count.x - 1), 1 - r / double(count.y - 1));
+                    polygon.push_back(v);
+                }
+                addClipped(polygon, bounds, mPositions, mTexCoords);
+            }
+        }
+}
+
+void HeadCompositor::draw() const
+{
+    if (mPositions.empty())
+        return;
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(4, GL_FLOAT, 0, &mPositions[0]);
+    glTexCoordPointer(2, GL_FLOAT, 0, &mTexCoords[0]);
+    glDrawArrays(GL_TRIANGLES, 0, GLsizei(mPositions.size()));
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
@@ -0,0 +1,47 @@
+//
+//  HeadCompositor.h
+//  EnsembleVisualization
+//
+//  Draws the render through every head's warp into the window in a single
+//  draw call, however many heads there are. Built once when the warps
+//  change, then drawn every frame.
+//
+//  Each head's quad goes through its warp transform into homogeneous clip
+//  coordinates on the CPU, so the GPU still interpolates the texture
+//  perspective correctly, and is clipped there to the head's part of the
+//  window so that a corner dragged past the edge doesn't spill onto the
+//  next head.
+//
+
+#pragma once
+#include <vector>
+#include <cinder/Matrix.h>
+#include <cinder/Rect.h>
+#include <cinder/Vector.h>
+
+
+class HeadCompositor
+{
+public:
+    /// Forget the heads added so far
+    void clear();
+    /// Adds a head, whose normalized coordinates (-1 to +1) fill bounds of
+    /// the window's, into which warpTransform takes the render's
+    void addHead(ci::Matrix44d const& warpTransform, ci::Rectf const& bounds);
+    /// Adds a head warped by a mesh instead: vertices is a grid of
+    /// count.x by count.y points, row by row from the top left, spread
+    /// evenly over the render and each where it lands in the head's
+    /// normalized coordinates. Linear within each triangle, so the mesh
+    /// should be fine enough for that not to show.
+    void addMesh(std::vector<ci::Vec2f> const& vertices, ci::Vec2i count, ci::Rectf const& bounds);
+
+    /// Draws every head added, sampling the texture that is bound, with the
+    /// whole window as the viewport and identity matrices
+    void draw() const;
+
+    int numTriangles() const { return int(mPositions.size() / 3); }
+
+private:
+    std::vector<ci::Vec4f> mPositions;
+    std::vector<ci::Vec2f> mTexCoords;
+};
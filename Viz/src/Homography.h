@@ -0,0 +1,209 @@
+//
+//  Homography.h
+//  EnsembleVisualization
+//
+//  The projective transform taking one set of 2D points to another, as
+//  used to warp the render into each head's quad. Four points determine it
+//  exactly; with more it is fitted by least squares. Matches what OpenCV's
+//  findHomography() gives with its default method for four points, and the
+//  linear estimate it starts from for more (this doesn't go on to refine
+//  the reprojection error).
+//
+//  The points are normalized first (centroid at the origin, mean distance
+//  sqrt(2), after Hartley) so the equations stay well conditioned whatever
+//  units the points are in. Everything is in double precision.
+//
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <cinder/Matrix.h>
+#include <cinder/Vector.h>
+
+
+namespace homography
+{
+    namespace detail
+    {
+        /// Row ordered 3x3 that moves the points' centroid to the origin and
+        /// scales their mean distance from it to sqrt(2). False if they are
+        /// all in one place.
+        inline bool normalization(std::vector<ci::Vec2f> const& points, double t[9])
+        {
+            double cx = 0, cy = 0;
+            for (size_t i=0; i<points.size(); ++i)
+            {
+                cx += points[i].x;
+                cy += points[i].y;
+            }
+            cx /= points.size();
+            cy /= points.size();
+            double distance = 0;
+            for (size_t i=0; i<points.size(); ++i)
+                distance += std::sqrt((points[i].x - cx) * (points[i].x - cx) + (points[i].y - cy) * (points[i].y - cy));
+            distance /= points.size();
+            if (!(distance > 0))
+                return false;
+            const double s = std::sqrt(2.) / distance;
+            const double m[9] = { s, 0, -s * cx, 0, s, -s * cy, 0, 0, 1 };
+            for (int i=0; i<9; ++i)
+                t[i] = m[i];
+            return true;
+        }
+
+        /// Solves the 8x8 system whose augmented rows are a, leaving the
+        /// solution in a[i][8]. Gaussian elimination with partial pivoting.
+        /// False if it is singular.
+        inline bool solve8(double a[8][9])
+        {
+            double largest = 0;
+            for (int r=0; r<8; ++r)
+                for (int c=0; c<8; ++c)
+                    largest = std::max(largest, std::fabs(a[r][c]));
+            for (int c=0; c<8; ++c)
+            {
+                int pivot = c;
+                for (int r=c+1; r<8; ++r)
+                    if (std::fabs(a[r][c]) > std::fabs(a[pivot][c]))
+                        pivot = r;
+                if (!(std::fabs(a[pivot][c]) > 1e-12 * largest))
+                    return false;
+                if (pivot != c)
+                    for (int k=0; k<9; ++k)
+                        std::swap(a[c][k], a[pivot][k]);
+                for (int r=c+1; r<8; ++r)
+                {
+                    const double f = a[r][c] / a[c][c];
+                    for (int k=c; k<9; ++k)
+                        a[r][k] -= f * a[c][k];
+                }
+            }
+            for (int r=7; r>=0; --r)
+            {
+                double x = a[r][8];
+                for (int k=r+1; k<8; ++k)
+                    x -= a[r][k] * a[k][8];
+                a[r][8] = x / a[r][r];
+            }
+            return true;
+        }
+
+        /// c = a b, row ordered 3x3s
+        inline void multiply(double const a[9], double const b[9], double c[9])
+        {
+            for (int r=0; r<3; ++r)
+                for (int k=0; k<3; ++k)
+                    c[r*3 + k] = a[r*3] * b[k] + a[r*3 + 1] * b[3 + k] + a[r*3 + 2] * b[6 + k];
+        }
+    }
+
+    /// The homography h taking each of src to the point of dst at the same
+    /// index, row ordered:
+    ///
+    ///     [0][1][2] x
+    ///     [3][4][5] y
+    ///     [6][7][8] w
+    ///
+    /// and scaled so that h[8] is 1. Needs at least four points. Returns
+    /// false, leaving h alone, if there are too few or they don't determine
+    /// a homography (e.g. three of four in a line).
+    inline bool find(std::vector<ci::Vec2f> const& src, std::vector<ci::Vec2f> const& dst, double h[9])
+    {
+        using namespace detail;
+        const size_t n = src.size();
+        double srcT[9], dstT[9];
+        if (n < 4 || dst.size() != n || !normalization(src, srcT) || !normalization(dst, dstT))
+            return false;
+
+        // Each pair gives two equations in the eight unknowns, fixing
+        // h[8] = 1: the rows x y 1 0 0 0 -ux -uy = u and
+        // 0 0 0 x y 1 -vx -vy = v. Four pairs are solved as they are; more
+        // through the normal equations.
+        double a[8][9] = {};
+        for (size_t i=0; i<n; ++i)
+        {
+            const double x = srcT[0] * src[i].x + srcT[2];
+            const double y = srcT[4] * src[i].y + srcT[5];
+            const double u = dstT[0] * dst[i].x + dstT[2];
+            const double v = dstT[4] * dst[i].y + dstT[5];
+            const double rows[2][9] = {
+                { x, y, 1, 0, 0, 0, -u * x, -u * y, u },
+                { 0, 0, 0, x, y, 1, -v * x, -v * y, v }
+            };
+            for (int j=0; j<2; ++j)
+            {
+                if (n == 4)
+                {
+                    for (int k=0; k<9; ++k)
+                        a[i*2 + j][k] = rows[j][k];
+                }
+                else
+                {
+                    for (int r=0; r<8; ++r)
+                        for (int k=0; k<9; ++k)
+                            a[r][k] += rows[j][r] * rows[j][k];
+                }
+            }
+        }
+        if (!solve8(a))
+            return false;
+
+        // Back from normalized coordinates: dstT^-1 hn srcT
+        const double hn[9] = { a[0][8], a[1][8], a[2][8], a[3][8], a[4][8], a[5][8], a[6][8], a[7][8], 1 };
+        const double dstInverse[9] = {
+            1 / dstT[0], 0, -dstT[2] / dstT[0],
+            0, 1 / dstT[4], -dstT[5] / dstT[4],
+            0, 0, 1
+        };
+        double hnSrc[9], result[9];
+        multiply(hn, srcT, hnSrc);
+        multiply(dstInverse, hnSrc, result);
+        // A singular h squashes the plane onto a line, as when three
+        // points of a quad are in a line
+        const double determinant =
+            result[0] * (result[4] * result[8] - result[5] * result[7])
+            - result[1] * (result[3] * result[8] - result[5] * result[6])
+            + result[2] * (result[3] * result[7] - result[4] * result[6]);
+        if (!(std::fabs(result[8]) > 1e-12) || !(std::fabs(determinant) > 1e-9 * std::pow(std::fabs(result[8]), 3)))
+            return false;
+        for (int i=0; i<9; ++i)
+            h[i] = result[i] / result[8];
+        return true;
+    }
+
+    /// A row ordered homography as a GL matrix: column ordered 4x4, acting
+    /// on x, y and w, with z passed through
+    ///
+    ///        x  y  z  w
+    ///       [0][1][ ][2]
+    ///       [3][4][ ][5]
+    ///       [ ][ ][1][ ]
+    ///       [6][7][ ][8]
+    inline ci::Matrix44d toMatrix44(double const h[9])
+    {
+        ci::Matrix44d m;
+        m.m[0] = h[0];
+        m.m[4] = h[1];
+        m.m[12] = h[2];
+
+        m.m[1] = h[3];
+        m.m[5] = h[4];
+        m.m[13] = h[5];
+
+        m.m[3] = h[6];
+        m.m[7] = h[7];
+        m.m[15] = h[8];
+        return m;
+    }
+
+    /// find() as a GL matrix
+    inline bool find(std::vector<ci::Vec2f> const& src, std::vector<ci::Vec2f> const& dst, ci::Matrix44d& transform)
+    {
+        double h[9];
+        if (!find(src, dst, h))
+            return false;
+        transform = toMatrix44(h);
+        return true;
+    }
+}
@@ -0,0 +1,176 @@
+//
+//  LatencyTracker.cpp
+//  EnsembleVisualization
+//
+
+#include "LatencyTracker.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "ip/NetworkingUtils.h"
+#include "Log.h"
+
+using namespace std;
+
+
+namespace
+{
+    /// If frames stop being submitted we stop queueing rather than grow forever
+    const size_t MAX_PENDING_MESSAGES = 10000;
+}
+
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+void LatencyHistogram::clear()
+{
+    memset(mBuckets, 0, sizeof(mBuckets));
+    mCount = 0;
+    mMax = 0;
+}
+
+int LatencyHistogram::bucketFor(unsigned long long microseconds)
+{
+    if (microseconds < 8)
+        return int(microseconds);
+    int exponent = 0;
+    while ((microseconds >> exponent) >= 16)
+        ++exponent;
+    // the top 4 bits are 1xxx, the xxx pick one of 8 sub-buckets
+    int bucket = 8 + exponent*8 + int((microseconds >> exponent) & 7);
+    return std::min(bucket, NUM_BUCKETS-1);
+}
+
+unsigned long long LatencyHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket < 8)
+        return bucket + 1;
+    int exponent = (bucket - 8) / 8;
+    unsigned long long lower = (unsigned long long)(8 + (bucket - 8) % 8) << exponent;
+    return lower + (1ULL << exponent);
+}
+
+void LatencyHistogram::add(unsigned long long nanoseconds)
+{
+    ++mBuckets[bucketFor(nanoseconds / 1000)];
+    ++mCount;
+    mMax = std::max(mMax, nanoseconds);
+}
+
+unsigned long long LatencyHistogram::percentile(double fraction) const
+{
+    if (mCount == 0)
+        return 0;
+    unsigned long target = (unsigned long)(fraction * (mCount - 1)) + 1;
+    unsigned long seen = 0;
+    for (int i=0; i<NUM_BUCKETS; ++i)
+    {
+        seen += mBuckets[i];
+        if (seen >= target)
+            return std::min(bucketUpperBound(i) * 1000, mMax);
+    }
+    return mMax;
+}
+
+
+LatencyTracker::LatencyTracker()
+: mDumpInterval(10)
+, mTimeOfLastDump(0)
+{
+}
+
+int LatencyTracker::addressIndex(std::string const& address)
+{
+    // there are only a handful of addresses
+    for (size_t i=0; i<mAddresses.size(); ++i)
+        if (mAddresses[i] == address)
+            return int(i);
+    mAddresses.push_back(address);
+    mHistograms.push_back(LatencyHistogram());
+    return int(mAddresses.size() - 1);
+}
+
+void LatencyTracker::messageApplied(std::string const& address, unsigned long long receiveTimestamp)
+{
+    if (receiveTimestamp == 0 || mPending.size() >= MAX_PENDING_MESSAGES)
+        return;
+    PendingMessage pending;
+    pending.address = addressIndex(address);
+    pending.receiveTimestamp = receiveTimestamp;
+    mPending.push_back(pending);
+}
+
+void LatencyTracker::messageApplied(std::string const& address, unsigned long long receiveTimestamp, unsigned long snapshot)
+{
+    std::lock_guard<std::mutex> lock(mIncomingMutex);
+    if (receiveTimestamp == 0 || mIncoming.size() >= MAX_PENDING_MESSAGES)
+        return;
+    IncomingMessage incoming;
+    incoming.address = address;
+    incoming.receiveTimestamp = receiveTimestamp;
+    incoming.snapshot = snapshot;
+    mIncoming.push_back(incoming);
+}
+
+void LatencyTracker::snapshotConsumed(unsigned long snapshot)
+{
+    std::lock_guard<std::mutex> lock(mIncomingMutex);
+    // snapshots are consumed in order, so those still waiting are at the end
+    size_t i = 0;
+    for (; i<mIncoming.size() && mIncoming[i].snapshot <= snapshot; ++i)
+        messageApplied(mIncoming[i].address, mIncoming[i].receiveTimestamp);
+    mIncoming.erase(mIncoming.begin(), mIncoming.begin() + i);
+}
+
+void LatencyTracker::frameSubmitted()
+{
+    const unsigned long long now = GetCurrentTimeNs();
+    for (size_t i=0; i<mPending.size(); ++i)
+    {
+        // the wall clock can be adjusted under us
+        unsigned long long latency = now > mPending[i].receiveTimestamp
+            ? now - mPending[i].receiveTimestamp
+            : 0;
+        mHistograms[mPending[i].address].add(latency);
+        mRecent.add(latency);
+    }
+    mPending.clear();
+
+    if (mDumpInterval > 0 && now - mTimeOfLastDump > mDumpInterval * 1e9)
+    {
+        if (mTimeOfLastDump != 0 && !mAddresses.empty())
+            VIZ_LOG(status());
+        mTimeOfLastDump = now;
+    }
+}
+
+LatencyHistogram LatencyTracker::takeRecent()
+{
+    LatencyHistogram recent = mRecent;
+    mRecent.clear();
+    return recent;
+}
+
+std::string LatencyTracker::status() const
+{
+    std::stringstream ss;
+    ss << "Input to frame submit latency (ms):";
+    if (mAddresses.empty())
+        ss << " no timestamped messages yet";
+    ss << std::fixed << std::setprecision(2);
+    for (size_t i=0; i<mAddresses.size(); ++i)
+    {
+        LatencyHistogram const& h = mHistograms[i];
+        ss << "\n  " << std::left << std::setw(24) << mAddresses[i] << std::right
+           << " n " << std::setw(8) << h.count()
+           << "  p50 " << std::setw(8) << h.percentile(0.5) / 1e6
+           << "  p99 " << std::setw(8) << h.percentile(0.99) / 1e6
+           << "  max " << std::setw(8) << h.maximum() / 1e6;
+    }
+    return ss.str();
+}
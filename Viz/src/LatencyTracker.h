@@ -0,0 +1,93 @@
+//
+//  LatencyTracker.h
+//  EnsembleVisualization
+//
+//  Measures how long an OSC message takes from arriving on the socket
+//  (kernel receive timestamp) to being on screen (submission of the first
+//  frame drawn after it was applied to the state), per OSC address.
+//
+
+#pragma once
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/// Fixed size histogram of latencies. Buckets are logarithmic with 8 per
+/// doubling, so percentiles are accurate to within 12.5%.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void add(unsigned long long nanoseconds);
+    void clear();
+
+    unsigned long count() const { return mCount; }
+    /// Upper bound of the bucket holding the given fraction (0-1) of samples
+    unsigned long long percentile(double fraction) const;
+    unsigned long long maximum() const { return mMax; }
+
+private:
+    static const int NUM_BUCKETS = 320;
+    static int bucketFor(unsigned long long microseconds);
+    static unsigned long long bucketUpperBound(int bucket);
+
+    unsigned long mBuckets[NUM_BUCKETS];
+    unsigned long mCount;
+    unsigned long long mMax;
+};
+
+
+class LatencyTracker
+{
+public:
+    LatencyTracker();
+
+    /// A message that arrived at receiveTimestamp (GetCurrentTimeNs() time)
+    /// has been applied to the state
+    void messageApplied(std::string const& address, unsigned long long receiveTimestamp);
+    /// As messageApplied(), but may be called from another thread that
+    /// publishes states as numbered snapshots. The message is counted from
+    /// the frame after snapshotConsumed() is called with that number or a
+    /// later one.
+    void messageApplied(std::string const& address, unsigned long long receiveTimestamp, unsigned long snapshot);
+    /// The render thread has taken this snapshot to draw the next frame
+    void snapshotConsumed(unsigned long snapshot);
+    /// Call when a frame drawn from the current state has been submitted.
+    /// Records the latency of every message applied since the last call.
+    void frameSubmitted();
+
+    /// Print status() to the console this often. 0 to disable.
+    void setDumpInterval(float seconds) { mDumpInterval = seconds; }
+
+    /// p50/p99/max per address
+    std::string status() const;
+
+    /// Latencies of every address recorded since the last call
+    LatencyHistogram takeRecent();
+
+private:
+    struct PendingMessage
+    {
+        int address;
+        unsigned long long receiveTimestamp;
+    };
+    struct IncomingMessage
+    {
+        std::string address;
+        unsigned long long receiveTimestamp;
+        unsigned long snapshot;
+    };
+    int addressIndex(std::string const& address);
+
+    std::vector<std::string> mAddresses;
+    std::vector<LatencyHistogram> mHistograms;
+    LatencyHistogram mRecent;
+    std::vector<PendingMessage> mPending;
+    /// Applied on another thread, waiting for their snapshot to be consumed
+    std::vector<IncomingMessage> mIncoming;
+    std::mutex mIncomingMutex;
+    float mDumpInterval;
+    unsigned long long mTimeOfLastDump;
+};
@@ -0,0 +1,346 @@
+//
+//  Log.cpp
+//  EnsembleVisualization
+//
+
+#include "Log.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+namespace
+{
+    /// Lines that can be waiting at once. More than this and they're dropped.
+    const size_t RING_SIZE = 512;
+    /// How often the writer looks for new lines. Producers never signal it,
+    /// as that would mean taking a lock.
+    const int POLL_INTERVAL_MS = 5;
+    /// How often suppressed and dropped counts are reported
+    const int SUMMARY_INTERVAL_MS = 1000;
+
+    long long millisecondsNow()
+    {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// Bounded multi producer, single consumer ring. Each slot carries a
+    /// sequence number saying whether it is free for the producer claiming
+    /// that position or full for the consumer (Vyukov's bounded queue).
+    /// A producer claims a slot, writes its line in place and commits it.
+    class Ring
+    {
+    public:
+        struct Slot
+        {
+            atomic<size_t> sequence;
+            size_t length;
+            char text[Log::MAX_LINE_LENGTH];
+        };
+
+        Ring()
+        : mSlots(RING_SIZE)
+        , mEnqueuePosition(0)
+        , mDequeuePosition(0)
+        {
+            for (size_t i=0; i<RING_SIZE; ++i)
+                mSlots[i].sequence.store(i, memory_order_relaxed);
+        }
+
+        /// NULL if full. The slot is the caller's until commit().
+        Slot* claim()
+        {
+            size_t position = mEnqueuePosition.load(memory_order_relaxed);
+            for (;;)
+            {
+                Slot& slot = mSlots[position % RING_SIZE];
+                size_t sequence = slot.sequence.load(memory_order_acquire);
+                long difference = long(sequence) - long(position);
+                if (difference == 0)
+                {
+                    if (mEnqueuePosition.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+                        return &slot;
+                }
+                else if (difference < 0)
+                    return NULL;
+                else
+                    position = mEnqueuePosition.load(memory_order_relaxed);
+            }
+        }
+
+        /// Hands a claimed slot to the consumer
+        void commit(Slot* slot)
+        {
+            // still the position it was claimed at, as only its owner moves it
+            const size_t position = slot->sequence.load(memory_order_relaxed);
+            slot->sequence.store(position + 1, memory_order_release);
+        }
+
+        /// The oldest committed line, or NULL. Writer thread only.
+        Slot const* front() const
+        {
+            Slot const& slot = mSlots[mDequeuePosition % RING_SIZE];
+            if (slot.sequence.load(memory_order_acquire) != mDequeuePosition + 1)
+                return NULL;
+            return &slot;
+        }
+
+        /// Frees the slot front() returned for producers
+        void pop()
+        {
+            Slot& slot = mSlots[mDequeuePosition % RING_SIZE];
+            slot.sequence.store(mDequeuePosition + RING_SIZE, memory_order_release);
+            ++mDequeuePosition;
+        }
+
+    private:
+        vector<Slot> mSlots;
+        atomic<size_t> mEnqueuePosition;
+        size_t mDequeuePosition;
+    };
+
+
+    class Writer
+    {
+    public:
+        static Writer& instance()
+        {
+            // constructed on first use, so before any rate limiter that
+            // registers with it, and so destroyed (and drained) after them
+            static Writer writer;
+            return writer;
+        }
+
+        /// NULL, and the line counted as dropped, if the ring is full
+        Ring::Slot* claim()
+        {
+            Ring::Slot* slot = mRing.claim();
+            if (!slot)
+                ++mDropped;
+            return slot;
+        }
+
+        void commit(Ring::Slot* slot)
+        {
+            mRing.commit(slot);
+        }
+
+        void write(string const& line)
+        {
+            Ring::Slot* slot = claim();
+            if (!slot)
+                return;
+            slot->length = min(line.size(), sizeof(slot->text));
+            memcpy(slot->text, line.data(), slot->length);
+            commit(slot);
+        }
+
+        void registerLimiter(LogRateLimiter* limiter)
+        {
+            lock_guard<mutex> lock(mLimitersMutex);
+            mLimiters.push_back(limiter);
+        }
+
+        void unregisterLimiter(LogRateLimiter* limiter)
+        {
+            {
+                lock_guard<mutex> lock(mLimitersMutex);
+                mLimiters.erase(remove(mLimiters.begin(), mLimiters.end(), limiter), mLimiters.end());
+            }
+            // it won't be around for the next summary
+            string summary = suppressedSummary(limiter);
+            if (!summary.empty())
+                write(summary);
+        }
+
+        void flush()
+        {
+            unique_lock<mutex> lock(mFlushMutex);
+            const unsigned long long target = ++mFlushRequests;
+            mFlushed.wait(lock, [&]{ return mFlushesDone >= target; });
+        }
+
+    private:
+        Writer()
+        : mDropped(0)
+        , mShouldQuit(false)
+        , mFlushRequests(0)
+        , mFlushesDone(0)
+        {
+            mThread = thread(&Writer::run, this);
+        }
+
+        ~Writer()
+        {
+            mShouldQuit = true;
+            mThread.join();
+        }
+
+        void run()
+        {
+            Trace::setThreadName("log writer");
+            long long timeOfLastSummary = millisecondsNow();
+            for (;;)
+            {
+                // read before draining, so a request made now is served by this pass
+                unsigned long long flushRequests;
+                {
+                    lock_guard<mutex> lock(mFlushMutex);
+                    flushRequests = mFlushRequests;
+                }
+                const bool quitting = mShouldQuit;
+
+                drain();
+
+                const long long now = millisecondsNow();
+                if (quitting || now - timeOfLastSummary >= SUMMARY_INTERVAL_MS)
+                {
+                    summarize();
+                    timeOfLastSummary = now;
+                }
+                if (flushRequests != 0)
+                {
+                    lock_guard<mutex> lock(mFlushMutex);
+                    mFlushesDone = flushRequests;
+                    mFlushed.notify_all();
+                }
+                if (quitting)
+                    return;
+                this_thread::sleep_for(chrono::milliseconds(POLL_INTERVAL_MS));
+            }
+        }
+
+        void drain()
+        {
+            Ring::Slot const* slot = mRing.front();
+            if (!slot)
+                return;
+            TRACE_SCOPE("write log");
+            do
+            {
+                cout.write(slot->text, slot->length) << '\n';
+                mRing.pop();
+            }
+            while ((slot = mRing.front()));
+            cout.flush();
+        }
+
+        static string suppressedSummary(LogRateLimiter* limiter)
+        {
+            unsigned long suppressed = limiter->takeSuppressed();
+            if (suppressed == 0)
+                return string();
+            // __FILE__ can be a full path
+            string file = limiter->file();
+            size_t slash = file.find_last_of("/\\");
+            if (slash != string::npos)
+                file = file.substr(slash + 1);
+            ostringstream ss;
+            ss << "(suppressed " << suppressed << " similar lines from " << file << ':' << limiter->line() << ")";
+            return ss.str();
+        }
+
+        void summarize()
+        {
+            {
+                lock_guard<mutex> lock(mLimitersMutex);
+                for (size_t i=0; i<mLimiters.size(); ++i)
+                {
+                    string summary = suppressedSummary(mLimiters[i]);
+                    if (!summary.empty())
+                        cout << summary << '\n';
+                }
+            }
+            unsigned long dropped = mDropped.exchange(0);
+            if (dropped > 0)
+                cout << "(dropped " << dropped << " log lines as the log was full)\n";
+            cout.flush();
+        }
+
+        Ring mRing;
+        atomic<unsigned long> mDropped;
+        atomic<bool> mShouldQuit;
+        thread mThread;
+
+        vector<LogRateLimiter*> mLimiters;
+        mutex mLimitersMutex;
+
+        mutex mFlushMutex;
+        condition_variable mFlushed;
+        unsigned long long mFlushRequests;
+        unsigned long long mFlushesDone;
+    };
+}
+
+
+void Log::write(std::string const& line)
+{
+    Writer::instance().write(line);
+}
+
+void Log::flush()
+{
+    Writer::instance().flush();
+}
+
+
+LogLine::LogLine()
+: mSlot(Writer::instance().claim())
+, mStream(this)
+{
+    if (Ring::Slot* slot = static_cast<Ring::Slot*>(mSlot))
+        setp(slot->text, slot->text + sizeof(slot->text));
+}
+
+LogLine::~LogLine()
+{
+    Ring::Slot* slot = static_cast<Ring::Slot*>(mSlot);
+    if (!slot)
+        return;
+    slot->length = pptr() - pbase();
+    // the stream goes bad when the slot overflows
+    if (mStream.bad() && slot->length == sizeof(slot->text))
+        memcpy(slot->text + slot->length - 3, "...", 3);
+    Writer::instance().commit(slot);
+}
+
+
+LogRateLimiter::LogRateLimiter(const char* file, int line, int perSecond)
+: mFile(file)
+, mLine(line)
+, mPerSecond(perSecond)
+, mWindow(0)
+, mCountInWindow(0)
+, mSuppressed(0)
+{
+    Writer::instance().registerLimiter(this);
+}
+
+LogRateLimiter::~LogRateLimiter()
+{
+    // statics at call sites go before the writer does
+    Writer::instance().unregisterLimiter(this);
+}
+
+bool LogRateLimiter::allow()
+{
+    const long long window = millisecondsNow() / 1000;
+    long long current = mWindow.load(memory_order_relaxed);
+    // whoever moves the window on starts its count again
+    if (window != current && mWindow.compare_exchange_strong(current, window))
+        mCountInWindow.store(0, memory_order_relaxed);
+    if (mCountInWindow.fetch_add(1, memory_order_relaxed) < mPerSecond)
+        return true;
+    ++mSuppressed;
+    return false;
+}
@@ -0,0 +1,100 @@
+//
+//  Log.h
+//  EnsembleVisualization
+//
+//  Console logging that never makes the caller wait on terminal I/O.
+//
+//  Lines are formatted on the calling thread straight into a slot of a
+//  fixed size lock-free ring, so logging allocates nothing, and a
+//  background thread drains the ring to stdout. If the ring is full the
+//  line is dropped and counted rather than blocking, and a line too long
+//  for its slot is cut short. Call sites
+//  that can fire on every message or frame use VIZ_LOG_RATE_LIMITED, which
+//  lets a few lines per second through and periodically reports how many
+//  were suppressed.
+//
+//      VIZ_LOG("Loaded " << path);
+//      VIZ_LOG_RATE_LIMITED(5, "ERROR: note for instrument " << i);
+//
+
+#pragma once
+#include <atomic>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+
+class Log
+{
+public:
+    /// Longest line kept, in bytes, without its newline
+    static const size_t MAX_LINE_LENGTH = 1024;
+
+    /// Queue a line (without its newline) for the writer thread
+    static void write(std::string const& line);
+    /// Block until everything queued so far has been written. For use at
+    /// exit or before a crash, never on a hot path.
+    static void flush();
+};
+
+
+/// A line being formatted into its slot in the ring, queued for the
+/// writer when it goes out of scope. Made by VIZ_LOG.
+class LogLine : private std::streambuf
+{
+public:
+    LogLine();
+    ~LogLine();
+
+    /// Null if the ring is full and the line dropped
+    std::ostream* stream() { return mSlot? &mStream : NULL; }
+
+private:
+    LogLine(LogLine const&);
+    LogLine& operator=(LogLine const&);
+
+    void* mSlot;
+    std::ostream mStream;
+};
+
+
+/// Lets at most a given number of lines per second through from one call
+/// site. Made by VIZ_LOG_RATE_LIMITED as a static at the call site.
+class LogRateLimiter
+{
+public:
+    LogRateLimiter(const char* file, int line, int perSecond);
+    ~LogRateLimiter();
+
+    /// Whether this line may be logged. Counts it as suppressed if not.
+    bool allow();
+
+    /// Lines suppressed since the last call, for the writer's summaries
+    unsigned long takeSuppressed() { return mSuppressed.exchange(0); }
+    const char* file() const { return mFile; }
+    int line() const { return mLine; }
+
+private:
+    const char* mFile;
+    int mLine;
+    int mPerSecond;
+    std::atomic<long long> mWindow;
+    std::atomic<int> mCountInWindow;
+    std::atomic<unsigned long> mSuppressed;
+};
+
+
+#define VIZ_LOG(expression) \
+    do { \
+        LogLine vizLogLine_; \
+        if (std::ostream* vizLogStream_ = vizLogLine_.stream()) \
+            *vizLogStream_ << expression; \
+    } while (0)
+
+/// Nothing is formatted for suppressed lines
+#define VIZ_LOG_RATE_LIMITED(perSecond, expression) \
+    do { \
+        static LogRateLimiter vizLogLimiter_(__FILE__, __LINE__, perSecond); \
+        if (vizLogLimiter_.allow()) \
+            VIZ_LOG(expression); \
+    } while (0)
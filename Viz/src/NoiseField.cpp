@@ -0,0 +1,109 @@
+//
+//  NoiseField.cpp
+//  EnsembleVisualization
+//
+
+// This module
+#include "NoiseField.h"
+
+// Project
+#include "SimplexNoise.h"
+#include "Trace.h"
+
+// Cinder
+using namespace ci;
+
+// C++ std
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+
+namespace
+{
+    // particles.vert's, which is a little short of pi
+    const float SHADER_PI = 3.14159f;
+}
+
+const float NoiseField::EXTENT = 1.5f;
+
+NoiseField::NoiseField()
+    : mResolution(0)
+    , mInterval(0)
+    , mTime(0)
+    , mIsEvaluated(false)
+{
+}
+
+void NoiseField::setup(int resolution, float interval)
+{
+    mResolution = max(2, resolution);
+    mInterval = interval;
+    mIsEvaluated = false;
+    const int n = mResolution * mResolution;
+    mX.resize(n);
+    mY.resize(n);
+    for (int k=0; k<3; ++k)
+        mSamples[k].resize(n);
+    mOffsets.resize(n);
+    const float spacing = 2 * EXTENT / (mResolution - 1);
+    for (int j=0; j<mResolution; ++j)
+        for (int i=0; i<mResolution; ++i)
+        {
+            mX[j * mResolution + i] = -EXTENT + i * spacing;
+            mY[j * mResolution + i] = -EXTENT + j * spacing;
+        }
+}
+
+bool NoiseField::update(float time)
+{
+    if (!isSetup() || (mIsEvaluated && time >= mTime && time - mTime < mInterval))
+        return false;
+    TRACE_SCOPE("noise field");
+    mTime = time;
+    mIsEvaluated = true;
+    const int n = int(mOffsets.size());
+    float z[3];
+    slices(time, z);
+    for (int k=0; k<3; ++k)
+        snoise(&mX[0], &mY[0], z[k], &mSamples[k][0], n);
+    for (int i=0; i<n; ++i)
+    {
+        const float samples[3] = { mSamples[0][i], mSamples[1][i], mSamples[2][i] };
+        mOffsets[i] = positionNoise(samples, time);
+    }
+    return true;
+}
+
+Vec2f NoiseField::sample(Vec2f const& position) const
+{
+    // In grid points from the bottom left, clamped to the grid
+    const float scale = (mResolution - 1) / (2 * EXTENT);
+    const float last = float(mResolution - 1);
+    const float gx = min(max((position.x + EXTENT) * scale, 0.f), last);
+    const float gy = min(max((position.y + EXTENT) * scale, 0.f), last);
+    const int i = min(int(gx), mResolution - 2);
+    const int j = min(int(gy), mResolution - 2);
+    const float fx = gx - i;
+    const float fy = gy - j;
+    Vec2f const* p = &mOffsets[j * mResolution + i];
+    const Vec2f bottom = p[0] + (p[1] - p[0]) * fx;
+    const Vec2f top = p[mResolution] + (p[mResolution + 1] - p[mResolution]) * fx;
+    return bottom + (top - bottom) * fy;
+}
+
+void NoiseField::slices(float time, float z[3])
+{
+    z[0] = time*(.16f+.1f)*.4f;
+    z[1] = time*(.6f+.1f);
+    z[2] = time*0.007f;
+}
+
+Vec2f NoiseField::positionNoise(float const samples[3], float time)
+{
+    float noise = samples[0] - 0.5f;
+    noise *= noise;
+    float noise2 = samples[1]*(sin(time)+0.5f);
+    float noise3 = samples[2]*2;
+    return Vec2f(cos(2*SHADER_PI*noise+noise3), sin(2*SHADER_PI*noise+noise3))*(0.1015f+(noise2*0.02f-0.05f) + 0.03f*noise3);
+}
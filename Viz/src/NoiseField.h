@@ -0,0 +1,68 @@
+//
+//  NoiseField.h
+//  EnsembleVisualization
+//
+//  The offsets particles.vert's calculatePositionNoise() gives particles,
+//  evaluated on a coarse grid every so often rather than for every particle
+//  every frame: the noise changes slowly over the screen and over time, so
+//  a particle can look its offset up between the grid points around it
+//  instead of taking three snoise() samples itself.
+//
+//  The grid's rows of snoise() are evaluated in batches (see SimplexNoise.h).
+//  Nothing in here needs a GL context; Renderer uploads offsets() into a
+//  texture for the shader, which filters it as sample() does.
+//
+//      mField.setup(64, 1 / 30.f);
+//      ...
+//      mField.update(time);   // once a frame, recomputes when it's due
+//      position += mField.sample(position) * 0.24f;
+//
+
+#pragma once
+#include <cinder/Vector.h>
+#include <vector>
+
+
+class NoiseField
+{
+public:
+    /// How far the grid reaches from the centre each way, in normalized
+    /// coordinates: enough to cover the render's corners at any rotation
+    static const float EXTENT;
+
+    NoiseField();
+
+    /// A grid of resolution by resolution points (at least 2) from -EXTENT
+    /// to EXTENT, evaluated again every interval seconds
+    void setup(int resolution, float interval);
+    bool isSetup() const { return mResolution > 0; }
+    int resolution() const { return mResolution; }
+
+    /// Evaluates the grid at time if it hasn't been yet, if interval has
+    /// passed since it last was, or if time has gone back. Returns whether
+    /// it did.
+    bool update(float time);
+
+    /// The offset at position, bilinear between the grid points around it.
+    /// Positions beyond the grid take the offset at its nearest edge.
+    ci::Vec2f sample(ci::Vec2f const& position) const;
+    /// The offset at each grid point, row by row from the bottom (y =
+    /// -EXTENT), each row from the left
+    std::vector<ci::Vec2f> const& offsets() const { return mOffsets; }
+
+    /// The z of each of the snoise() slices positionNoise() samples at time
+    static void slices(float time, float z[3]);
+    /// particles.vert's calculatePositionNoise(), the offset of a particle
+    /// from the snoise() of its position in each of slices()
+    static ci::Vec2f positionNoise(float const samples[3], float time);
+
+private:
+    int mResolution;
+    float mInterval;
+    /// When the grid was last evaluated, if mIsEvaluated
+    float mTime;
+    bool mIsEvaluated;
+    /// Where each grid point is, and the noise there in each slice
+    std::vector<float> mX, mY, mSamples[3];
+    std::vector<ci::Vec2f> mOffsets;
+};
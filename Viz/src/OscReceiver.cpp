@@ -6,8 +6,15 @@
 //
 //
 
+#include <functional>
+#include <iomanip>
 #include <sstream>
+#include <stdexcept>
 #include "OscReceiver.h"
+#include "ConnectionsBlob.h"
+#include "Log.h"
+#include "Trace.h"
+#include "AllocationTracker.h"
 using namespace ci;
 using namespace ci::osc;
 using namespace std;
@@ -19,102 +26,460 @@ OscReceiver::OscReceiver()
 , mListenPort(0)
 , mHasANewStateEverHappened(false)
 , mIsSetup(false)
+, mIsOffline(false)
+, mScriptedInputStart(-1)
+, mNumMessagesReceived(0)
+, mDecodeOnNetworkThread(false)
+, mNextSnapshot(1)
+, mHasUnpublishedChanges(false)
+, mClockElapsedTime(0)
+, mClockReference(std::chrono::steady_clock::now())
+, mFrameStats(NULL)
+, mStatsInterval(0)
+, mTimeStatsWereLastSent(-1)
+, mHasMonitor(false)
+, mNumParticles(0)
+, mNumPacketsAtLastStats(0)
 {
+    // Names the listener's threads once, as they start, for trace dumps
+    mOsc.setThreadStartedCallback(&Trace::setThreadName);
+}
 
+void OscReceiver::setSocketThreadOptions(int cpu, bool realtime, bool busyPoll)
+{
+    assert(!mIsSetup);
+    mOsc.setThreadCpu(cpu);
+    mOsc.setThreadRealtime(realtime);
+    mOsc.setBusyPoll(busyPoll);
+}
+
+void OscReceiver::setDecodeOnNetworkThread(bool enabled)
+{
+    assert(!mIsSetup);
+    mDecodeOnNetworkThread = enabled;
 }
 
-void OscReceiver::setup(int port, std::string stabilizerHost, int stabilizerPort)
+void OscReceiver::setup(int port, std::string stabilizerHost, int stabilizerPort, std::string const& multicastGroup)
 {
-    mOsc.setup(port);
+    // With a callback registered the listener hands each message to us
+    // on its own thread rather than queueing it, and a snapshot is
+    // published once each packet's messages have all been applied
+    if (mDecodeOnNetworkThread)
+    {
+        mOsc.registerMessageReceived(this, &OscReceiver::onMessageReceived);
+        mOsc.setPacketProcessedCallback(std::bind(&OscReceiver::onPacketProcessed, this));
+    }
+
+    mMulticastGroup.clear();
+    if (multicastGroup.empty())
+        mOsc.setup(port);
+    else
+    {
+        try
+        {
+            mOsc.setup(port, multicastGroup);
+            mMulticastGroup = multicastGroup;
+            VIZ_LOG("Receiving OSC from multicast group " << multicastGroup << ':' << port);
+        }
+        catch (std::runtime_error const& e)
+        {
+            VIZ_LOG("ERROR: could not join multicast group " << multicastGroup << " (" << e.what() << "), receiving unicast only");
+            mOsc.setup(port);
+        }
+    }
     mSender.setup(stabilizerHost, stabilizerPort);
+    // Outgoing messages are queued during the frame and sent together
+    // from the sender's own thread when update() flushes them
+    mSender.setBatching(true);
     mListenPort = port;
     mStabilizerHost = stabilizerHost;
     mStabilizerPort = stabilizerPort;
     mIsSetup = true;
 }
 
+void OscReceiver::setupOffline()
+{
+    // An unconnected sender drops what it is given
+    mIsOffline = true;
+    mIsSetup = true;
+}
+
+void OscReceiver::setStatsPublishing(float interval, std::string const& monitorHost, int monitorPort)
+{
+    assert(mIsSetup);
+    mStatsInterval = interval;
+    mHasMonitor = false;
+    if (interval <= 0 || monitorHost.empty())
+        return;
+    try
+    {
+        mMonitorSender.setup(monitorHost, monitorPort);
+        // the send itself happens on the sender's thread, not the frame loop
+        mMonitorSender.setBatching(true);
+        mHasMonitor = true;
+    }
+    catch (std::runtime_error const& e)
+    {
+        VIZ_LOG("ERROR: could not send stats to " << monitorHost << ':' << monitorPort << " (" << e.what() << "), sending them to the stabilizer");
+    }
+}
+
 void OscReceiver::update(float i_timeSinceAppLaunch, float i_timeSinceLastUpdate)
 {
     assert(mIsSetup);
-    assert(mState.instruments.size() == NUM_INSTRUMENTS);
+    AllocationScope allocations(ALLOC_OSC);
+    feedScriptedInput(i_timeSinceAppLaunch);
 
-    // For each received OSC message
-    Message m;
-    while (mOsc.hasWaitingMessages())
+    if (mDecodeOnNetworkThread)
     {
-        m.clear();
-        mOsc.getNextMessage(&m);
-
-        //
-        string address = m.getAddress();
-        if (address == "/viz/narrative"
-            && m.getArgType(0) == TYPE_FLOAT)
+        ScopedStageTimer timer(mFrameStats, STAGE_OSC_DRAIN);
+        std::vector<Message> replies;
         {
-            mState.narrative = m.getArgAsFloat(0);
+            std::lock_guard<std::mutex> lock(mWorkingMutex);
+            mClockElapsedTime = i_timeSinceAppLaunch;
+            mClockReference = std::chrono::steady_clock::now();
+            replies.swap(mReplies);
+            // Notes still age while nothing arrives, without the socket
+            // thread having to wake for them
+            ageNotes();
         }
-        else if (address == "/viz/note"
-                 && m.getArgType(0) == TYPE_INT32
-                 && m.getArgType(1) == TYPE_FLOAT)
+        for (size_t i=0; i<replies.size(); ++i)
+            mSender.sendMessage(replies[i]);
+
+        // All that's left for this thread is to take the latest snapshot
+        mHasNewState = mSnapshots.consume();
+        if (mHasNewState)
+            mLatency.snapshotConsumed(mSnapshots.front().number);
+    }
+    else
+    {
+        assert(mState.instruments.size() == NUM_INSTRUMENTS);
+
         {
-            int instrumentNo = m.getArgAsInt32(0);
-            if (instrumentNo < 0 || instrumentNo >= NUM_INSTRUMENTS)
+            ScopedStageTimer timer(mFrameStats, STAGE_OSC_DRAIN);
+            // For each received OSC message, from the socket or shared memory
+            Message m;
+            while (mOsc.hasWaitingMessages())
             {
-                std::cout << "ERROR: Note has instrument "<<instrumentNo<<" which is out of bounds." << endl;
-                continue;
+                m.clear();
+                mOsc.getNextMessage(&m);
+                if (!applyMessage(m, i_timeSinceAppLaunch))
+                    continue;
+                mLatency.messageApplied(m.getAddress(), m.getReceiveTimestamp());
+                mHasNewState = true;
             }
-            Note note(i_timeSinceAppLaunch, m.getArgAsFloat(1));
-            mState.instruments[instrumentNo].notes.push_back(note);
         }
-        else if (address == "/viz/connections"
-                 && m.getArgType(0) == TYPE_INT32)
+        ScopedStageTimer timer(mFrameStats, STAGE_STATE_UPDATE);
+        AllocationScope stateAllocations(ALLOC_STATE);
+        mState.update(i_timeSinceAppLaunch, i_timeSinceLastUpdate);
+    }
+
+    if (!mIsOffline && i_timeSinceAppLaunch - mTimeListenPortMessageWasLastSent > 5)
+    {
+        // Every display in a multicast group announces the same group, so
+        // the stabilizer only has one destination however many there are
+        Message m;
+        if (mMulticastGroup.empty())
         {
-            const int num_insts = m.getArgAsInt32(0);
-            if (num_insts > NUM_INSTRUMENTS)
-            {
-                std::cout << "ERROR: connections message sent with "<<num_insts<<" instruments but we are only setup to work with "<<NUM_INSTRUMENTS<<endl;
-                continue;
-            }
-            else if (num_insts*num_insts + 1 != m.getNumArgs())
-            {
-                printf("ERROR: connections message declares %d instruments but has %d arguments\n", num_insts, m.getNumArgs());
-                continue;
-            }
-//          std::cout << "state connections updated"<<endl;
-//          std::cout << "new connections: ";
-            for (int i=0; i<num_insts; i++)
-            {
-                for (int j=0; j<num_insts; j++)
-                {
-//                  // the + 1 is because the first argument is num_insts
-                    float v = m.getArgAsFloat(i * num_insts + j + 1);
-//                  std::cout << i << "->"<<j<<" "<<v<<", ";
-                    mState.instruments.at(i).connections.at(j) = v;
-                }
-            }
-//          std::cout << endl;
+            m.setAddress("/viz/listen_port");
+            m.addIntArg(mListenPort);
         }
-        else if (address=="/viz/debug" && m.getArgType(0)==TYPE_INT32)
+        else
         {
-            mState.debugMode = m.getArgAsInt32(0) != 0;
-            // get names if they're there
-            int num_names = std::min(NUM_INSTRUMENTS, m.getNumArgs()-1);
-            for (int i=0; i<num_names; ++i)
-                if (m.getArgType(i+1)==TYPE_STRING)
-                    mState.instruments.at(i).name = m.getArgAsString(i+1);
+            m.setAddress("/viz/listen_multicast");
+            m.addStringArg(mMulticastGroup);
+            m.addIntArg(mListenPort);
         }
-        mHasNewState = true;
-        mHasANewStateEverHappened = true;
+        mSender.sendMessage(m);
+        mTimeListenPortMessageWasLastSent = i_timeSinceAppLaunch;
     }
-    mState.update(i_timeSinceAppLaunch, i_timeSinceLastUpdate);
 
-    if (i_timeSinceAppLaunch - mTimeListenPortMessageWasLastSent > 5)
+    if (mStatsInterval > 0)
     {
-        Message m;
-        m.setAddress("/viz/listen_port");
-        m.addIntArg(mListenPort);
+        if (mTimeStatsWereLastSent < 0)
+        {
+            mNumPacketsAtLastStats = mOsc.getNumPacketsReceived();
+            mTimeStatsWereLastSent = i_timeSinceAppLaunch;
+        }
+        else if (i_timeSinceAppLaunch - mTimeStatsWereLastSent >= mStatsInterval)
+        {
+            sendStats(i_timeSinceAppLaunch - mTimeStatsWereLastSent);
+            mTimeStatsWereLastSent = i_timeSinceAppLaunch;
+        }
+    }
+
+    // Send anything queued this frame, including messages from toggleDebugMode()
+    mSender.flush();
+}
+
+void OscReceiver::sendStats(float period)
+{
+    FrameStats::Summary frame = {0, 0, 0, 0, 0};
+    if (mFrameStats)
+        frame = mFrameStats->summary(STAGE_FRAME);
+    const uint64_t numPackets = mOsc.getNumPacketsReceived();
+    const uint64_t numDropped = mOsc.getNumDropped() + mOsc.getNumSharedMemoryDropped();
+    LatencyHistogram latency = mLatency.takeRecent();
+
+    Message m;
+    m.setAddress("/viz/stats");
+    m.addFloatArg(frame.mean);
+    m.addFloatArg(frame.p50);
+    m.addFloatArg(frame.p99);
+    m.addIntArg(mNumParticles);
+    m.addFloatArg((numPackets - mNumPacketsAtLastStats) / period);
+    m.addIntArg(int(mOsc.getNumWaitingMessages()));
+    m.addIntArg(int(numDropped));
+    m.addFloatArg(latency.percentile(0.5) / 1e6f);
+    m.addFloatArg(latency.percentile(0.99) / 1e6f);
+    mNumPacketsAtLastStats = numPackets;
+
+    if (mHasMonitor)
+    {
+        mMonitorSender.sendMessage(m);
+        mMonitorSender.flush();
+    }
+    else
         mSender.sendMessage(m);
-        mTimeListenPortMessageWasLastSent = i_timeSinceAppLaunch;
+}
+
+void OscReceiver::feedScriptedInput(float elapsedTime)
+{
+    if (!isPlayingInput())
+        return;
+    if (mScriptedInputStart < 0)
+        mScriptedInputStart = elapsedTime;
+    const float seconds = elapsedTime - mScriptedInputStart;
+
+    // Replayed packets join the listener's queue, to be drained below
+    mOsc.advanceReplay(seconds);
+
+    mDueMessages.clear();
+    mScenario.takeDue(seconds, mDueMessages);
+    for (size_t i=0; i<mDueMessages.size(); ++i)
+    {
+        if (applyMessage(mDueMessages[i], elapsedTime))
+            mHasNewState = true;
+    }
+}
+
+bool OscReceiver::applyMessage(Message const& m, float i_timeSinceAppLaunch)
+{
+    ++mNumMessagesReceived;
+
+    // A malformed message from the network should never take us down
+    bool accepted;
+    try
+    {
+        accepted = handleMessage(m, i_timeSinceAppLaunch);
+    }
+    catch (OscExc const&)
+    {
+        VIZ_LOG_RATE_LIMITED(5, "ERROR: malformed "<<m.getAddress()<<" message with "<<m.getNumArgs()<<" arguments");
+        accepted = false;
+    }
+    if (accepted)
+        mHasANewStateEverHappened = true;
+    return accepted;
+}
+
+void OscReceiver::onMessageReceived(Message const* m)
+{
+    TRACE_SCOPE("apply OSC message");
+    AllocationScope allocations(ALLOC_OSC);
+    std::lock_guard<std::mutex> lock(mWorkingMutex);
+    if (!applyMessage(*m, elapsedTimeNow()))
+        return;
+    mLatency.messageApplied(m->getAddress(), m->getReceiveTimestamp(), mNextSnapshot);
+    mHasUnpublishedChanges = true;
+}
+
+void OscReceiver::onPacketProcessed()
+{
+    std::lock_guard<std::mutex> lock(mWorkingMutex);
+    if (!mHasUnpublishedChanges)
+        return;
+    TRACE_SCOPE("publish OSC state");
+    AllocationScope allocations(ALLOC_OSC);
+    mState.update(elapsedTimeNow(), 0);
+    publishState();
+}
+
+void OscReceiver::ageNotes()
+{
+    // Only a snapshot that loses some is worth publishing
+    size_t numNotes = 0;
+    for (size_t i=0; i<mState.instruments.size(); ++i)
+        numNotes += mState.instruments[i].notes.size();
+    mState.update(elapsedTimeNow(), 0);
+    for (size_t i=0; i<mState.instruments.size(); ++i)
+        numNotes -= mState.instruments[i].notes.size();
+    if (numNotes > 0)
+        publishState();
+}
+
+float OscReceiver::elapsedTimeNow() const
+{
+    std::chrono::duration<float> sinceUpdate = std::chrono::steady_clock::now() - mClockReference;
+    return mClockElapsedTime + sinceUpdate.count();
+}
+
+void OscReceiver::publishState()
+{
+    // The slot keeps its allocations from last time round, so after the
+    // first few snapshots this copy doesn't allocate
+    Snapshot& snapshot = mSnapshots.back();
+    snapshot.state = mState;
+    snapshot.number = mNextSnapshot++;
+    mSnapshots.publish();
+    mHasUnpublishedChanges = false;
+}
+
+void OscReceiver::sendReply(Message const& m)
+{
+    if (mDecodeOnNetworkThread)
+        mReplies.push_back(m);
+    else
+        mSender.sendMessage(m);
+}
+
+bool OscReceiver::handleMessage(Message const& m, float i_timeSinceAppLaunch)
+{
+    string address = m.getAddress();
+    if (address == "/viz/narrative"
+        && m.getArgType(0) == TYPE_FLOAT)
+    {
+        mState.narrative = m.getArgAsFloat(0);
+    }
+    else if (address == "/viz/note"
+             && m.getArgType(0) == TYPE_INT32
+             && m.getArgType(1) == TYPE_FLOAT)
+    {
+        int instrumentNo = m.getArgAsInt32(0);
+        if (instrumentNo < 0 || instrumentNo >= NUM_INSTRUMENTS)
+        {
+            VIZ_LOG_RATE_LIMITED(5, "ERROR: Note has instrument "<<instrumentNo<<" which is out of bounds.");
+            return false;
+        }
+        Note note(i_timeSinceAppLaunch, m.getArgAsFloat(1), m.getReceiveTimestamp());
+        mState.instruments[instrumentNo].notes.push_back(note);
     }
+    else if (address == "/viz/connections"
+             && m.getArgType(0) == TYPE_INT32)
+    {
+        const int num_insts = m.getArgAsInt32(0);
+        if (num_insts > NUM_INSTRUMENTS)
+        {
+            VIZ_LOG_RATE_LIMITED(5, "ERROR: connections message sent with "<<num_insts<<" instruments but we are only setup to work with "<<NUM_INSTRUMENTS);
+            return false;
+        }
+        else if (num_insts*num_insts + 1 != m.getNumArgs())
+        {
+            VIZ_LOG_RATE_LIMITED(5, "ERROR: connections message declares "<<num_insts<<" instruments but has "<<m.getNumArgs()<<" arguments");
+            return false;
+        }
+//      std::cout << "state connections updated"<<endl;
+//      std::cout << "new connections: ";
+        for (int i=0; i<num_insts; i++)
+        {
+            for (int j=0; j<num_insts; j++)
+            {
+//              // the + 1 is because the first argument is num_insts
+                float v = m.getArgAsFloat(i * num_insts + j + 1);
+//              std::cout << i << "->"<<j<<" "<<v<<", ";
+                mState.instruments.at(i).connections.at(j) = v;
+            }
+        }
+//      std::cout << endl;
+    }
+    else if (address == "/viz/connections_blob"
+             && m.getNumArgs() == 3
+             && m.getArgType(0) == TYPE_INT32
+             && m.getArgType(1) == TYPE_INT32
+             && m.getArgType(2) == TYPE_BLOB)
+    {
+        // Same matrix as /viz/connections packed into a single blob,
+        // see ConnectionsBlob.h for the encodings
+        string error;
+        if (!decodeConnectionsBlob(m.getArgAsInt32(0), m.getArgAsInt32(1), m.getArgAsBlob(2), mState, error))
+        {
+            VIZ_LOG_RATE_LIMITED(5, "ERROR: connections_blob message: "<<error);
+            return false;
+        }
+    }
+    else if (address=="/viz/debug" && m.getArgType(0)==TYPE_INT32)
+    {
+        mState.debugMode = m.getArgAsInt32(0) != 0;
+        // get names if they're there
+        int num_names = std::min(NUM_INSTRUMENTS, m.getNumArgs()-1);
+        for (int i=0; i<num_names; ++i)
+            if (m.getArgType(i+1)==TYPE_STRING)
+                mState.instruments.at(i).name = m.getArgAsString(i+1);
+    }
+    else if (address=="/viz/ping" && m.getArgType(0)==TYPE_INT32)
+    {
+        // Lets the stabilizer (or a stand-in) measure how many messages we
+        // actually get through, including this one
+        Message pong;
+        pong.setAddress("/viz/pong");
+        pong.addIntArg(m.getArgAsInt32(0));
+        pong.addIntArg(int(mNumMessagesReceived));
+        sendReply(pong);
+    }
+    return true;
+}
+
+bool OscReceiver::setupSharedMemory(std::string const& name)
+{
+    return mOsc.setupSharedMemory(name);
+}
+
+bool OscReceiver::startRecording(std::string const& path)
+{
+    return mOsc.startRecording(path);
+}
+
+void OscReceiver::stopRecording()
+{
+    mOsc.stopRecording();
+}
+
+bool OscReceiver::isRecording() const
+{
+    return mOsc.isRecording();
+}
+
+bool OscReceiver::startReplay(std::string const& path, double speed)
+{
+    return mOsc.startReplay(path, speed);
+}
+
+bool OscReceiver::startSteppedReplay(std::string const& path)
+{
+    assert(!mDecodeOnNetworkThread);
+    if (!mOsc.startSteppedReplay(path))
+        return false;
+    mScriptedInputStart = -1;
+    return true;
+}
+
+bool OscReceiver::startScenario(std::string const& path)
+{
+    assert(!mDecodeOnNetworkThread);
+    if (!mScenario.load(path))
+        return false;
+    mScriptedInputStart = -1;
+    return true;
+}
+
+bool OscReceiver::isPlayingInput() const
+{
+    return mOsc.isReplaying() || (mScenario.isLoaded() && !mScenario.isFinished());
+}
+
+void OscReceiver::frameSubmitted()
+{
+    mLatency.frameSubmitted();
 }
 
 bool OscReceiver::hasNewState() const
@@ -122,13 +487,20 @@ bool OscReceiver::hasNewState() const
     return mHasNewState;
 }
 
-State OscReceiver::state() const
+State const& OscReceiver::state() const
 {
-    return mState;
+    return mDecodeOnNetworkThread ? mSnapshots.front().state : mState;
 }
 
 void OscReceiver::setState(State const& state)
 {
+    if (mDecodeOnNetworkThread)
+    {
+        std::lock_guard<std::mutex> lock(mWorkingMutex);
+        mState = state;
+        publishState();
+        return;
+    }
     mState = state;
     mHasNewState = true;
 }
@@ -138,21 +510,50 @@ void OscReceiver::setState(State const& state)
 std::string OscReceiver::status() const
 {
     std::stringstream ss;
-    ss <<"OscReceiver (listen: "<<mListenPort<<" stabilizer: "<<mStabilizerHost<<':'<<mStabilizerPort<<") ";
+    ss <<"OscReceiver (listen: "<<mListenPort;
+    if (!mMulticastGroup.empty())
+        ss <<" multicast: "<<mMulticastGroup;
+    ss <<" stabilizer: "<<mStabilizerHost<<':'<<mStabilizerPort<<") ";
     ss << (mHasANewStateEverHappened
         ? "OSC Data has been received"
         : "Yet to receive OSC data");
+    ss << " ("<<mNumMessagesReceived<<" messages)";
+    if (mOsc.getNumDropped() > 0)
+        ss << " (dropped "<<mOsc.getNumDropped()<<" malformed)";
+    if (mOsc.isRecording())
+        ss << " recording";
+    if (mOsc.isReplaying())
+        ss << " replaying";
+    if (mOsc.getNumSharedMemoryDropped() > 0)
+        ss << " (shared memory dropped "<<mOsc.getNumSharedMemoryDropped()<<")";
+    ss << "\n";
+    Listener::WakeUpLatency wakeUp = mOsc.getWakeUpLatency();
+    ss << "Socket thread: " << mOsc.getThreadStatus()
+       << std::fixed << std::setprecision(1)
+       << "; wake-up latency (us) p50 " << wakeUp.median / 1e3
+       << "  p99 " << wakeUp.p99 / 1e3
+       << "  max " << wakeUp.maximum / 1e3
+       << " (last " << wakeUp.count << " packets)\n";
+    ss << mLatency.status();
     return ss.str();
 }
 
 
 void OscReceiver::toggleDebugMode()
 {
-    mState.debugMode = !mState.debugMode;
+    bool debugMode;
+    {
+        std::lock_guard<std::mutex> lock(mWorkingMutex);
+        mState.debugMode = !mState.debugMode;
+        debugMode = mState.debugMode;
+        if (mDecodeOnNetworkThread)
+            publishState();
+        else
+            mHasNewState = true;
+    }
     // send to stabilizer to prevent it overriding our value
     Message m;
     m.setAddress("/viz/debug");
-    m.addIntArg(int(mState.debugMode));
+    m.addIntArg(int(debugMode));
     mSender.sendMessage(m);
-    mHasNewState = true;
 }
@@ -7,21 +7,50 @@
 //
 
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <string>
+#include <vector>
 #include "State.h"
 //#include "ofxOsc.h"
 #include "OscListener.h"
 #include "OscSender.h"
+#include "LatencyTracker.h"
+#include "TripleBuffer.h"
+#include "FrameStats.h"
+#include "Scenario.h"
 
 class OscReceiver
 {
 public:
 	OscReceiver();
-	void setup(int listenPort, std::string stabilizerHost, int stabilizerPort);
+	/// With a multicastGroup (e.g. "239.255.0.1") we also receive what the
+	/// stabilizer sends to the group, and announce the group rather than
+	/// our port so that one send reaches every display. Falls back to
+	/// unicast if the group can't be joined.
+	void setup(int listenPort, std::string stabilizerHost, int stabilizerPort, std::string const& multicastGroup="");
+	/// Instead of setup(), for rendering offline: no socket and nothing
+	/// sent, so input only comes from a stepped replay or a scenario
+	void setupOffline();
 	void update(float elapsedTime, float dt);
+
+	/// Decode messages and apply them to the state on the network thread as
+	/// they arrive, publishing a snapshot once all of a packet's messages
+	/// are applied. Shared memory is read on that thread too. update() then
+	/// only ages notes that have run out, while nothing arrives, and picks
+	/// up the latest snapshot, so frame time doesn't depend on how many
+	/// messages came in. Call before setup().
+	void setDecodeOnNetworkThread(bool enabled);
+
+	/// Scheduling of the socket thread: pin it to a CPU (-1 for any), ask
+	/// for realtime priority, and busy poll the socket instead of sleeping
+	/// in select(). What it got and the resulting wake-up latency show in
+	/// status(). Call before setup().
+	void setSocketThreadOptions(int cpu, bool realtime, bool busyPoll);
 	
 	bool hasNewState() const;
-	State state() const;
+	State const& state() const;
 	/// Manually set state - will be overwritten by any osc data
 	/// Also will be rotated
 	void setState(State const& state);
@@ -30,20 +59,126 @@ public:
 	/// triggered manually here
 	void toggleDebugMode();
 
+	/// Call after submitting each frame, to measure input latency
+	void frameSubmitted();
+
+	/// Time the stages of update() into stats (NULL to stop)
+	void setFrameStats(FrameStats* stats) { mFrameStats = stats; }
+
+	/// Send /viz/stats every interval seconds (0 for never) from update(),
+	/// to the stabilizer or, if monitorHost isn't empty, to
+	/// monitorHost:monitorPort. Frame times come from the FrameStats given
+	/// to setFrameStats(). Call after setup(). The message carries:
+	///   f frame time mean, p50, p99 (ms, last few seconds)
+	///   i particles
+	///   f OSC packets per second
+	///   i messages waiting in the queue
+	///   i packets and messages dropped since launch
+	///   f input to frame latency p50, p99 (ms, since the last stats)
+	void setStatsPublishing(float interval, std::string const& monitorHost="", int monitorPort=0);
+	/// Particle count reported in /viz/stats
+	void setNumParticles(int numParticles) { mNumParticles = numParticles; }
+
+	/// Also receive through a shared memory ring that a stabilizer on the
+	/// same machine can write to. Returns false if it can't be created.
+	bool setupSharedMemory(std::string const& name);
+
+	/// Record everything received on the socket to a capture file, or
+	/// replay one as if it were arriving now. speed 0 replays as fast as
+	/// possible. Both return false if the file can't be opened.
+	bool startRecording(std::string const& path);
+	void stopRecording();
+	bool isRecording() const;
+	bool startReplay(std::string const& path, double speed=1);
+	/// Replay a capture file, or apply a scenario (see Scenario.h), from
+	/// update() by the elapsed time it is given rather than the clock, so
+	/// the same messages land on the same frames every run. Time starts
+	/// at the next update(). Not when decoding on the network thread.
+	bool startSteppedReplay(std::string const& path);
+	bool startScenario(std::string const& path);
+	/// Whether a replay or scenario has messages still to come
+	bool isPlayingInput() const;
+
 	/// For debugging
 	std::string status() const;
 
 private:
+	/// Applies one received message to mState. Returns false if it was
+	/// rejected. May throw ci::osc::OscExc if the message is malformed.
+	bool handleMessage(ci::osc::Message const& m, float elapsedTime);
+	/// handleMessage() for a message straight off the network, counting it
+	/// and catching malformed ones
+	bool applyMessage(ci::osc::Message const& m, float elapsedTime);
+	/// Replies are sent from update(), as the sender isn't thread safe
+	void sendReply(ci::osc::Message const& m);
+	/// /viz/stats covering the given number of seconds
+	void sendStats(float period);
+	/// Feed the stepped replay and scenario up to the given elapsed time
+	void feedScriptedInput(float elapsedTime);
+
+	/// Listener callbacks, on the network thread, when decoding there
+	void onMessageReceived(ci::osc::Message const* m);
+	void onPacketProcessed();
+	/// Ages the notes in mState, publishing a snapshot if any have gone.
+	/// mWorkingMutex must be held.
+	void ageNotes();
+	/// Elapsed time as update() would see it now, from any thread
+	float elapsedTimeNow() const;
+	/// Copies mState into a new snapshot for update() to pick up.
+	/// mWorkingMutex must be held.
+	void publishState();
+
 	ci::osc::Listener mOsc;
 	ci::osc::Sender mSender;
+	/// The state messages are applied to. When decoding on the network
+	/// thread it belongs to that thread, under mWorkingMutex, and the render
+	/// thread reads mSnapshots instead.
 	State mState;
+	LatencyTracker mLatency;
+	FrameStats* mFrameStats;
+
+	struct Snapshot
+	{
+		State state;
+		unsigned long number;
+		Snapshot() : number(0) {}
+	};
+	bool mDecodeOnNetworkThread;
+	TripleBuffer<Snapshot> mSnapshots;
+	std::mutex mWorkingMutex;
+	unsigned long mNextSnapshot;
+	/// Messages have been applied to mState since the last snapshot
+	bool mHasUnpublishedChanges;
+	std::vector<ci::osc::Message> mReplies;
+	/// Elapsed time at the last update(), and when that was
+	float mClockElapsedTime;
+	std::chrono::steady_clock::time_point mClockReference;
 	
 	int mListenPort;
+	/// Empty unless receiving by multicast
+	std::string mMulticastGroup;
 	std::string mStabilizerHost;
 	int mStabilizerPort;
 	
 	bool mHasNewState;
 	float mTimeListenPortMessageWasLastSent;
-	bool mHasANewStateEverHappened;
+	std::atomic<bool> mHasANewStateEverHappened;
 	bool mIsSetup;
+	bool mIsOffline;
+
+	Scenario mScenario;
+	/// Elapsed time stepped replays and scenarios count from, negative
+	/// until the first update() after one is started
+	float mScriptedInputStart;
+	std::vector<ci::osc::Message> mDueMessages;
+
+	float mStatsInterval;
+	/// Negative until the first interval has started
+	float mTimeStatsWereLastSent;
+	ci::osc::Sender mMonitorSender;
+	bool mHasMonitor;
+	int mNumParticles;
+	uint64_t mNumPacketsAtLastStats;
+	/// Messages taken off the queue since launch, reported in /viz/pong
+	std::atomic<unsigned long> mNumMessagesReceived;
 };
\ No newline at end of file
@@ -9,12 +9,20 @@
 // This module
 #include "Renderer.h"
 
+// Project
+#include "Log.h"
+#include "NoiseField.h"
+#include "SimplexNoise.h"
+#include "Trace.h"
+#include "AllocationTracker.h"
+
 // Cinder
 #include <cinder/Surface.h>
 #include <cinder/Rand.h>
 #include <cinder/DataSource.h>
 #include <cinder/Channel.h>
 #include <cinder/ImageIo.h>
+#include <cinder/CinderMath.h>
 using namespace ci;
 
 // C++ std
@@ -44,6 +52,7 @@ Renderer::Renderer()
     , mNumParticles(30000)
     , mNumRandoms(9)
     , mRotation(0.0)
+    , mFrameStats(NULL)
 {
     // + Load blob texture {{{
 
@@ -152,16 +161,17 @@ Renderer::Renderer()
 
 void Renderer::loadShader()
 {
+    TRACE_SCOPE("loadShader");
     mShaderLoaded = false;
     try
     {
         mShader = gl::GlslProg::create(DataSourcePath::create(app::getAssetPath("particles.vert")), DataSourcePath::create(app::getAssetPath("particles.frag")));
         mShaderLoaded = true;
-        cout << "\n*\nShader compiled successfully" << endl;
+        VIZ_LOG("\n*\nShader compiled successfully");
     }
     catch (gl::GlslProgCompileExc e)
     {
-        cout << "\n*\nError compiling shader:\n" <<e.what()<<endl;
+        VIZ_LOG("\n*\nError compiling shader:\n" <<e.what());
     }
 }
 
@@ -189,14 +199,78 @@ vector<vector<float> > makeRandoms(int rows, int cols)
 }
 
 
+void Renderer::setNoiseField(int resolution, float interval)
+{
+    if (resolution <= 0)
+    {
+        mNoiseField = NoiseField();
+        mNoiseFieldTex.reset();
+        return;
+    }
+    mNoiseField.setup(resolution, interval);
+    // Offsets in red and green, filtered as NoiseField::sample() does
+    mNoiseFieldSurface = Surface32f(mNoiseField.resolution(), mNoiseField.resolution(), true, SurfaceChannelOrder::RGBA);
+    mNoiseFieldTex = gl::Texture::create(mNoiseFieldSurface);
+    mNoiseFieldTex->setMagFilter(GL_LINEAR);
+    mNoiseFieldTex->setMinFilter(GL_LINEAR);
+    mNoiseFieldTex->setWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+}
+
+void Renderer::updateNoiseFieldTex()
+{
+    vector<Vec2f> const& offsets = mNoiseField.offsets();
+    const int size = mNoiseField.resolution();
+    for (int j=0; j<size; ++j)
+    {
+        for (int i=0; i<size; ++i)
+        {
+            Vec2f const& offset = offsets[j * size + i];
+            *mNoiseFieldSurface.getDataRed(Vec2i(i, j)) = offset.x;
+            *mNoiseFieldSurface.getDataGreen(Vec2i(i, j)) = offset.y;
+            *mNoiseFieldSurface.getDataBlue(Vec2i(i, j)) = 0.0f;
+            *mNoiseFieldSurface.getDataAlpha(Vec2i(i, j)) = 0.0f;
+        }
+    }
+    mNoiseFieldTex->update(mNoiseFieldSurface);
+}
+
 void Renderer::draw(float elapsedTime)
+{
+    AllocationScope allocations(ALLOC_RENDERER);
+    {
+        ScopedStageTimer buildTimer(mFrameStats, STAGE_RENDERER_BUILD);
+        buildPoints(mPoints);
+        if (mNoiseField.update(elapsedTime))
+            updateNoiseFieldTex();
+    }
+
+    {
+        ScopedStageTimer timer(mFrameStats, STAGE_PARTICLE_RENDER);
+        render(elapsedTime, mPoints);
+    }
+
+    if (mEnableDrawConnectionsDebug)
+        drawConnectionsDebug();
+}
+
+void Renderer::drawSoftware(float elapsedTime, SpriteRasterizer& rasterizer, float fadeAlpha)
+{
+    AllocationScope allocations(ALLOC_RENDERER);
+    {
+        ScopedStageTimer buildTimer(mFrameStats, STAGE_RENDERER_BUILD);
+        buildPoints(mPoints);
+        computeSprites(elapsedTime, mPoints, mSprites);
+    }
+
+    ScopedStageTimer timer(mFrameStats, STAGE_PARTICLE_RENDER);
+    rasterizer.render(fadeAlpha, mSprites);
+}
+
+void Renderer::buildPoints(std::vector<ci::Vec4f>& points)
 {
     int N = mNumParticles;
-    // w is the size, z is the id
-    vector<Vec4f> points;
+    points.clear();
     points.reserve(N);
-    map<int,int> pCount;
-    map<int,int> qCount;
     for (int particleNo = 0; particleNo < N; ++particleNo)
     {
         int randomCount = 0;
@@ -213,11 +287,6 @@ void Renderer::draw(float elapsedTime)
         }
         points.push_back(Vec4f(p, q, points.size(), amount));
     }
-
-    render(elapsedTime, points);
-
-    if (mEnableDrawConnectionsDebug)
-        drawConnectionsDebug();
 }
 
 void Renderer::render(float elapsedTime, std::vector<ci::Vec4f> const& points)
@@ -241,6 +310,11 @@ void Renderer::render(float elapsedTime, std::vector<ci::Vec4f> const& points)
     glBindTexture(GL_TEXTURE_2D, mRandomTex->getId());
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, mControlPointsTex->getId());
+    if (mNoiseFieldTex)
+    {
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, mNoiseFieldTex->getId());
+    }
     if (mShaderLoaded)
     {
         mShader->bind();
@@ -252,6 +326,10 @@ void Renderer::render(float elapsedTime, std::vector<ci::Vec4f> const& points)
         mShader->uniform("numRandomsPerParticle", mNumRandoms);
         mShader->uniform("textureRowSize", TEXTURE_ROW_SIZE);
         mShader->uniform("time", elapsedTime);
+        mShader->uniform("NoiseField", 3);
+        // 0 for the shader to evaluate the noise itself
+        mShader->uniform("noiseFieldSize", mNoiseFieldTex? float(mNoiseField.resolution()) : 0.f);
+        mShader->uniform("noiseFieldExtent", NoiseField::EXTENT);
     }
     glMatrixMode(GL_MODELVIEW);
     glEnable(GL_POINT_SPRITE);
@@ -266,6 +344,8 @@ void Renderer::render(float elapsedTime, std::vector<ci::Vec4f> const& points)
     {
         mShader->unbind();
     }
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, NULL);
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, NULL);
     glActiveTexture(GL_TEXTURE1);
@@ -275,6 +355,102 @@ void Renderer::render(float elapsedTime, std::vector<ci::Vec4f> const& points)
 //  gl::draw(mControlPointsTex, Rectf(-1, -1, 1, 1));
 }
 
+namespace
+{
+    float ups_sq(float x)
+    {
+        return 1.f - (1.f-x)*(1.f-x);
+    }
+}
+
+void Renderer::computeSprites(float elapsedTime, std::vector<ci::Vec4f> const& points, std::vector<SpriteRasterizer::Sprite>& sprites)
+{
+    const float time = elapsedTime;
+    // glRotatef() takes degrees
+    const float rotation = toRadians(mRotation);
+    const bool useNoiseField = mNoiseField.isSetup();
+    if (useNoiseField)
+        mNoiseField.update(time);
+    sprites.clear();
+    sprites.reserve(points.size());
+    mNoiseX.clear();
+    mNoiseY.clear();
+    for (size_t i=0; i<points.size(); ++i)
+    {
+        const int id = int(points[i].z);
+        const int inst0 = int(points[i].x);
+        const int inst1 = int(points[i].y);
+        const float amount = points[i].w;
+        if (inst0 == inst1)
+            continue;
+        // The shader's rand() reads the particle's row of mRandomTex in turn
+        vector<float> const& randoms = mRandoms[id % TEXTURE_ROW_SIZE];
+        int randomCount = 0;
+
+        float period = randoms[randomCount++]*50.f + 10;
+        float phase = randoms[randomCount++]*period;
+        float t = (time+phase)/period;
+        t -= floor(t);
+        t *= min(1.f, t+0.2f);
+        Vec2f position = shaderSpline(inst0, inst1, t);
+        position.rotate(rotation);
+        if (useNoiseField)
+            position += mNoiseField.sample(position)*0.24f;
+        else
+        {
+            // moved by the noise below
+            mNoiseX.push_back(position.x);
+            mNoiseY.push_back(position.y);
+        }
+
+        SpriteRasterizer::Sprite sprite;
+        sprite.position = position;
+        sprite.size = 2.05f*(20.12f*(1+2*cos(randoms[randomCount++])-0.5f)*0.7f*amount*.75f);
+        const float brightness = ups_sq(amount)*(2*randoms[randomCount++]*.21315f+0.7543214f);
+        if (randoms[randomCount++]<0.04f)
+        {
+            const float r0 = randoms[randomCount++];
+            const float r1 = randoms[randomCount++];
+            float x = max(0.f, sin(time*r0*r1*0.572f)-0.97f)/0.03f;
+            sprite.size += 0.5f*x*amount*100;
+        }
+        // particles.frag
+        sprite.alpha = 0.04f*brightness*3.f;
+        sprites.push_back(sprite);
+    }
+    if (useNoiseField)
+        return;
+
+    // The noise a slice at a time, as many particles at once as the CPU can
+    const int n = int(mNoiseX.size());
+    float z[3];
+    NoiseField::slices(time, z);
+    for (int k=0; k<3; ++k)
+    {
+        mNoise[k].resize(n);
+        if (n > 0)
+            snoise(&mNoiseX[0], &mNoiseY[0], z[k], &mNoise[k][0], n);
+    }
+    for (int i=0; i<n; ++i)
+    {
+        const float samples[3] = { mNoise[0][i], mNoise[1][i], mNoise[2][i] };
+        sprites[i].position += NoiseField::positionNoise(samples, time)*0.24f;
+    }
+}
+
+ci::Vec2f Renderer::shaderSpline(int inst0, int inst1, float t) const
+{
+    // Tangents as updateCalculatedControlPoints() caches them, the next
+    // point less this one and none at the end
+    vector<Vec2f> const& ps = mCalculatedControlPoints.at(inst0).at(inst1);
+    const float numSegments = ps.size() - 1;
+    const int segment = int(min(numSegments-1, float(int(t*numSegments))));
+    const float p = t*numSegments - segment;
+    const Vec2f tangent0 = ps[segment+1] - ps[segment];
+    const Vec2f tangent1 = segment+2 < int(ps.size())? ps[segment+2] - ps[segment+1] : Vec2f(0, 0);
+    return hermiteSpline(ps[segment], tangent0, ps[segment+1], tangent1, p);
+}
+
 void Renderer::setControlPoints(ControlPointMap const & points)
 {
     mControlPoints = points;
@@ -426,39 +602,6 @@ void Renderer::drawConnectionsDebug()
     gl::lineWidth(1.f);
 }
 
-template <typename T>
-T Renderer::hermiteSpline(T const& point0, T const& tangent0, T const& point1, T const& tangent1, float s)
-{
-    float h1 =  2*s*s*s - 3*s*s + 1;          // calculate basis function 1
-    float h2 = -2*s*s*s + 3*s*s;              // calculate basis function 2
-    float h3 =   s*s*s  - 2*s*s + s;         // calculate basis function 3
-    float h4 =   s*s*s  -  s*s;              // calculate basis function 4
-    T p = h1*point0 +                    // multiply and sum all funtions
-    h2*point1 +                    // together to build the interpolated
-    h3*tangent0 +                    // point along the curve.
-    h4*tangent1;
-    return p;
-}
-
-template <typename T>
-T Renderer::hermiteSpline(vector<T> const& points, float t)
-{
-    assert(points.size()>=2);
-    const int numSegments = points.size() - 1;
-    int segment = min(numSegments-1, int(t*numSegments));
-    float p = t*numSegments - segment;
-    assert(0<=p && p<=1);
-    assert(segment < points.size()-1);
-    // last segment is a special case
-    // ...
-    T tangent0 = points[segment+1]-points[segment];
-    T tangent1 =
-        segment+2>=points.size()? T()
-                                : points[segment+2]-points[segment];
-    return hermiteSpline(points[segment], tangent0, points[segment+1], tangent1, p);
-
-}
-
 Vec2f Renderer::interpHermite(int inst0, int inst1, float t) const
 {
     vector<Vec2f> const & points = mCalculatedControlPoints.at(inst0).at(inst1);
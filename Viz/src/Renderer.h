@@ -12,9 +12,13 @@
 // This program
 #include "State.h"
 #include "Common.h"
+#include "FrameStats.h"
+#include "NoiseField.h"
+#include "SpriteRasterizer.h"
 
 // Cinder
 #include <cinder/gl/Texture.h>
+#include <cinder/Surface.h>
 #include <cinder/Perlin.h>
 #include <cinder/gl/GlslProg.h>
 
@@ -29,6 +33,9 @@ public:
     State state() const;
 
     void draw(float elapsedTime);
+    /// As draw(), but on the CPU into rasterizer, over the last frame faded
+    /// as a black quad of fadeAlpha alpha would fade it. Uses no GL.
+    void drawSoftware(float elapsedTime, SpriteRasterizer& rasterizer, float fadeAlpha);
 
     /// control points for splines
     void setControlPoints(ControlPointMap const& points);
@@ -41,8 +48,34 @@ public:
 
     void setRotation(float radians) { mRotation = radians; }
 
+    /// Have the particles look up their noise offsets in a NoiseField of
+    /// resolution by resolution points, evaluated every interval seconds,
+    /// rather than each evaluate the noise itself. Cheaper, though coarser
+    /// in space and time. 0 (the default) for the noise itself.
+    void setNoiseField(int resolution, float interval);
+
+    int numParticles() const { return mNumParticles; }
+
+    template <typename T>
+    static T hermiteSpline(T const& point0, T const& tangent0, T const& point1, T const& tangent1, float t);
+
+    /// Through all the points, t from 0 to 1
+    template <typename T>
+    static T hermiteSpline(std::vector<T> const& points, float t);
+
+    /// Time building the points and rendering them into stats (NULL to stop)
+    void setFrameStats(FrameStats* stats) { mFrameStats = stats; }
+
 private:
+    /// w is the size, z is the id
+    void buildPoints(std::vector<ci::Vec4f>& points);
     void render(float elapsedTime, std::vector<ci::Vec4f> const& points);
+    /// What particles.vert and particles.frag make of the points
+    void computeSprites(float elapsedTime, std::vector<ci::Vec4f> const& points, std::vector<SpriteRasterizer::Sprite>& sprites);
+    /// The spline as particles.vert reads it from mControlPointsTex
+    ci::Vec2f shaderSpline(int inst0, int inst1, float t) const;
+    /// Uploads mNoiseField into mNoiseFieldTex
+    void updateNoiseFieldTex();
     void drawQuad(ci::Vec2f const& pos, ci::Vec2f const& size);
     void drawConnectionsDebug();
 //  ci::Vec2f interp(ci::Vec2f const& orig, ci::Vec2f const& dest, float t);
@@ -63,6 +96,7 @@ private:
 //  int mRandomsRows;
 //  int mRandomsCols;
     float mRotation;
+    FrameStats* mFrameStats;
 
     ci::gl::GlslProgRef mShader;
     bool mShaderLoaded;
@@ -77,17 +111,58 @@ private:
 
     float mx, my;
 
-    template <typename T>
-    static T hermiteSpline(T const& point0, T const& tangent0, T const& point1, T const& tangent1, float t);
-
-    template <typename T>
-    static T hermiteSpline(std::vector<T> const& points, float t);
-
     ci::Vec2f interpHermite(int inst0, int inst1, float t) const;
 
     ci::Perlin mPerlin;
+
+    /// Kept between frames of draw() and drawSoftware(), so they aren't
+    /// allocated every frame
+    std::vector<ci::Vec4f> mPoints;
+    std::vector<SpriteRasterizer::Sprite> mSprites;
+    /// computeSprites()'s particle positions before the noise, and the
+    /// noise there in each of its three slices
+    std::vector<float> mNoiseX, mNoiseY, mNoise[3];
+
+    /// Not set up unless setNoiseField() was given a resolution
+    NoiseField mNoiseField;
+    /// mNoiseField's offsets in red and green, row by row from the bottom
+    ci::gl::TextureRef mNoiseFieldTex;
+    ci::Surface32f mNoiseFieldSurface;
 };
 
+template <typename T>
+T Renderer::hermiteSpline(T const& point0, T const& tangent0, T const& point1, T const& tangent1, float s)
+{
+    float h1 =  2*s*s*s - 3*s*s + 1;          // calculate basis function 1
+    float h2 = -2*s*s*s + 3*s*s;              // calculate basis function 2
+    float h3 =   s*s*s  - 2*s*s + s;         // calculate basis function 3
+    float h4 =   s*s*s  -  s*s;              // calculate basis function 4
+    T p = h1*point0 +                    // multiply and sum all funtions
+    h2*point1 +                    // together to build the interpolated
+    h3*tangent0 +                    // point along the curve.
+    h4*tangent1;
+    return p;
+}
+
+template <typename T>
+T Renderer::hermiteSpline(std::vector<T> const& points, float t)
+{
+    assert(points.size()>=2);
+    const int numSegments = points.size() - 1;
+    int segment = std::min(numSegments-1, int(t*numSegments));
+    float p = t*numSegments - segment;
+    assert(0<=p && p<=1);
+    assert(segment < points.size()-1);
+    // last segment is a special case
+    // ...
+    T tangent0 = points[segment+1]-points[segment];
+    T tangent1 =
+        segment+2>=points.size()? T()
+                                : points[segment+2]-points[segment];
+    return hermiteSpline(points[segment], tangent0, points[segment+1], tangent1, p);
+
+}
+
 //template<typename T, typename L>
 //T bezierInterp( const T &a, const T &b, const T &c, const T &d, L t)
 //{
@@ -0,0 +1,146 @@
+//
+//  Scenario.cpp
+//  EnsembleVisualization
+//
+
+// This module
+#include "Scenario.h"
+
+// Project
+#include "Log.h"
+
+// C++ std
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+using namespace std;
+
+
+namespace
+{
+    /// Whether the whole of s was read as a number
+    bool readInt(std::string const& s, int& value)
+    {
+        char* end;
+        long v = strtol(s.c_str(), &end, 10);
+        if (s.empty() || *end != '\0')
+            return false;
+        value = int(v);
+        return true;
+    }
+
+    /// Nor are inf, nan or anything too big for a float
+    bool readFloat(std::string const& s, float& value)
+    {
+        char* end;
+        double v = strtod(s.c_str(), &end);
+        if (s.empty() || *end != '\0' || !std::isfinite(float(v)))
+            return false;
+        value = float(v);
+        return true;
+    }
+
+    /// "start", or "start+periodxcount"
+    bool readTimes(std::string const& s, std::vector<float>& times)
+    {
+        times.clear();
+        // not the sign of a leading number or an exponent, as in 1e+2
+        size_t plus = s.find('+', 1);
+        while (plus != string::npos && (s[plus - 1] == 'e' || s[plus - 1] == 'E'))
+            plus = s.find('+', plus + 1);
+        float start;
+        if (plus == string::npos)
+        {
+            if (!readFloat(s, start))
+                return false;
+            times.push_back(start);
+            return true;
+        }
+        size_t x = s.find('x', plus);
+        float period;
+        int count;
+        if (x == string::npos
+            || !readFloat(s.substr(0, plus), start)
+            || !readFloat(s.substr(plus + 1, x - plus - 1), period)
+            || !readInt(s.substr(x + 1), count)
+            || count < 1)
+            return false;
+        for (int i=0; i<count; ++i)
+            times.push_back(start + i * period);
+        return true;
+    }
+}
+
+
+Scenario::Scenario()
+: mNext(0)
+{
+}
+
+bool Scenario::load(std::string const& path)
+{
+    mEvents.clear();
+    mNext = 0;
+    ifstream in(path.c_str());
+    if (!in.good())
+    {
+        VIZ_LOG("ERROR: could not open scenario " << path);
+        return false;
+    }
+
+    std::string line;
+    std::vector<float> times;
+    for (int lineNo=1; std::getline(in, line); ++lineNo)
+    {
+        std::istringstream ss(line);
+        std::string time, address;
+        if (!(ss >> time) || time[0] == '#')
+            continue;
+        if (!readTimes(time, times) || !(ss >> address) || address[0] != '/')
+        {
+            VIZ_LOG("ERROR: " << path << ':' << lineNo << ": expected a time and an address: " << line);
+            mEvents.clear();
+            return false;
+        }
+
+        Event event;
+        event.message.setAddress(address);
+        std::string argument;
+        while (ss >> argument)
+        {
+            int i;
+            float f;
+            if (readInt(argument, i))
+                event.message.addIntArg(i);
+            else if (readFloat(argument, f))
+                event.message.addFloatArg(f);
+            else
+                event.message.addStringArg(argument);
+        }
+        for (size_t i=0; i<times.size(); ++i)
+        {
+            event.time = times[i];
+            mEvents.push_back(event);
+        }
+    }
+
+    // Lines needn't be in order, but those at the same time keep theirs
+    std::stable_sort(mEvents.begin(), mEvents.end(), [](Event const& a, Event const& b)
+    {
+        return a.time < b.time;
+    });
+    return true;
+}
+
+void Scenario::takeDue(float seconds, std::vector<ci::osc::Message>& messages)
+{
+    for (; mNext < mEvents.size() && mEvents[mNext].time <= seconds; ++mNext)
+        messages.push_back(mEvents[mNext].message);
+}
+
+float Scenario::duration() const
+{
+    return mEvents.empty()? 0 : mEvents.back().time;
+}
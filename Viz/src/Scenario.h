@@ -0,0 +1,52 @@
+//
+//  Scenario.h
+//  EnsembleVisualization
+//
+//  Scripted OSC input, for offline renders and demos without a stabilizer
+//  or a recorded show. A scenario file has one message per line:
+//
+//      # seconds   address          arguments
+//      0           /viz/narrative   0.2
+//      0.5         /viz/note        3 0.8
+//      2+0.25x16   /viz/note        1 0.6
+//
+//  The time is in seconds from the start. "start+periodxcount" repeats the
+//  message count times, period seconds apart. Arguments are ints if they
+//  read as one, floats if they read as a finite number with a decimal
+//  point or exponent, and strings otherwise. Lines starting with # are
+//  comments.
+//
+
+#pragma once
+#include <string>
+#include <vector>
+#include "OscMessage.h"
+
+
+class Scenario
+{
+public:
+    Scenario();
+
+    /// Replaces any scenario loaded before. Returns false, having logged
+    /// where, if the file can't be read or a line can't be understood.
+    bool load(std::string const& path);
+    bool isLoaded() const { return !mEvents.empty(); }
+
+    /// Appends the messages due after the last call, up to the given number
+    /// of seconds from the start, in order
+    void takeDue(float seconds, std::vector<ci::osc::Message>& messages);
+    /// Whether every message has been taken
+    bool isFinished() const { return mNext >= mEvents.size(); }
+    /// Time of the last message
+    float duration() const;
+
+private:
+    struct Event
+    {
+        float time;
+        ci::osc::Message message;
+    };
+    std::vector<Event> mEvents;
+    size_t mNext;
+};
@@ -0,0 +1,242 @@
+//
+//  SimplexNoise.cpp
+//  EnsembleVisualization
+//
+
+// This module
+#include "SimplexNoise.h"
+
+// C++ std
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#if defined(__AVX512F__)
+#define VIZ_NOISE_WIDTH 16
+#include <immintrin.h>
+#elif defined(__AVX__)
+#define VIZ_NOISE_WIDTH 8
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VIZ_NOISE_WIDTH 4
+#include <emmintrin.h>
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+#else
+#define VIZ_NOISE_WIDTH 1
+#endif
+
+// The batch and one point versions only round the same if the compiler
+// does each float operation as written. Fast math lets it reorder them
+// and fuse multiplies and adds into one rounding wherever it sees fit,
+// differently in each version; GCC fuses them by default wherever the
+// target has FMA. So neither is allowed here, whatever the build's flags
+// (and the projects build this file without fast math too, though the
+// Xcode project's Release configuration has it on for everything else).
+#if defined(__clang__)
+#pragma float_control(precise, on)
+#pragma STDC FP_CONTRACT OFF
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC optimize("no-fast-math", "fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma float_control(precise, on)
+#pragma fp_contract(off)
+#endif
+
+
+namespace
+{
+    // The operations the noise needs, for a float and for each vector
+    // width, so that one template does them all in the same order
+
+    inline float vfloor(float x) { return floor(x); }
+    inline float vmin(float a, float b) { return min(a, b); }
+    inline float vmax(float a, float b) { return max(a, b); }
+    inline float vabs(float x) { return fabs(x); }
+    /// GLSL's step(): 0 if x < edge, otherwise 1
+    inline float vstep(float edge, float x) { return x < edge? 0.f : 1.f; }
+
+#if VIZ_NOISE_WIDTH == 4
+    struct Lanes
+    {
+        __m128 v;
+        Lanes(__m128 v_) : v(v_) {}
+        Lanes(float f) : v(_mm_set1_ps(f)) {}
+    };
+    inline Lanes operator+(Lanes a, Lanes b) { return _mm_add_ps(a.v, b.v); }
+    inline Lanes operator-(Lanes a, Lanes b) { return _mm_sub_ps(a.v, b.v); }
+    inline Lanes operator*(Lanes a, Lanes b) { return _mm_mul_ps(a.v, b.v); }
+    inline Lanes operator-(Lanes a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.f)); }
+    inline Lanes vfloor(Lanes x)
+    {
+#ifdef __SSE4_1__
+        return _mm_floor_ps(x.v);
+#else
+        // Truncated, then one less where that went up. Exact while |x| <
+        // 2^31, which the noise's lattice coordinates are.
+        const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x.v));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x.v), _mm_set1_ps(1.f)));
+#endif
+    }
+    inline Lanes vmin(Lanes a, Lanes b) { return _mm_min_ps(a.v, b.v); }
+    inline Lanes vmax(Lanes a, Lanes b) { return _mm_max_ps(a.v, b.v); }
+    inline Lanes vabs(Lanes x) { return _mm_andnot_ps(_mm_set1_ps(-0.f), x.v); }
+    inline Lanes vstep(Lanes edge, Lanes x) { return _mm_and_ps(_mm_cmpnlt_ps(x.v, edge.v), _mm_set1_ps(1.f)); }
+    inline Lanes load(float const* p) { return _mm_loadu_ps(p); }
+    inline void store(float* p, Lanes x) { _mm_storeu_ps(p, x.v); }
+#elif VIZ_NOISE_WIDTH == 8
+    struct Lanes
+    {
+        __m256 v;
+        Lanes(__m256 v_) : v(v_) {}
+        Lanes(float f) : v(_mm256_set1_ps(f)) {}
+    };
+    inline Lanes operator+(Lanes a, Lanes b) { return _mm256_add_ps(a.v, b.v); }
+    inline Lanes operator-(Lanes a, Lanes b) { return _mm256_sub_ps(a.v, b.v); }
+    inline Lanes operator*(Lanes a, Lanes b) { return _mm256_mul_ps(a.v, b.v); }
+    inline Lanes operator-(Lanes a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.f)); }
+    inline Lanes vfloor(Lanes x) { return _mm256_floor_ps(x.v); }
+    inline Lanes vmin(Lanes a, Lanes b) { return _mm256_min_ps(a.v, b.v); }
+    inline Lanes vmax(Lanes a, Lanes b) { return _mm256_max_ps(a.v, b.v); }
+    inline Lanes vabs(Lanes x) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), x.v); }
+    inline Lanes vstep(Lanes edge, Lanes x) { return _mm256_and_ps(_mm256_cmp_ps(x.v, edge.v, _CMP_NLT_UQ), _mm256_set1_ps(1.f)); }
+    inline Lanes load(float const* p) { return _mm256_loadu_ps(p); }
+    inline void store(float* p, Lanes x) { _mm256_storeu_ps(p, x.v); }
+#elif VIZ_NOISE_WIDTH == 16
+    struct Lanes
+    {
+        __m512 v;
+        Lanes(__m512 v_) : v(v_) {}
+        Lanes(float f) : v(_mm512_set1_ps(f)) {}
+    };
+    inline Lanes operator+(Lanes a, Lanes b) { return _mm512_add_ps(a.v, b.v); }
+    inline Lanes operator-(Lanes a, Lanes b) { return _mm512_sub_ps(a.v, b.v); }
+    inline Lanes operator*(Lanes a, Lanes b) { return _mm512_mul_ps(a.v, b.v); }
+    inline Lanes operator-(Lanes a) { return _mm512_sub_ps(_mm512_setzero_ps(), a.v); }
+    // Masked forms with every lane set where GCC's headers (before 13)
+    // build the unmasked ones on an undefined vector, which -Wuninitialized
+    // takes for a read of an uninitialized one
+    inline Lanes vfloor(Lanes x) { return _mm512_mask_roundscale_ps(x.v, 0xFFFF, x.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    inline Lanes vmin(Lanes a, Lanes b) { return _mm512_mask_min_ps(a.v, 0xFFFF, a.v, b.v); }
+    inline Lanes vmax(Lanes a, Lanes b) { return _mm512_mask_max_ps(a.v, 0xFFFF, a.v, b.v); }
+    inline Lanes vabs(Lanes x) { return _mm512_abs_ps(x.v); }
+    inline Lanes vstep(Lanes edge, Lanes x) { return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x.v, edge.v, _CMP_NLT_UQ), _mm512_set1_ps(1.f)); }
+    inline Lanes load(float const* p) { return _mm512_loadu_ps(p); }
+    inline void store(float* p, Lanes x) { _mm512_storeu_ps(p, x.v); }
+#endif
+
+    template <typename V>
+    inline V mod289(V x)
+    {
+        return x - vfloor(x * V(1.f / 289.f)) * V(289.f);
+    }
+
+    template <typename V>
+    inline V permute(V x)
+    {
+        return mod289((x * V(34.f) + V(1.f)) * x);
+    }
+
+    template <typename V>
+    inline V taylorInvSqrt(V r)
+    {
+        return V(1.79284291400159f) - V(0.85373472095314f) * r;
+    }
+
+    /// One of the simplex's four corners: i + offset on the lattice, x
+    /// from it to the point
+    template <typename V>
+    inline V corner(V ix, V iy, V iz, V offsetX, V offsetY, V offsetZ, V xx, V xy, V xz)
+    {
+        // Gradients: 7x7 points over a square, mapped onto an octahedron.
+        // The ring size 17*17 = 289 is close to a multiple of 49 (49*6 = 294)
+        const V n_(0.142857142857f); // 1.0/7.0
+        const V nsx = n_ * V(2.f), nsy = n_ * V(0.5f) - V(1.f), nsz = n_;
+        const V p = permute(permute(permute(iz + offsetZ) + iy + offsetY) + ix + offsetX);
+        const V j = p - V(49.f) * vfloor(p * nsz * nsz); // mod(p,7*7)
+        const V x_ = vfloor(j * nsz);
+        const V y_ = vfloor(j - V(7.f) * x_); // mod(j,N)
+        const V gradX = x_ * nsx + nsy;
+        const V gradY = y_ * nsx + nsy;
+        const V h = V(1.f) - vabs(gradX) - vabs(gradY);
+        const V sh = -vstep(h, V(0.f));
+        const V ax = gradX + (vfloor(gradX) * V(2.f) + V(1.f)) * sh;
+        const V ay = gradY + (vfloor(gradY) * V(2.f) + V(1.f)) * sh;
+        const V az = h;
+
+        // Normalise gradients
+        const V norm = taylorInvSqrt(ax * ax + ay * ay + az * az);
+
+        // Mix final noise value
+        V m = vmax(V(0.6f) - (xx * xx + xy * xy + xz * xz), V(0.f));
+        m = m * m;
+        return m * m * (ax * norm * xx + ay * norm * xy + az * norm * xz);
+    }
+
+    template <typename V>
+    V noise(V vx, V vy, V vz)
+    {
+        const V Cx(1.f / 6.f), Cy(1.f / 3.f);
+
+        // First corner
+        // dot(v, C.yyy) and dot(i, C.xxx), rounded as GLSL's dot()
+        const V s = vx * Cy + vy * Cy + vz * Cy;
+        V ix = vfloor(vx + s), iy = vfloor(vy + s), iz = vfloor(vz + s);
+        const V t = ix * Cx + iy * Cx + iz * Cx;
+        const V x0x = vx - ix + t, x0y = vy - iy + t, x0z = vz - iz + t;
+
+        // Other corners
+        const V gx = vstep(x0y, x0x), gy = vstep(x0z, x0y), gz = vstep(x0x, x0z);
+        const V lx = V(1.f) - gx, ly = V(1.f) - gy, lz = V(1.f) - gz;
+        const V i1x = vmin(gx, lz), i1y = vmin(gy, lx), i1z = vmin(gz, ly);
+        const V i2x = vmax(gx, lz), i2y = vmax(gy, lx), i2z = vmax(gz, ly);
+
+        // Permutations
+        ix = mod289(ix);
+        iy = mod289(iy);
+        iz = mod289(iz);
+
+        // x1 = x0 - i1 + C.x, x2 = x0 - i2 + C.y, x3 = x0 - 0.5
+        const V zero(0.f), one(1.f), half(0.5f);
+        V result = corner(ix, iy, iz, zero, zero, zero, x0x, x0y, x0z);
+        result = result + corner(ix, iy, iz, i1x, i1y, i1z, x0x - i1x + Cx, x0y - i1y + Cx, x0z - i1z + Cx);
+        result = result + corner(ix, iy, iz, i2x, i2y, i2z, x0x - i2x + Cy, x0y - i2y + Cy, x0z - i2z + Cy);
+        result = result + corner(ix, iy, iz, one, one, one, x0x - half, x0y - half, x0z - half);
+        return V(42.f) * result;
+    }
+}
+
+
+float snoise(float x, float y, float z)
+{
+    return noise<float>(x, y, z);
+}
+
+void snoise(float const* x, float const* y, float const* z, float* out, int n)
+{
+    int i = 0;
+#if VIZ_NOISE_WIDTH > 1
+    for (; i + VIZ_NOISE_WIDTH <= n; i += VIZ_NOISE_WIDTH)
+        store(out + i, noise<Lanes>(load(x + i), load(y + i), load(z + i)));
+#endif
+    for (; i < n; ++i)
+        out[i] = noise<float>(x[i], y[i], z[i]);
+}
+
+void snoise(float const* x, float const* y, float z, float* out, int n)
+{
+    int i = 0;
+#if VIZ_NOISE_WIDTH > 1
+    for (; i + VIZ_NOISE_WIDTH <= n; i += VIZ_NOISE_WIDTH)
+        store(out + i, noise<Lanes>(load(x + i), load(y + i), Lanes(z)));
+#endif
+    for (; i < n; ++i)
+        out[i] = noise<float>(x[i], y[i], z);
+}
+
+int snoiseWidth()
+{
+    return VIZ_NOISE_WIDTH;
+}
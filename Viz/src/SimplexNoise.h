@@ -0,0 +1,32 @@
+//
+//  SimplexNoise.h
+//  EnsembleVisualization
+//
+//  3D simplex noise on the CPU, the same function as snoise() in
+//  particles.vert (Ian McEwan and Ashima Arts' textureless GLSL version,
+//  MIT licensed, https://github.com/ashima/webgl-noise), step for step in
+//  single precision so that particles placed on the CPU land where the
+//  shader puts them.
+//
+//  The batch version takes as many points at a time as the widest vectors
+//  the build allows: 16 with AVX-512, 8 with AVX, 4 with SSE2, otherwise
+//  one. Every width runs the same code on the same float operations, so
+//  the results are the same whichever is used. SimplexNoise.cpp stops the
+//  compiler reordering float operations or fusing multiplies and adds
+//  (fast math, FP contraction), which would break that, so it holds
+//  whatever the build's floating point flags.
+//
+
+#pragma once
+
+
+/// Between about -1 and 1
+float snoise(float x, float y, float z);
+
+/// out[i] = snoise(x[i], y[i], z[i]) for i < n
+void snoise(float const* x, float const* y, float const* z, float* out, int n);
+/// out[i] = snoise(x[i], y[i], z) for i < n, a slice through the noise
+void snoise(float const* x, float const* y, float z, float* out, int n);
+
+/// Points the batch versions take at a time in this build: 1, 4, 8 or 16
+int snoiseWidth();
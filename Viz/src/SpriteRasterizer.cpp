@@ -0,0 +1,315 @@
+//
+//  SpriteRasterizer.cpp
+//  EnsembleVisualization
+//
+
+// This module
+#include "SpriteRasterizer.h"
+
+// Project
+#include "Trace.h"
+
+// Cinder
+using namespace ci;
+
+// C++ std
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+using namespace std;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VIZ_SPRITE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+namespace
+{
+    /// Pixels each way of a tile. 64x64 RGBA floats is 64KB, about what a
+    /// core has of L2 to itself.
+    const int TILE_SIZE = 64;
+
+    /// Bilinear between four texels, times multiply, added to pixel
+    inline void addSample(float* pixel, float const* t00, float const* t10, float const* t01, float const* t11,
+                          float fx, float fy, float const multiply[4])
+    {
+#if VIZ_SPRITE_SSE2
+        const __m128 a = _mm_loadu_ps(t00);
+        const __m128 b = _mm_loadu_ps(t10);
+        const __m128 c = _mm_loadu_ps(t01);
+        const __m128 d = _mm_loadu_ps(t11);
+        const __m128 x = _mm_set1_ps(fx);
+        const __m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), x));
+        const __m128 bottom = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), x));
+        const __m128 sample = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), _mm_set1_ps(fy)));
+        _mm_storeu_ps(pixel, _mm_add_ps(_mm_loadu_ps(pixel), _mm_mul_ps(sample, _mm_loadu_ps(multiply))));
+#else
+        for (int k=0; k<4; ++k)
+        {
+            const float top = t00[k] + (t10[k] - t00[k]) * fx;
+            const float bottom = t01[k] + (t11[k] - t01[k]) * fx;
+            pixel[k] += (top + (bottom - top) * fy) * multiply[k];
+        }
+#endif
+    }
+
+    /// pixel = pixel (1 - a) + (0, 0, 0, a) a, for fade = (1 - a, a a)
+    inline void fadePixel(float* pixel, float keep, float alpha)
+    {
+#if VIZ_SPRITE_SSE2
+        _mm_storeu_ps(pixel, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pixel), _mm_set1_ps(keep)), _mm_set_ps(alpha, 0, 0, 0)));
+#else
+        pixel[0] *= keep;
+        pixel[1] *= keep;
+        pixel[2] *= keep;
+        pixel[3] = pixel[3] * keep + alpha;
+#endif
+    }
+
+    /// Clamps pixel to 0 to 1 and writes it in 8 bits too
+    inline void resolvePixel(float* pixel, unsigned char* rgba8)
+    {
+#if VIZ_SPRITE_SSE2
+        const __m128 p = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pixel), _mm_setzero_ps()), _mm_set1_ps(1));
+        _mm_storeu_ps(pixel, p);
+        const __m128i i = _mm_cvtps_epi32(_mm_mul_ps(p, _mm_set1_ps(255)));
+        const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(i, i), _mm_setzero_si128());
+        const int packed = _mm_cvtsi128_si32(bytes);
+        memcpy(rgba8, &packed, 4);
+#else
+        for (int k=0; k<4; ++k)
+        {
+            pixel[k] = min(1.f, max(0.f, pixel[k]));
+            rgba8[k] = (unsigned char)(pixel[k] * 255 + 0.5f);
+        }
+#endif
+    }
+}
+
+
+SpriteRasterizer::SpriteRasterizer()
+: mSize(0, 0)
+, mNumTiles(0, 0)
+, mFadeAlpha(0)
+, mFrame(0)
+, mNumWorkersFinished(0)
+, mStopping(false)
+, mNextTile(0)
+{
+}
+
+SpriteRasterizer::~SpriteRasterizer()
+{
+    {
+        lock_guard<mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mFrameStarted.notify_all();
+    for (size_t i=0; i<mWorkers.size(); ++i)
+        mWorkers[i].join();
+}
+
+void SpriteRasterizer::setup(ci::Vec2i size, ci::Surface8u const& sprite, int numThreads)
+{
+    mSize = size;
+    mPixels.assign(size.x * size.y * 4, 0.f);
+    mRgba8.assign(size.x * size.y * 4, 0);
+    mNumTiles = Vec2i((size.x + TILE_SIZE - 1) / TILE_SIZE, (size.y + TILE_SIZE - 1) / TILE_SIZE);
+    mBins.resize(mNumTiles.x * mNumTiles.y);
+
+    // Level 0 is the sprite as it is, premultiplied; each after it a 2x2
+    // box filter of the one before, down to a single texel
+    mLevels.clear();
+    Level level;
+    level.width = sprite.getWidth();
+    level.height = sprite.getHeight();
+    level.texels.resize(level.width * level.height * 4);
+    for (int y=0; y<level.height; ++y)
+        for (int x=0; x<level.width; ++x)
+        {
+            ColorA8u c = sprite.getPixel(Vec2i(x, y));
+            const float a = c.a / 255.f;
+            float* texel = &level.texels[(y * level.width + x) * 4];
+            texel[0] = c.r / 255.f * a;
+            texel[1] = c.g / 255.f * a;
+            texel[2] = c.b / 255.f * a;
+            texel[3] = a * a;
+        }
+    mLevels.push_back(level);
+    while (level.width > 1 || level.height > 1)
+    {
+        Level const& previous = mLevels.back();
+        Level next;
+        next.width = max(1, previous.width / 2);
+        next.height = max(1, previous.height / 2);
+        next.texels.resize(next.width * next.height * 4);
+        for (int y=0; y<next.height; ++y)
+            for (int x=0; x<next.width; ++x)
+            {
+                const int x0 = min(previous.width - 1, x * 2), x1 = min(previous.width - 1, x * 2 + 1);
+                const int y0 = min(previous.height - 1, y * 2), y1 = min(previous.height - 1, y * 2 + 1);
+                for (int k=0; k<4; ++k)
+                    next.texels[(y * next.width + x) * 4 + k] = 0.25f * (
+                        previous.texels[(y0 * previous.width + x0) * 4 + k] + previous.texels[(y0 * previous.width + x1) * 4 + k]
+                        + previous.texels[(y1 * previous.width + x0) * 4 + k] + previous.texels[(y1 * previous.width + x1) * 4 + k]);
+            }
+        mLevels.push_back(next);
+        level = next;
+    }
+
+    if (numThreads <= 0)
+        numThreads = max(1, int(thread::hardware_concurrency()));
+    // the caller draws tiles too
+    while (int(mWorkers.size()) < numThreads - 1)
+        mWorkers.push_back(thread(&SpriteRasterizer::runWorker, this, mFrame));
+}
+
+void SpriteRasterizer::render(float fadeAlpha, std::vector<Sprite> const& sprites)
+{
+    TRACE_SCOPE("rasterize sprites");
+    if (!isSetup())
+        return;
+    mFadeAlpha = fadeAlpha;
+
+    // Where each sprite lands, and which tiles it touches
+    mPrepared.clear();
+    for (size_t i=0; i<mBins.size(); ++i)
+        mBins[i].clear();
+    for (size_t i=0; i<sprites.size(); ++i)
+    {
+        Sprite const& s = sprites[i];
+        if (!(s.alpha > 0) || !(s.size > 0)
+            || !(fabs(s.position.x) <= 1) || !(fabs(s.position.y) <= 1))
+            continue;
+        const float cx = (s.position.x + 1) * 0.5f * mSize.x;
+        const float cy = (s.position.y + 1) * 0.5f * mSize.y;
+        // GL draws points at least a pixel wide
+        const float size = max(1.f, s.size);
+        const float half = size * 0.5f;
+        // Pixels whose centres are in the square, as GL rasterizes points
+        Prepared p;
+        p.x0 = max(0, int(ceil(cx - half - 0.5f)));
+        p.x1 = min(mSize.x, int(ceil(cx + half - 0.5f)));
+        p.y0 = max(0, int(ceil(cy - half - 0.5f)));
+        p.y1 = min(mSize.y, int(ceil(cy + half - 0.5f)));
+        if (p.x0 >= p.x1 || p.y0 >= p.y1)
+            continue;
+        p.left = cx - half;
+        p.top = cy + half;
+        p.inverseSize = 1 / size;
+        // The smallest level still at least as big as the sprite
+        p.level = 0;
+        while (p.level + 1 < int(mLevels.size()) && mLevels[p.level + 1].width >= size)
+            ++p.level;
+        p.multiply[0] = p.multiply[1] = p.multiply[2] = s.alpha;
+        p.multiply[3] = s.alpha * s.alpha;
+        const int index = int(mPrepared.size());
+        mPrepared.push_back(p);
+        for (int ty=p.y0 / TILE_SIZE; ty<=(p.y1 - 1) / TILE_SIZE; ++ty)
+            for (int tx=p.x0 / TILE_SIZE; tx<=(p.x1 - 1) / TILE_SIZE; ++tx)
+                mBins[ty * mNumTiles.x + tx].push_back(index);
+    }
+
+    // Every thread takes tiles until there are none left
+    {
+        lock_guard<mutex> lock(mMutex);
+        mNextTile = 0;
+        mNumWorkersFinished = 0;
+        ++mFrame;
+    }
+    mFrameStarted.notify_all();
+    renderTiles();
+    unique_lock<mutex> lock(mMutex);
+    while (mNumWorkersFinished < int(mWorkers.size()))
+        mWorkerFinished.wait(lock);
+}
+
+void SpriteRasterizer::renderTiles()
+{
+    const int numTiles = mNumTiles.x * mNumTiles.y;
+    for (int tile = mNextTile++; tile < numTiles; tile = mNextTile++)
+        renderTile(tile);
+}
+
+void SpriteRasterizer::renderTile(int tile)
+{
+    const int tx0 = (tile % mNumTiles.x) * TILE_SIZE;
+    const int ty0 = (tile / mNumTiles.x) * TILE_SIZE;
+    const int tx1 = min(mSize.x, tx0 + TILE_SIZE);
+    const int ty1 = min(mSize.y, ty0 + TILE_SIZE);
+
+    const float keep = 1 - mFadeAlpha;
+    const float fadeAlpha = mFadeAlpha * mFadeAlpha;
+    for (int y=ty0; y<ty1; ++y)
+        for (int x=tx0; x<tx1; ++x)
+            fadePixel(&mPixels[(y * mSize.x + x) * 4], keep, fadeAlpha);
+
+    std::vector<int> const& bin = mBins[tile];
+    for (size_t i=0; i<bin.size(); ++i)
+        drawSprite(mPrepared[bin[i]], tx0, tx1, ty0, ty1);
+
+    // Everything added is positive, so clamping once now is the same as
+    // GL clamping after every sprite
+    for (int y=ty0; y<ty1; ++y)
+        for (int x=tx0; x<tx1; ++x)
+        {
+            const int i = (y * mSize.x + x) * 4;
+            resolvePixel(&mPixels[i], &mRgba8[i]);
+        }
+}
+
+void SpriteRasterizer::drawSprite(Prepared const& sprite, int tx0, int tx1, int ty0, int ty1)
+{
+    Level const& level = mLevels[sprite.level];
+    const int x0 = max(sprite.x0, tx0), x1 = min(sprite.x1, tx1);
+    const int y0 = max(sprite.y0, ty0), y1 = min(sprite.y1, ty1);
+
+    // The same columns of texels for every row, and never more than a tile
+    int offset0[TILE_SIZE], offset1[TILE_SIZE];
+    float fxs[TILE_SIZE];
+    for (int x=x0; x<x1; ++x)
+    {
+        const float u = ((x + 0.5f) - sprite.left) * sprite.inverseSize * level.width - 0.5f;
+        const int iu = int(floor(u));
+        fxs[x - x0] = u - iu;
+        offset0[x - x0] = max(0, min(level.width - 1, iu)) * 4;
+        offset1[x - x0] = max(0, min(level.width - 1, iu + 1)) * 4;
+    }
+
+    for (int y=y0; y<y1; ++y)
+    {
+        // gl_PointCoord's t goes down from the top of the sprite, and the
+        // texture's first row is the top of the image
+        const float v = (sprite.top - (y + 0.5f)) * sprite.inverseSize * level.height - 0.5f;
+        const int iv = int(floor(v));
+        const float fy = v - iv;
+        float const* row0 = &level.texels[max(0, min(level.height - 1, iv)) * level.width * 4];
+        float const* row1 = &level.texels[max(0, min(level.height - 1, iv + 1)) * level.width * 4];
+        float* pixel = &mPixels[(y * mSize.x + x0) * 4];
+        for (int i=0; i<x1-x0; ++i, pixel+=4)
+            addSample(pixel, row0 + offset0[i], row0 + offset1[i], row1 + offset0[i], row1 + offset1[i],
+                      fxs[i], fy, sprite.multiply);
+    }
+}
+
+void SpriteRasterizer::runWorker(unsigned long framesDone)
+{
+    Trace::setThreadName("sprite rasterizer");
+    unique_lock<mutex> lock(mMutex);
+    for (;;)
+    {
+        while (mFrame == framesDone && !mStopping)
+            mFrameStarted.wait(lock);
+        if (mStopping)
+            return;
+        framesDone = mFrame;
+        lock.unlock();
+
+        renderTiles();
+
+        lock.lock();
+        ++mNumWorkersFinished;
+        mWorkerFinished.notify_one();
+    }
+}
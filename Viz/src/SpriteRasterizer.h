@@ -0,0 +1,120 @@
+//
+//  SpriteRasterizer.h
+//  EnsembleVisualization
+//
+//  Draws the particles on the CPU, for rendering without a GPU: textured
+//  point sprites added together as Renderer draws them with GL (blend
+//  GL_SRC_ALPHA, GL_ONE), over the last frame faded as VizApp fades it.
+//  Nothing in here needs a GL context.
+//
+//  The framebuffer is cut into square tiles and each sprite is binned into
+//  the tiles it touches; the tiles are then drawn in parallel by a pool of
+//  threads, each tile by one thread, so no two threads ever write the same
+//  pixel. A tile is faded, has its sprites added, and is converted to 8 bits
+//  in one pass while it is in cache. Pixels are four floats, blended four
+//  channels at a time with SSE2 where there is SSE2.
+//
+//  The sprite texture is filtered down into mip levels beforehand, and each
+//  sprite is sampled bilinearly from the level nearest its size, so small
+//  sprites don't alias. Like the GL framebuffer, colours are clamped to 1
+//  at the end of a frame; the fade is in float, so trails don't band.
+//
+//      mRasterizer.setup(size, Surface(loadImage(...blob.png)), 0);
+//      ...
+//      mRasterizer.render(0.7f, sprites);   // once a frame
+//      upload mRasterizer.rgba8(), or read mRasterizer.pixels()
+//
+
+#pragma once
+#include <cinder/Surface.h>
+#include <cinder/Vector.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class SpriteRasterizer
+{
+public:
+    /// As particles.vert leaves a particle
+    struct Sprite
+    {
+        /// Normalized framebuffer coordinates, -1 to 1 with y up
+        ci::Vec2f position;
+        /// Width and height in pixels, as gl_PointSize
+        float size;
+        /// Multiplies the texture's alpha, as particles.frag does
+        float alpha;
+    };
+
+    SpriteRasterizer();
+    /// Stops the threads
+    ~SpriteRasterizer();
+
+    /// Makes a black framebuffer of size pixels and the sprite's mip levels,
+    /// and starts the threads (0 for one per core, counting the caller's)
+    void setup(ci::Vec2i size, ci::Surface8u const& sprite, int numThreads);
+    bool isSetup() const { return !mPixels.empty(); }
+
+    /// Fades the framebuffer towards black as a black quad of fadeAlpha
+    /// alpha blended over it would, then adds the sprites. Sprites whose
+    /// centre is outside the framebuffer are left out, as GL clips points.
+    void render(float fadeAlpha, std::vector<Sprite> const& sprites);
+
+    ci::Vec2i size() const { return mSize; }
+    /// RGBA floats from 0 to 1, row by row from the bottom as in GL
+    std::vector<float> const& pixels() const { return mPixels; }
+    /// The same in 8 bits
+    std::vector<unsigned char> const& rgba8() const { return mRgba8; }
+
+private:
+    /// A sprite ready to draw: where it covers, and how to sample it
+    struct Prepared
+    {
+        /// Pixels covered, x0 <= x < x1 and y0 <= y < y1
+        int x0, x1, y0, y1;
+        /// The sprite's left and top edges in pixels, and 1 / its size
+        float left, top, inverseSize;
+        int level;
+        /// The texel multiplies: alpha for colour, alpha squared for alpha
+        float multiply[4];
+    };
+    /// Premultiplied by alpha (colour times alpha, and alpha squared, as
+    /// blending GL_SRC_ALPHA adds them), row by row from the top
+    struct Level
+    {
+        int width, height;
+        std::vector<float> texels;
+    };
+
+    void renderTiles();
+    void renderTile(int tile);
+    void drawSprite(Prepared const& sprite, int tx0, int tx1, int ty0, int ty1);
+    /// Draws tiles of every frame after framesDone
+    void runWorker(unsigned long framesDone);
+
+    ci::Vec2i mSize;
+    std::vector<float> mPixels;
+    std::vector<unsigned char> mRgba8;
+    std::vector<Level> mLevels;
+    ci::Vec2i mNumTiles;
+    /// Indices into mPrepared of the sprites touching each tile, kept from
+    /// frame to frame so the vectors aren't allocated again
+    std::vector<std::vector<int> > mBins;
+    std::vector<Prepared> mPrepared;
+    float mFadeAlpha;
+
+    std::vector<std::thread> mWorkers;
+    /// Guards what's below, along with the frame's inputs above
+    std::mutex mMutex;
+    std::condition_variable mFrameStarted;
+    std::condition_variable mWorkerFinished;
+    /// Counts frames, so the workers see each one start
+    unsigned long mFrame;
+    int mNumWorkersFinished;
+    bool mStopping;
+    /// Next tile to be drawn, taken by whichever thread is free
+    std::atomic<int> mNextTile;
+};
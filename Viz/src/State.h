@@ -22,10 +22,14 @@ struct Note
 	float time;
 	/// Value between 0 and 1
 	float intensity;
+	/// When the note's OSC message arrived on the socket, in nanoseconds
+	/// since the unix epoch. 0 for notes that didn't come over the network.
+	unsigned long long receiveTimestamp;
 	
-	Note(float time_=0, float intensity_=0)
+	Note(float time_=0, float intensity_=0, unsigned long long receiveTimestamp_=0)
 	: time(time_)
 	, intensity(intensity_)
+	, receiveTimestamp(receiveTimestamp_)
 	{}
 };
 std::ostream& operator<<(std::ostream& out, Note const& note);
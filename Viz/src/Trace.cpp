@@ -0,0 +1,203 @@
+//
+//  Trace.cpp
+//  EnsembleVisualization
+//
+
+// This module
+#include "Trace.h"
+
+// C++ std
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+
+namespace
+{
+    /// Spans kept per thread. The render thread records a couple of dozen
+    /// a frame, so this covers well over ten seconds of it.
+    const size_t RING_SIZE = 32768;
+
+    struct Event
+    {
+        const char* name;
+        /// nanoseconds since epoch()
+        long long begin;
+        long long duration;
+    };
+
+    /// Written only by its own thread. A dump reads it from another thread
+    /// and throws away whatever the owner may have overwritten meanwhile.
+    struct ThreadBuffer
+    {
+        ThreadBuffer(int id_)
+        : events(RING_SIZE)
+        , numWritten(0)
+        , name(NULL)
+        , id(id_)
+        {}
+        vector<Event> events;
+        atomic<unsigned long long> numWritten;
+        atomic<const char*> name;
+        int id;
+    };
+
+    Trace::Clock::time_point epoch()
+    {
+        static const Trace::Clock::time_point e = Trace::Clock::now();
+        return e;
+    }
+
+    long long nanosecondsSinceEpoch(Trace::Clock::time_point t)
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(t - epoch()).count();
+    }
+
+    /// Every thread that has recorded anything. Buffers outlive their
+    /// threads, so a dump still shows what a finished thread did, and are
+    /// never freed, as the log writer can still be recording during exit.
+    class Registry
+    {
+    public:
+        static Registry& instance()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        ThreadBuffer* add()
+        {
+            lock_guard<mutex> lock(mMutex);
+            mBuffers.push_back(new ThreadBuffer(int(mBuffers.size()) + 1));
+            return mBuffers.back();
+        }
+
+        vector<ThreadBuffer*> buffers()
+        {
+            lock_guard<mutex> lock(mMutex);
+            return mBuffers;
+        }
+
+    private:
+        mutex mMutex;
+        vector<ThreadBuffer*> mBuffers;
+    };
+
+    thread_local ThreadBuffer* tBuffer = NULL;
+
+    ThreadBuffer& threadBuffer()
+    {
+        if (!tBuffer)
+        {
+            epoch();
+            tBuffer = Registry::instance().add();
+        }
+        return *tBuffer;
+    }
+
+    volatile sig_atomic_t gDumpRequested = 0;
+
+#if !defined(_WIN32)
+    void onDumpSignal(int)
+    {
+        gDumpRequested = 1;
+    }
+#endif
+
+    void writeJsonString(ostream& out, const char* s)
+    {
+        out << '"';
+        for (; *s; ++s)
+        {
+            if (*s == '"' || *s == '\\')
+                out << '\\';
+            out << *s;
+        }
+        out << '"';
+    }
+}
+
+
+void Trace::setThreadName(const char* name)
+{
+    ThreadBuffer& buffer = threadBuffer();
+    if (buffer.name.load(memory_order_relaxed) != name)
+        buffer.name.store(name, memory_order_relaxed);
+}
+
+void Trace::record(const char* name, Clock::time_point begin, Clock::time_point end)
+{
+    ThreadBuffer& buffer = threadBuffer();
+    const unsigned long long n = buffer.numWritten.load(memory_order_relaxed);
+    Event& e = buffer.events[n % RING_SIZE];
+    e.name = name;
+    e.begin = nanosecondsSinceEpoch(begin);
+    e.duration = chrono::duration_cast<chrono::nanoseconds>(end - begin).count();
+    buffer.numWritten.store(n + 1, memory_order_release);
+}
+
+bool Trace::dump(std::string const& path, double seconds)
+{
+    const long long cutoff = nanosecondsSinceEpoch(Clock::now()) - (long long)(seconds * 1e9);
+
+    ofstream out(path.c_str());
+    if (!out.good())
+        return false;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+
+    vector<ThreadBuffer*> buffers = Registry::instance().buffers();
+    vector<Event> events(RING_SIZE);
+    for (size_t i=0; i<buffers.size(); ++i)
+    {
+        ThreadBuffer& buffer = *buffers[i];
+
+        // Copy, then keep only the events the owner can't have been
+        // overwriting while we copied
+        const unsigned long long before = buffer.numWritten.load(memory_order_acquire);
+        std::copy(buffer.events.begin(), buffer.events.end(), events.begin());
+        const unsigned long long after = buffer.numWritten.load(memory_order_acquire);
+        const unsigned long long oldest = after + 1 > RING_SIZE? after + 1 - RING_SIZE : 0;
+
+        const char* name = buffer.name.load(memory_order_relaxed);
+        out << (first? "" : ",\n") << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": " << buffer.id
+            << ", \"args\": {\"name\": ";
+        writeJsonString(out, name? name : "unnamed");
+        out << "}}";
+        first = false;
+
+        for (unsigned long long n=oldest; n<before; ++n)
+        {
+            Event const& e = events[n % RING_SIZE];
+            if (e.begin + e.duration < cutoff)
+                continue;
+            out << ",\n{\"ph\": \"X\", \"name\": ";
+            writeJsonString(out, e.name);
+            out << ", \"pid\": 1, \"tid\": " << buffer.id
+                << ", \"ts\": " << e.begin / 1000. << ", \"dur\": " << e.duration / 1000. << "}";
+        }
+    }
+    out << "\n]}\n";
+    return out.good();
+}
+
+void Trace::installDumpSignal()
+{
+#if !defined(_WIN32)
+    signal(SIGUSR1, onDumpSignal);
+#endif
+}
+
+bool Trace::takeDumpRequest()
+{
+    if (!gDumpRequested)
+        return false;
+    gDumpRequested = 0;
+    return true;
+}
@@ -0,0 +1,66 @@
+//
+//  Trace.h
+//  EnsembleVisualization
+//
+//  Timeline of what every thread was doing, for finding the cause of an
+//  occasional hitch (a JSON save or shader reload landing on an OSC burst,
+//  say) that averaged timings hide.
+//
+//  Each thread records spans into its own fixed size ring, so recording
+//  takes no lock and old spans are simply overwritten. dump() writes the
+//  last few seconds of every thread as Chrome trace event JSON, which can
+//  be opened in chrome://tracing or https://ui.perfetto.dev.
+//
+//      void Renderer::loadShader()
+//      {
+//          TRACE_SCOPE("loadShader");
+//          ...
+//
+
+#pragma once
+#include <chrono>
+#include <string>
+
+
+class Trace
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /// Name the calling thread in dumps. Cheap if the name hasn't changed,
+    /// so it can be called on every event from threads we don't start.
+    /// The name must be a literal (or otherwise live forever).
+    static void setThreadName(const char* name);
+
+    /// Record a span on the calling thread. name must be a literal.
+    static void record(const char* name, Clock::time_point begin, Clock::time_point end);
+
+    /// Write the spans of every thread that ended in the last given number
+    /// of seconds. Returns false if the file can't be written.
+    static bool dump(std::string const& path, double seconds);
+
+    /// Have SIGUSR1 request a dump (POSIX only), for when the window can't
+    /// be reached. The request is picked up by takeDumpRequest().
+    static void installDumpSignal();
+    static bool takeDumpRequest();
+};
+
+
+/// Records a span from construction to destruction
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name)
+    : mName(name)
+    , mBegin(Trace::Clock::now())
+    {}
+    ~TraceScope() { Trace::record(mName, mBegin, Trace::Clock::now()); }
+
+private:
+    const char* mName;
+    Trace::Clock::time_point mBegin;
+};
+
+#define TRACE_CONCATENATE_(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCATENATE(traceScope_, __LINE__)(name)
@@ -0,0 +1,63 @@
+//
+//  TripleBuffer.h
+//  EnsembleVisualization
+//
+
+#pragma once
+#include <atomic>
+
+/// Hands complete values from one writer thread to one reader thread
+/// without either ever waiting for the other.
+///
+/// The writer fills back() and calls publish(); the reader calls consume()
+/// and reads front(). Three slots means the writer always has one to
+/// itself, the reader always has one to itself, and the third holds the
+/// latest published value. Both operations are a single atomic exchange
+/// of an index, so the reader only ever swaps a pointer. Values published
+/// faster than they are consumed are skipped, only the newest is seen.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer()
+    : mBack(0)
+    , mMiddle(1)
+    , mFront(2)
+    {
+    }
+
+    /// Writer side. The slot to fill before calling publish(). Its contents
+    /// are whatever was there before, not the last value published.
+    T& back() { return mBuffers[mBack]; }
+
+    /// Writer side. Makes back() the latest value and hands the writer a
+    /// free slot in its place.
+    void publish()
+    {
+        mBack = mMiddle.exchange(mBack | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    /// Reader side. Moves the latest published value to front() and returns
+    /// true, or returns false if nothing was published since last time.
+    bool consume()
+    {
+        if (!(mMiddle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    /// Reader side. The value last consumed.
+    T const& front() const { return mBuffers[mFront]; }
+    T& front() { return mBuffers[mFront]; }
+
+private:
+    enum { INDEX = 3, FRESH = 4 };
+
+    T mBuffers[3];
+    int mBack;
+    /// Index of the slot in the middle, with FRESH set if the reader hasn't
+    /// taken it yet
+    std::atomic<int> mMiddle;
+    int mFront;
+};
@@ -5,13 +5,22 @@
 #include "State.h"
 #include "OscReceiver.h"
 #include "ControlPointEditor.h"
+#include "Log.h"
+#include "FrameStats.h"
+#include "Trace.h"
+#include "AllocationTracker.h"
+#include "FrameCapture.h"
+#include "FrameExport.h"
+#include "HeadCompositor.h"
+#include "SpriteRasterizer.h"
 
 // Cinder
 #include <cinder/app/AppNative.h>
 #include <cinder/gl/gl.h>
 #include <cinder/gl/Fbo.h>
-#include <cinder/Utilities.h>
+#include <cinder/gl/TextureFont.h>
 #include <cinder/ImageIo.h>
+#include <cinder/Utilities.h>
 using namespace ci;
 
 // Boost
@@ -20,15 +29,12 @@ using namespace ci;
 
 // C std
 #include <ctime>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
 using namespace std;
 
 
-const bool RECORD_FRAMES = false;
-const std::string RECORD_FRAMES_PATH = "/Users/tim/viz_recording";
-std::string RECORD_FRAMES_PREFIX;
-int gFrameNumber = 0;
-
-
 class VizApp : public ci::app::AppNative
 {
 public:
@@ -44,11 +50,19 @@ public:
     void keyUp(ci::app::KeyEvent event);
     void update();
     void draw();
+    void shutdown();
 
 
 private:
     void saveScreenshot();
     void toggleFullScreen();
+    void toggleOscRecording();
+    void toggleFrameRecording();
+    void offlineFrameRendered();
+    /// Rebuilds the compositors when the editor's warps have changed
+    void updateCompositors();
+    void drawFrameStats();
+    void dumpTrace();
 
     int mListenPort;
     std::string mStabilizerHost;
@@ -69,14 +83,46 @@ private:
     int mCurrentDest;
     bool mPrintFrameRate;
 
+    FrameStats mFrameStats;
+    bool mShowFrameStats;
+    /// Overlay text, refreshed a few times a second so it can be read
+    std::vector<std::string> mFrameStatsLines;
+    float mTimeFrameStatsLinesUpdated;
+
     // to allow warping, everything is drawn to fbo
     ci::gl::Fbo mFbo;
-    /// receives warped left head stream
-    ci::gl::Fbo mLeftHead;
-    ci::gl::Fbo mRightHead;
+    /// Warps mFbo into every head of the window at once
+    HeadCompositor mCompositor;
+    /// Each head alone, filling its own viewport, for export
+    std::vector<HeadCompositor> mHeadCompositors;
+    /// mEditor.warpRevision() the compositors were built from
+    int mCompositorRevision;
+    /// receive the warped heads at their own resolutions, only when exported
+    std::vector<ci::gl::Fbo> mHeadFbos;
     // FBO size can be different from window size
     ci::Vec2i mRenderResolution;
-    ci::Vec2i mHeadResolution;
+    /// With --software-render the particles are drawn on the CPU, and
+    /// uploaded to mSoftwareFrame to be drawn into mFbo
+    SpriteRasterizer mRasterizer;
+    ci::gl::Texture mSoftwareFrame;
+
+    /// Screenshots and recorded frames are read back from mFbo and written
+    /// in the background
+    FrameCapture mCapture;
+    /// Where each frame is being recorded to, empty when not recording
+    ci::fs::path mFramesDirectory;
+    int mNumFramesRecorded;
+    /// Publishes the heads to other processes, when configured
+    FrameExport mExport;
+
+    /// Rendering offline: time goes by 1/mOfflineFps a frame, however long
+    /// frames take, until mOfflineDuration seconds (or if negative until
+    /// the replay or scenario ends), and every frame is recorded
+    bool mIsOffline;
+    float mOfflineFps;
+    float mOfflineDuration;
+    int mNumOfflineFrames;
+    double mOfflineStartTime;
 };
 
 VizApp::VizApp()
@@ -92,8 +138,16 @@ VizApp::VizApp()
     , mCurrentOrig(-1)
     , mCurrentDest(-1)
     , mPrintFrameRate(false)
+    , mShowFrameStats(false)
+    , mTimeFrameStatsLinesUpdated(-42)
+    , mCompositorRevision(-1)
     , mRenderResolution(1500, 1500)
-    , mHeadResolution(400, 400)
+    , mNumFramesRecorded(0)
+    , mIsOffline(false)
+    , mOfflineFps(25)
+    , mOfflineDuration(-1)
+    , mNumOfflineFrames(0)
+    , mOfflineStartTime(0)
 {
 }
 
@@ -110,8 +164,7 @@ void VizApp::prepareSettings(Settings * i_settings)
     mEditor.loadSettings();
     mStabilizerHost = mEditor.hostName();
     mRenderResolution = mEditor.renderResolution();
-    mHeadResolution = mEditor.headResolution();
-    i_settings->setWindowSize(mHeadResolution.x*mEditor.numHeads(), mHeadResolution.y);
+    i_settings->setWindowSize(mEditor.windowSize());
 }
 
 std::string dateString()
@@ -125,20 +178,148 @@ std::string dateString()
     return s;
 }
 
+/// Zero padded, so the files sort in order
+std::string frameFilename(int frameNumber)
+{
+    std::ostringstream ss;
+    ss << "frame_" << std::setw(6) << std::setfill('0') << frameNumber << ".png";
+    return ss.str();
+}
+
 void VizApp::setup()
 {
-    RECORD_FRAMES_PREFIX = dateString();
+    Trace::setThreadName("render");
+    AllocationTracker::setFrameThread();
+    Trace::installDumpSignal();
+
+    // --replay <capture file> [--replay-speed <x>] plays back a recorded show,
+    //   ignoring the live input until it ends
+    // --scenario <file> plays a scripted one (see Scenario.h)
+    // --offline <directory> renders every frame of them into directory as
+    //   fast as it can, at --fps <x> (25) for --duration <seconds> or until
+    //   the replay or scenario ends, with nothing taken from the network,
+    //   the clock or a random seed, so each run gives the same frames
+    vector<string> const& args = getArgs();
+    string replayPath;
+    double replaySpeed = 1;
+    string scenarioPath;
+    string offlinePath;
+    for (size_t i=1; i+1<args.size(); ++i)
+    {
+        if (args[i] == "--replay")
+            replayPath = args[++i];
+        else if (args[i] == "--replay-speed")
+            replaySpeed = atof(args[++i].c_str());
+        else if (args[i] == "--scenario")
+            scenarioPath = args[++i];
+        else if (args[i] == "--offline")
+            offlinePath = args[++i];
+        else if (args[i] == "--fps")
+            mOfflineFps = atof(args[++i].c_str());
+        else if (args[i] == "--duration")
+            mOfflineDuration = atof(args[++i].c_str());
+    }
+    // --assert-no-allocations aborts if the frame loop allocates once warmed up
+    if (std::find(args.begin(), args.end(), "--assert-no-allocations") != args.end())
+    {
+        if (AllocationTracker::isCompiledIn())
+            AllocationTracker::setExpectNoAllocations(true);
+        else
+            std::cout << "ERROR: --assert-no-allocations needs a Debug build, or one with VIZ_TRACK_ALLOCATIONS" << endl;
+    }
+    mIsOffline = !offlinePath.empty();
+    // --software-render draws the particles on the CPU
+    const bool softwareRender = std::find(args.begin(), args.end(), "--software-render") != args.end();
 
     mRenderer = new Renderer;
-    mRenderer->setState(State::randomState(0));
-    mOscReceiver.setup(mListenPort, mStabilizerHost, mStabilizerPort);
+    // State::randomState() seeds itself from the clock
+    mRenderer->setState(mIsOffline? State() : State::randomState(0));
+    mRenderer->setFrameStats(&mFrameStats);
+    mOscReceiver.setFrameStats(&mFrameStats);
+    mOscReceiver.setNumParticles(mRenderer->numParticles());
+    if (mIsOffline)
+        mOscReceiver.setupOffline();
+    else
+    {
+        // Scenarios are applied by update(), so decode there too
+        mOscReceiver.setDecodeOnNetworkThread(mEditor.decodeOscOnNetworkThread() && scenarioPath.empty());
+        mOscReceiver.setSocketThreadOptions(mEditor.oscThreadCpu(), mEditor.oscThreadRealtime(), mEditor.oscBusyPoll());
+        mOscReceiver.setup(mListenPort, mStabilizerHost, mStabilizerPort, mEditor.multicastGroup());
+        mOscReceiver.setStatsPublishing(mEditor.statsInterval(), mEditor.monitorHost(), mEditor.monitorPort());
+        if (!mEditor.sharedMemoryName().empty())
+        {
+            if (mOscReceiver.setupSharedMemory(mEditor.sharedMemoryName()))
+                std::cout << "Receiving OSC through shared memory " << mEditor.sharedMemoryName() << endl;
+            else
+                std::cout << "ERROR: could not create shared memory " << mEditor.sharedMemoryName() << endl;
+        }
+    }
+
+    if (!replayPath.empty())
+    {
+        if (mIsOffline? mOscReceiver.startSteppedReplay(replayPath) : mOscReceiver.startReplay(replayPath, replaySpeed))
+            std::cout << "Replaying OSC capture " << replayPath << (mIsOffline? "" : " at speed " + toString(replaySpeed)) << endl;
+        else
+            std::cout << "ERROR: could not read OSC capture " << replayPath << endl;
+    }
+    if (!scenarioPath.empty())
+    {
+        if (mOscReceiver.startScenario(scenarioPath))
+            std::cout << "Playing scenario " << scenarioPath << endl;
+        else
+            std::cout << "ERROR: could not play scenario " << scenarioPath << endl;
+    }
+
     mEditor.setup(mRenderer);
+    if (mEditor.noiseFieldResolution() > 0)
+    {
+        mRenderer->setNoiseField(mEditor.noiseFieldResolution(), mEditor.noiseFieldInterval());
+        std::cout << "Particle noise from a " << mEditor.noiseFieldResolution() << "x" << mEditor.noiseFieldResolution() << " grid every " << mEditor.noiseFieldInterval() << "s" << endl;
+    }
+    mCapture.setup(mEditor.captureThreads());
+    if (mIsOffline)
+    {
+        if (mOfflineDuration < 0 && !mOscReceiver.isPlayingInput())
+            std::cout << "ERROR: --offline needs a --duration, --replay or --scenario" << endl;
+        if (mOfflineFps <= 0)
+        {
+            std::cout << "ERROR: --fps must be positive, using 25" << endl;
+            mOfflineFps = 25;
+        }
+        fs::create_directories(offlinePath);
+        mFramesDirectory = offlinePath;
+        mCapture.setWaitWhenBacklogged(true);
+        // Frames as fast as they can be drawn and encoded
+        disableFrameRate();
+        gl::disableVerticalSync();
+        mOfflineStartTime = getElapsedSeconds();
+        std::cout << "Rendering offline to " << offlinePath << " at " << mOfflineFps << " fps" << endl;
+    }
     mFbo = ci::gl::Fbo(mRenderResolution.x, mRenderResolution.y, true);
-    mLeftHead = ci::gl::Fbo(mHeadResolution.x, mHeadResolution.y, true);
-    mRightHead = ci::gl::Fbo(mHeadResolution.x, mHeadResolution.y, true);
+    if (softwareRender)
+    {
+        mRasterizer.setup(mRenderResolution, Surface8u(loadImage(getAssetPath("blob.png"))), 0);
+        mSoftwareFrame = ci::gl::Texture(mRenderResolution.x, mRenderResolution.y);
+        std::cout << "Drawing the particles on the CPU" << endl;
+    }
+    vector<ci::gl::Fbo*> fbos = boost::assign::list_of(&mFbo);
+    if (!mEditor.frameExportName().empty())
+    {
+        vector<Vec2i> headSizes;
+        for (int headNo = 0; headNo < mEditor.numHeads(); ++headNo)
+            headSizes.push_back(mEditor.headResolution(headNo));
+        if (mExport.create(mEditor.frameExportName(), headSizes))
+        {
+            std::cout << "Exporting frames to shared memory " << mEditor.frameExportName() << endl;
+            for (size_t headNo = 0; headNo < headSizes.size(); ++headNo)
+                mHeadFbos.push_back(ci::gl::Fbo(headSizes[headNo].x, headSizes[headNo].y, true));
+            for (size_t headNo = 0; headNo < mHeadFbos.size(); ++headNo)
+                fbos.push_back(&mHeadFbos[headNo]);
+        }
+        else
+            std::cout << "ERROR: could not create shared memory " << mEditor.frameExportName() << endl;
+    }
 
-    vector<ci::gl::Fbo*> fbos = boost::assign::list_of
-        (&mFbo)(&mLeftHead)(&mRightHead);
     for (auto it=fbos.begin(); it!=fbos.end(); ++it)
     {
         (**it).bindFramebuffer();
@@ -244,6 +425,16 @@ void VizApp::keyDown(ci::app::KeyEvent event)
     }
     else if (key=='.')
         saveScreenshot();
+    else if (key=='o')
+        toggleOscRecording();
+    else if (key=='v' && !mIsOffline)
+        toggleFrameRecording();
+    else if (key=='t')
+        mShowFrameStats = !mShowFrameStats;
+    else if (key=='T')
+        mFrameStats.setFinishGlPerStage(!mFrameStats.finishGlPerStage());
+    else if (key=='x')
+        dumpTrace();
     mEditor.keyPressed(event);
 }
 
@@ -273,10 +464,53 @@ void VizApp::toggleFullScreen()
     }
 }
 
+void VizApp::toggleOscRecording()
+{
+    if (mOscReceiver.isRecording())
+    {
+        mOscReceiver.stopRecording();
+        std::cout << "OSC recording stopped" << endl;
+        return;
+    }
+    fs::path outPath = getHomeDirectory() / ("Ensemble_osc_capture_" + dateString() + ".osccap");
+    if (mOscReceiver.startRecording(outPath.string()))
+        std::cout << "Recording OSC to " << outPath << endl;
+    else
+        std::cout << "ERROR: could not create " << outPath << endl;
+}
+
+void VizApp::toggleFrameRecording()
+{
+    if (!mFramesDirectory.empty())
+    {
+        mFramesDirectory.clear();
+        std::cout << "Frame recording stopped: " << mCapture.status() << endl;
+        return;
+    }
+    fs::path outPath = getHomeDirectory() / ("Ensemble_frames_" + dateString());
+    if (fs::create_directories(outPath))
+    {
+        mFramesDirectory = outPath;
+        mNumFramesRecorded = 0;
+        std::cout << "Recording frames to " << outPath << endl;
+    }
+    else
+        std::cout << "ERROR: could not create " << outPath << endl;
+}
+
+void VizApp::dumpTrace()
+{
+    fs::path outPath = getHomeDirectory() / ("Ensemble_trace_" + dateString() + ".json");
+    if (Trace::dump(outPath.string(), mEditor.traceSeconds()))
+        std::cout << "Trace of the last " << mEditor.traceSeconds() << "s saved to " << outPath << endl;
+    else
+        std::cout << "ERROR: could not write " << outPath << endl;
+}
+
 void VizApp::saveScreenshot()
 {
     using namespace ci;
-    Surface8u screenshot(mFbo.getTexture());
+    TRACE_SCOPE("saveScreenshot");
     // make filename
 
     time_t t = time(0);   // get time now
@@ -284,9 +518,9 @@ void VizApp::saveScreenshot()
     char buf[128];
     strftime(buf, sizeof(buf), "%Y-%m-%d-%HH-%MM-%SS", now);
     string filename = string("Ensemble_visualizer_screenshot_")+buf+"_"+toString(getElapsedFrames())+".png";
-    fs::path outPath = fs::path("~") / filename;
-    writeImage(outPath, screenshot);
-    std::cout << "Screenshot saved to " << outPath << endl;
+    fs::path outPath = getHomeDirectory() / filename;
+    mCapture.capture(mFbo, outPath);
+    std::cout << "Saving screenshot to " << outPath << endl;
 }
 
 void VizApp::update()
@@ -294,12 +528,17 @@ void VizApp::update()
     using namespace ci;
     using namespace ci::app;
 
+    mFrameStats.frameStarted();
+    TRACE_SCOPE("update");
+    if (Trace::takeDumpRequest())
+        dumpTrace();
+
     // Get current time (since application was launched), work out delta since last update,
     // and save new current time
     float currentTime = getElapsedSeconds();
-    //  If recording then fake the current time to have a fixed delta
-    if (RECORD_FRAMES)
-        currentTime = mTimeOfLastUpdate += 0.04;  // [shouldn't it be + and not += ?]
+    //  Offline, time goes by a fixed step per frame
+    if (mIsOffline)
+        currentTime = mNumOfflineFrames / mOfflineFps;
     float timeSinceLastUpdate = currentTime - mTimeOfLastUpdate;
     mTimeOfLastUpdate = currentTime;
 
@@ -307,6 +546,8 @@ void VizApp::update()
     mOscReceiver.update(mTimeOfLastUpdate, timeSinceLastUpdate);
     if (mOscReceiver.hasNewState())
     {
+        ScopedStageTimer timer(&mFrameStats, STAGE_SET_STATE);
+        AllocationScope allocations(ALLOC_STATE);
         mRenderer->setState(mOscReceiver.state());
     }
 
@@ -324,7 +565,22 @@ void VizApp::update()
 
     if (mPrintFrameRate)
     {
-        cout << "timeSinceLastUpdate: " <<timeSinceLastUpdate << "\nfps: " << 1.f/timeSinceLastUpdate << endl;
+        VIZ_LOG("timeSinceLastUpdate: " <<timeSinceLastUpdate << "\nfps: " << 1.f/timeSinceLastUpdate);
+    }
+
+    if (mShowFrameStats && currentTime - mTimeFrameStatsLinesUpdated > 0.25)
+    {
+        mFrameStatsLines.clear();
+        std::string status = mFrameStats.status() + "\n\n" + AllocationTracker::status();
+        if (mCapture.numCaptured() > 0)
+            status += "\n\n" + mCapture.status();
+        if (mExport.isOpen())
+            status += "\n\n" + mExport.status();
+        std::istringstream ss(status);
+        std::string line;
+        while (std::getline(ss, line))
+            mFrameStatsLines.push_back(line);
+        mTimeFrameStatsLinesUpdated = currentTime;
     }
 }
 
@@ -332,6 +588,7 @@ void VizApp::draw()
 {
     using namespace ci;
     using namespace tmb;
+    TRACE_SCOPE("draw");
 
     // + Draw visualization to offscreen mFbo {{{
 
@@ -352,14 +609,45 @@ void VizApp::draw()
         //if (getElapsedFrames()%5==0)
         //    gl::clear( Color( 0, 0, 0 ) );
 
-        gl::enableAlphaBlending();
-        gl::color(ColorA(0, 0, 0, 0.7));
-        gl::drawSolidRect(Rectf(-1, -1, 1, 1));
+        if (mRasterizer.isSetup())
+        {
+            // Faded and drawn on the CPU, then copied over the whole of mFbo
+            mRenderer->drawSoftware(mTimeOfLastUpdate, mRasterizer, 0.7);
+            Vec2i size = mRasterizer.size();
+            mSoftwareFrame.update(Surface8u(const_cast<uint8_t*>(&mRasterizer.rgba8()[0]), size.x, size.y, size.x * 4, SurfaceChannelOrder::RGBA));
+            gl::disableAlphaBlending();
+            gl::color(Color::white());
+            mSoftwareFrame.enableAndBind();
+            // its rows are from the bottom, as mFbo's
+            glBegin(GL_QUADS);
+            {
+                gl::texCoord(0, 0);
+                gl::vertex(Vec2f(-1, -1));
+                gl::texCoord(1, 0);
+                gl::vertex(Vec2f(1, -1));
+                gl::texCoord(1, 1);
+                gl::vertex(Vec2f(1, 1));
+                gl::texCoord(0, 1);
+                gl::vertex(Vec2f(-1, 1));
+            }
+            glEnd();
+            mSoftwareFrame.unbind();
+            mSoftwareFrame.disable();
+            gl::enableAlphaBlending();
+        }
+        else
+        {
+            gl::enableAlphaBlending();
+            gl::color(ColorA(0, 0, 0, 0.7));
+            gl::drawSolidRect(Rectf(-1, -1, 1, 1));
 
-        // Render particles
-        mRenderer->draw(mTimeOfLastUpdate);
+            // Render particles
+            mRenderer->draw(mTimeOfLastUpdate);
+        }
 
         // Render control point editor
+        ScopedStageTimer timer(&mFrameStats, STAGE_EDITOR_OVERLAY);
+        AllocationScope allocations(ALLOC_EDITOR);
         mEditor.draw(mTimeOfLastUpdate);
     }
 
@@ -367,74 +655,124 @@ void VizApp::draw()
 
     // + }}}
 
-    if (RECORD_FRAMES)
+    if (!mFramesDirectory.empty())
     {
-        ci::writeImage(fs::path(RECORD_FRAMES_PATH) / fs::path(RECORD_FRAMES_PREFIX + "_" + toString(gFrameNumber++)+".png"), mFbo.getTexture());
+        mCapture.capture(mFbo, mFramesDirectory / frameFilename(mNumFramesRecorded++));
     }
+    mCapture.update();
 
     gl::clear(Color::black());
     gl::color(Color::white());
 
-    // Warp
-    int numHeads = mEditor.isSecondHeadEnabled()? 2 : 1;
-    vector<gl::Fbo *> headFbos = boost::assign::list_of(&mLeftHead)(&mRightHead);
-    for (int headNo = 0; headNo < numHeads; ++headNo)
+    // Warp every head straight from mFbo into its part of the window
     {
-        headFbos.at(headNo)->bindFramebuffer();
-        gl::clear(ColorA::black());
-        gl::setViewport(headFbos.at(headNo)->getBounds());
+        ScopedStageTimer timer(&mFrameStats, STAGE_COMPOSITE);
+        gl::setViewport(getWindowBounds());
         gl::disableAlphaBlending();
         glMatrixMode(GL_PROJECTION);
         glLoadIdentity();
-        glMultMatrixd(mEditor.warpTransform(headNo));
         glMatrixMode(GL_MODELVIEW);
         glLoadIdentity();
-//      glTranslatef(headNo/float(numHeads), 0, 0);
-        tmb::Quad quad = Quad();
+        updateCompositors();
+        mFbo.bindTexture();
+        mCompositor.draw();
+        mFbo.unbindTexture();
+    }
+
+    // Exported heads are warped again, at their own resolutions
+    if (mExport.isOpen())
+    {
+        ScopedStageTimer timer(&mFrameStats, STAGE_EXPORT_HEADS);
         mFbo.bindTexture();
-        glBegin(GL_QUADS);
+        for (int headNo = 0; headNo < int(mHeadFbos.size()); ++headNo)
         {
-            gl::texCoord(0, 1);
-            gl::vertex(quad.tl);
-            gl::texCoord(1, 1);
-            gl::vertex(quad.tr);
-            gl::texCoord(1, 0);
-            gl::vertex(quad.br);
-            gl::texCoord(0, 0);
-            gl::vertex(quad.bl);
+            mHeadFbos[headNo].bindFramebuffer();
+            gl::clear(ColorA::black());
+            gl::setViewport(mHeadFbos[headNo].getBounds());
+            mHeadCompositors.at(headNo).draw();
+            mHeadFbos[headNo].unbindFramebuffer();
+            mExport.exportHead(headNo, mHeadFbos[headNo], getElapsedFrames());
         }
-        glEnd();
         mFbo.unbindTexture();
-        headFbos.at(headNo)->unbindFramebuffer();
+        gl::setViewport(getWindowBounds());
     }
 
-    // Draw
-    gl::setViewport(getWindowBounds());
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    for (int headNo = 0; headNo < numHeads; ++headNo)
+    if (mShowFrameStats)
+        drawFrameStats();
+    //glFinish();
+
+    // Everything received before this frame's update() is now on its way to the screen
+    mOscReceiver.frameSubmitted();
+    AllocationTracker::frameEnded();
+
+    if (mIsOffline)
+        offlineFrameRendered();
+}
+
+void VizApp::updateCompositors()
+{
+    if (mCompositorRevision == mEditor.warpRevision())
+        return;
+    mCompositorRevision = mEditor.warpRevision();
+    mCompositor.clear();
+    mHeadCompositors.assign(mEditor.numHeads(), HeadCompositor());
+    for (int headNo = 0; headNo < mEditor.numHeads(); ++headNo)
     {
-        float x0 = headNo/float(numHeads) * 2 - 1;
-        float x1 = (headNo+1)/float(numHeads) * 2 - 1;
-        Vec2f tl(x0, 1), tr(x1, 1), br(x1, -1), bl(x0, -1);
-        headFbos.at(headNo)->bindTexture();
-        glBegin(GL_QUADS);
+        ControlPointEditor::Head const& head = mEditor.head(headNo);
+        const Rectf wholeHead(-1, -1, 1, 1);
+        if (head.hasMesh())
+        {
+            mCompositor.addMesh(head.meshVertices, head.meshVertexCount(), mEditor.headBounds(headNo));
+            mHeadCompositors[headNo].addMesh(head.meshVertices, head.meshVertexCount(), wholeHead);
+        }
+        else
         {
-            gl::texCoord(0, 1);
-            gl::vertex(tl);
-            gl::texCoord(1, 1);
-            gl::vertex(tr);
-            gl::texCoord(1, 0);
-            gl::vertex(br);
-            gl::texCoord(0, 0);
-            gl::vertex(bl);
+            mCompositor.addHead(head.warpTransform, mEditor.headBounds(headNo));
+            mHeadCompositors[headNo].addHead(head.warpTransform, wholeHead);
         }
-        glEnd();
-        headFbos.at(headNo)->unbindTexture();
     }
-    //glFinish();
+}
+
+void VizApp::offlineFrameRendered()
+{
+    ++mNumOfflineFrames;
+    const float time = mNumOfflineFrames / mOfflineFps;
+    const double wallTime = getElapsedSeconds() - mOfflineStartTime;
+    const bool finished = mOfflineDuration >= 0
+        ? time >= mOfflineDuration
+        : !mOscReceiver.isPlayingInput();
+    if (finished || mNumOfflineFrames % 250 == 0)
+    {
+        std::cout << "Rendered " << mNumOfflineFrames << " frames (" << time << "s) in "
+                  << wallTime << "s, " << mNumOfflineFrames / wallTime << " fps" << endl;
+    }
+    if (finished)
+        quit();
+}
+
+void VizApp::shutdown()
+{
+    // Write out the frames still being read back or encoded, as the app
+    // may not be destroyed
+    mCapture.flush();
+    mCapture.waitUntilWritten();
+    if (mCapture.numCaptured() > 0)
+        std::cout << mCapture.status() << endl;
+}
+
+void VizApp::drawFrameStats()
+{
+    using namespace ci;
+    // monospaced, so the columns line up
+    static gl::TextureFontRef font = gl::TextureFont::create(Font("Courier New", 16));
+
+    gl::setMatricesWindow(getWindowSize());
+    gl::enableAlphaBlending();
+    gl::color(ColorA(0, 0, 0, 0.6));
+    gl::drawSolidRect(Rectf(0, 0, 560, 20 + 18 * mFrameStatsLines.size()));
+    gl::color(ColorA(1, .6, .45, 1.));
+    for (size_t i=0; i<mFrameStatsLines.size(); ++i)
+        font->drawString(mFrameStatsLines[i], Vec2f(10, 24 + 18 * i));
 }
 
 CINDER_APP_NATIVE( VizApp, ci::app::RendererGl )
@@ -0,0 +1,761 @@
+//
+//  Benchmarks.cpp
+//  EnsembleVisualization
+//
+//  Microbenchmarks of the visualization's hot paths, to catch performance
+//  regressions between releases:
+//    - Renderer::hermiteSpline, and the lookup and spline of interpHermite
+//    - State::update with full note histories, and copying such a State
+//    - OscReceiver::update's decode loop, per message type
+//    - oscpack ReceivedMessage parsing and OutboundPacketStream encoding
+//    - ControlPointEditor::load and save
+//    - homography::find for a warp quad and for a fit to many points
+//    - snoise, one point and a batch at a time, NoiseField's grid and its
+//      lookups, and SpriteRasterizer::render drawing a frame of particles
+//
+//  Before timing anything, snoise is checked against recorded values and
+//  its batch version against the one point version, and
+//  homography::find against fits recorded from OpenCV's findHomography();
+//  if any is off, that is printed and the exit status is 1. With --check
+//  that is all it does: every project runs Benchmarks --check once it is
+//  built, so a change that breaks either fails the build.
+//
+//  Each benchmark is calibrated to run for about 20ms, then repeated; the
+//  median and fastest time per operation over the repetitions are reported.
+//  Results are written as JSON (--out, default benchmark_results.json) with
+//  a table on stdout. Give a previous results file with --baseline to
+//  print the change of each benchmark and exit with status 1 if any got
+//  slower by more than --tolerance (default 0.1, i.e. 10%).
+//
+//  Options:
+//    --check              only check snoise and homography::find
+//    --filter <text>      only run benchmarks whose name contains text
+//    --out <file>         where to write the results
+//    --baseline <file>    results to compare against
+//    --tolerance <x>      allowed slowdown before failing
+//    --json <file>        control points file to load and save a copy of
+//                         (../assets/control_points.json)
+//
+//  Built from every source in src/ but VizApp.cpp by the Benchmarks target
+//  of xcode/Viz.xcodeproj, which the app's target depends on, and by the
+//  Benchmarks project in each vc solution. Run it from this directory, for
+//  the default --json.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <json.h>
+
+#include "State.h"
+#include "Renderer.h"
+#include "ControlPointEditor.h"
+#include "Homography.h"
+#include "SimplexNoise.h"
+#include "NoiseField.h"
+#include "SpriteRasterizer.h"
+#include "OscReceiver.h"
+#include "ConnectionsBlob.h"
+#include "OscSender.h"
+#include "osc/OscOutboundPacketStream.h"
+#include "osc/OscReceivedElements.h"
+
+using namespace std;
+using namespace ci;
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    /// Runs n operations, returning how many seconds they took. Most
+    /// benchmarks time the whole call with timed(); those with set up that
+    /// mustn't count time themselves.
+    typedef std::function<double (long n)> Body;
+
+    const double CALIBRATION_SECONDS = 0.02;
+    const int NUM_REPETITIONS = 7;
+
+    /// Stops the compiler optimizing away results that aren't otherwise used
+    volatile float gSink;
+
+    template <typename F>
+    Body timed(F operation)
+    {
+        return [=](long n) mutable
+        {
+            Clock::time_point start = Clock::now();
+            for (long i=0; i<n; ++i)
+                operation(i);
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        };
+    }
+
+    struct Result
+    {
+        string name;
+        long iterations;
+        double medianNs;
+        double minNs;
+    };
+
+    Result run(string const& name, Body body)
+    {
+        long n = 1;
+        while (body(n) < CALIBRATION_SECONDS && n < (1L << 30))
+            n *= 2;
+        vector<double> nsPerOp;
+        for (int i=0; i<NUM_REPETITIONS; ++i)
+            nsPerOp.push_back(body(n) * 1e9 / n);
+        std::sort(nsPerOp.begin(), nsPerOp.end());
+        Result r;
+        r.name = name;
+        r.iterations = n;
+        r.medianNs = nsPerOp[nsPerOp.size() / 2];
+        r.minNs = nsPerOp.front();
+        return r;
+    }
+
+    /// Swallows what the code under test prints
+    class NullBuffer : public std::streambuf
+    {
+    protected:
+        int overflow(int c) { return c; }
+    };
+
+    /// Every instrument with a full history of recent notes
+    State stateWithFullHistories()
+    {
+        State state = State::randomState(0);
+        for (int i=0; i<NUM_INSTRUMENTS; ++i)
+        {
+            state.instruments[i].notes.clear();
+            for (int k=0; k<State::sMaxNumNotes; ++k)
+                state.instruments[i].notes.push_back(Note(k * 0.01f, 0.5f));
+        }
+        return state;
+    }
+
+    ci::osc::Message noteMessage(int i)
+    {
+        ci::osc::Message m;
+        m.setAddress("/viz/note");
+        m.addIntArg(i % NUM_INSTRUMENTS);
+        m.addFloatArg(0.5f);
+        return m;
+    }
+
+    ci::osc::Message connectionsMessage(int)
+    {
+        ci::osc::Message m;
+        m.setAddress("/viz/connections");
+        m.addIntArg(NUM_INSTRUMENTS);
+        for (int i=0; i<NUM_INSTRUMENTS*NUM_INSTRUMENTS; ++i)
+            m.addFloatArg(i / 64.f);
+        return m;
+    }
+
+    ci::osc::Message connectionsBlobMessage(int)
+    {
+        static vector<char> blob;
+        if (blob.empty())
+            encodeConnectionsBlob(State::randomState(0), NUM_INSTRUMENTS, CONNECTIONS_FLOAT16, blob);
+        ci::osc::Message m;
+        m.setAddress("/viz/connections_blob");
+        m.addIntArg(NUM_INSTRUMENTS);
+        m.addIntArg(CONNECTIONS_FLOAT16);
+        m.addBlobArg(&blob[0], blob.size());
+        return m;
+    }
+
+    ci::osc::Message narrativeMessage(int i)
+    {
+        ci::osc::Message m;
+        m.setAddress("/viz/narrative");
+        m.addFloatArg((i % 100) / 100.f);
+        return m;
+    }
+
+    /// OscReceiver::update() over messages made by makeMessage, which are
+    /// written into its shared memory ring beforehand so that neither the
+    /// sockets nor the encoding are timed
+    Body oscReceiverDecode(std::function<ci::osc::Message (int)> makeMessage)
+    {
+        return [=](long n)
+        {
+            // reused by each run, and always left empty
+            const std::string ring = "/ensemble_viz_benchmark";
+            OscReceiver receiver;
+            receiver.setup(0, "127.0.0.1", 9);
+            receiver.setupSharedMemory(ring);
+            ci::osc::Sender sender;
+            sender.setupSharedMemory(ring);
+            const long BATCH = 1000;
+            double seconds = 0;
+            float elapsedTime = 0;
+            for (long done=0; done<n; done+=BATCH)
+            {
+                for (long i=done; i<std::min(n, done+BATCH); ++i)
+                    sender.sendMessage(makeMessage(int(i)));
+                Clock::time_point start = Clock::now();
+                receiver.update(elapsedTime += 0.001f, 0.001f);
+                receiver.frameSubmitted();
+                seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            }
+            return seconds;
+        };
+    }
+
+    void encodeNote(::osc::OutboundPacketStream& p, int i)
+    {
+        p << ::osc::BeginMessage("/viz/note") << (::osc::int32)(i % NUM_INSTRUMENTS) << 0.5f << ::osc::EndMessage;
+    }
+
+    void encodeConnections(::osc::OutboundPacketStream& p, int)
+    {
+        p << ::osc::BeginMessage("/viz/connections") << (::osc::int32)NUM_INSTRUMENTS;
+        for (int i=0; i<NUM_INSTRUMENTS*NUM_INSTRUMENTS; ++i)
+            p << i / 64.f;
+        p << ::osc::EndMessage;
+    }
+
+    /// Parses a packet the way OscListener does, reading every argument
+    Body parse(void (*encodeMessage)(::osc::OutboundPacketStream&, int))
+    {
+        std::shared_ptr<vector<char> > buffer(new vector<char>(4096));
+        ::osc::OutboundPacketStream p(&(*buffer)[0], buffer->size());
+        encodeMessage(p, 3);
+        const size_t size = p.Size();
+        return timed([=](long)
+        {
+            ::osc::ReceivedPacket packet(&(*buffer)[0], size);
+            ::osc::ReceivedMessage m(packet);
+            float sum = float(strlen(m.AddressPattern()));
+            for (::osc::ReceivedMessage::const_iterator arg = m.ArgumentsBegin(); arg != m.ArgumentsEnd(); ++arg)
+            {
+                if (arg->IsInt32())
+                    sum += arg->AsInt32Unchecked();
+                else if (arg->IsFloat())
+                    sum += arg->AsFloatUnchecked();
+            }
+            gSink = sum;
+        });
+    }
+
+    Body encode(void (*encodeMessage)(::osc::OutboundPacketStream&, int))
+    {
+        std::shared_ptr<vector<char> > buffer(new vector<char>(4096));
+        return timed([=](long i)
+        {
+            ::osc::OutboundPacketStream p(&(*buffer)[0], buffer->size());
+            encodeMessage(p, int(i));
+            gSink = float(p.Size());
+        });
+    }
+
+    /// A soft white disc like blob.png, so as not to need the assets
+    Surface8u blobSprite()
+    {
+        Surface8u sprite(64, 64, true, SurfaceChannelOrder::RGBA);
+        for (int y=0; y<64; ++y)
+            for (int x=0; x<64; ++x)
+            {
+                const float r = Vec2f(x - 31.5f, y - 31.5f).length() / 32;
+                sprite.setPixel(Vec2i(x, y), ColorA8u(255, 255, 255, (uint8_t)(255 * max(0.f, 1 - r) * max(0.f, 1 - r))));
+            }
+        return sprite;
+    }
+
+    /// Sprites sized and placed about as the particles are
+    vector<SpriteRasterizer::Sprite> particleSprites(int n)
+    {
+        vector<SpriteRasterizer::Sprite> sprites;
+        for (int i=0; i<n; ++i)
+        {
+            SpriteRasterizer::Sprite s;
+            s.position = Vec2f(std::sin(i * 0.37f) * 0.9f, std::cos(i * 0.61f) * 0.9f);
+            s.size = 4 + (i % 13) * 4.f;
+            s.alpha = 0.1f;
+            sprites.push_back(s);
+        }
+        return sprites;
+    }
+
+    /// snoise at a few points, from a single precision transliteration of
+    /// particles.vert's snoise() (not read back from the shader), so they
+    /// catch changes to the C++ rather than differences from a GPU
+    struct NoiseSample { float x, y, z, value; };
+    const NoiseSample NOISE_SAMPLES[] =
+    {
+        { 0.1f, 0.2f, 0.3f, -4.75501776e-01f },
+        { -1.7f, 2.3f, 0.5f, -3.47045004e-01f },
+        { 12.5f, -7.25f, 3.f, 4.46383702e-03f },
+        { 0.f, 0.f, 0.f, -4.12198752e-01f },
+        { 100.3f, 42.1f, -8.6f, 5.36030591e-01f },
+        { -250.75f, 13.5f, 190.2f, 2.35067964e-01f },
+        { 0.5f, 0.5f, 0.5f, -2.12058783e-01f },
+        { 3.3f, -0.4f, 17.9f, 1.33764222e-02f },
+    };
+
+    /// Whether snoise matches NOISE_SAMPLES, to within rounding of the last
+    /// bit or two, and its batch versions match it exactly
+    bool checkNoise()
+    {
+        bool ok = true;
+        for (size_t i=0; i<sizeof(NOISE_SAMPLES) / sizeof(NOISE_SAMPLES[0]); ++i)
+        {
+            NoiseSample const& s = NOISE_SAMPLES[i];
+            const float value = snoise(s.x, s.y, s.z);
+            if (std::fabs(value - s.value) > 1e-6f)
+            {
+                fprintf(stderr, "snoise(%g, %g, %g) is %.8g, should be %.8g\n", s.x, s.y, s.z, value, s.value);
+                ok = false;
+            }
+        }
+
+        // an odd count, so the batch has a tail that isn't a whole vector
+        const int n = 4099;
+        vector<float> x(n), y(n), z(n), out(n), slice(n);
+        for (int i=0; i<n; ++i)
+        {
+            const float scale = i % 3 == 0? 2.f : i % 3 == 1? 30.f : 400.f;
+            x[i] = std::sin(i * 0.37f) * scale;
+            y[i] = std::cos(i * 0.61f) * scale;
+            z[i] = std::sin(i * 1.13f + 0.5f) * scale;
+        }
+        snoise(&x[0], &y[0], &z[0], &out[0], n);
+        snoise(&x[0], &y[0], 0.25f, &slice[0], n);
+        int mismatches = 0;
+        for (int i=0; i<n; ++i)
+        {
+            if (out[i] != snoise(x[i], y[i], z[i]))
+                ++mismatches;
+            if (slice[i] != snoise(x[i], y[i], 0.25f))
+                ++mismatches;
+        }
+        if (mismatches > 0)
+        {
+            fprintf(stderr, "snoise %d at a time differs from one at a time in %d of %d points\n", snoiseWidth(), mismatches, 2 * n);
+            ok = false;
+        }
+        return ok;
+    }
+
+    /// Whether homography::find fits src to dst, giving expected to within
+    /// tolerance in each element
+    bool checkFit(const char* name, vector<Vec2f> const& src, vector<Vec2f> const& dst, double const expected[9], double tolerance)
+    {
+        double h[9];
+        if (!homography::find(src, dst, h))
+        {
+            fprintf(stderr, "homography::find found no fit for %s\n", name);
+            return false;
+        }
+        for (int i=0; i<9; ++i)
+            if (!(std::fabs(h[i] - expected[i]) <= tolerance))
+            {
+                fprintf(stderr, "homography::find for %s gave h[%d] %.10g, should be %.10g\n", name, i, h[i], expected[i]);
+                return false;
+            }
+        return true;
+    }
+
+    /// Whether homography::find rejects src and dst, leaving its result alone
+    bool checkNoFit(const char* name, vector<Vec2f> const& src, vector<Vec2f> const& dst)
+    {
+        double h[9];
+        for (int i=0; i<9; ++i)
+            h[i] = 42;
+        bool untouched = true;
+        const bool found = homography::find(src, dst, h);
+        for (int i=0; i<9; ++i)
+            untouched = untouched && h[i] == 42;
+        if (found || !untouched)
+        {
+            fprintf(stderr, "homography::find should have rejected %s\n", name);
+            return false;
+        }
+        return true;
+    }
+
+    template <size_t N>
+    vector<Vec2f> toPoints(float const (&xy)[N][2])
+    {
+        vector<Vec2f> points;
+        for (size_t i=0; i<N; ++i)
+            points.push_back(Vec2f(xy[i][0], xy[i][1]));
+        return points;
+    }
+
+    /// Whether homography::find gives what OpenCV's findHomography() (method
+    /// 0, scaled so h[8] is 1) gave for the same points, and rejects points
+    /// that don't determine a homography
+    bool checkHomography()
+    {
+        bool ok = true;
+
+        // Quads, which determine a homography exactly
+        const float square[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+        const double identity[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+        ok = checkFit("a square to itself", toPoints(square), toPoints(square), identity, 1e-9) && ok;
+
+        const float render[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+        const float head[4][2] = { { -0.82f, -0.74f }, { 0.91f, -0.88f }, { 0.77f, 0.95f }, { -0.93f, 0.81f } };
+        const double headFit[9] = {
+            0.85892939227175846, -0.061926110342660955, -0.088704772060704332,
+            -0.0027098165118503445, 0.83929597900858999, 0.037288633086684467,
+            -0.082840228338693145, 0.0027084457588069568, 1
+        };
+        ok = checkFit("the render to a head's quad", toPoints(render), toPoints(head), headFit, 1e-9) && ok;
+
+        const float screen[4][2] = { { 0, 0 }, { 1920, 0 }, { 1920, 1080 }, { 0, 1080 } };
+        const float pixels[4][2] = { { 103.5f, 57.25f }, { 1811, 12 }, { 1870.75f, 1044 }, { 64, 1001.5f } };
+        const double pixelsFit[9] = {
+            0.81114837672305262, -0.039666934730074953, 103.49999999999972,
+            -0.024085706389282282, 0.82590711888391399, 57.250000000000377,
+            -4.3166504662404402e-05, -4.8325947750015968e-05, 1
+        };
+        ok = checkFit("a quad in pixels", toPoints(screen), toPoints(pixels), pixelsFit, 1e-7) && ok;
+
+        // A 4x4 grid taken through a homography, exactly and then jittered.
+        // findHomography() refines its linear estimate, which find() stops
+        // at, so they only agree closely for the jittered points.
+        const double grid[9] = { 0.9, 0.12, -0.05, -0.08, 1.1, 0.07, 0.15, -0.1, 1 };
+        const float xs[4] = { -1, -0.3f, 0.4f, 1 };
+        const float ys[4] = { -1, -0.25f, 0.5f, 1 };
+        vector<Vec2f> src, dst, jittered;
+        for (int j=0; j<4; ++j)
+            for (int i=0; i<4; ++i)
+            {
+                const double x = xs[i], y = ys[j];
+                const double w = grid[6] * x + grid[7] * y + grid[8];
+                const double u = (grid[0] * x + grid[1] * y + grid[2]) / w;
+                const double v = (grid[3] * x + grid[4] * y + grid[5]) / w;
+                const int k = int(src.size());
+                src.push_back(Vec2f(float(x), float(y)));
+                dst.push_back(Vec2f(float(u), float(v)));
+                jittered.push_back(Vec2f(float(u + std::sin(k * 1.7) * 0.004), float(v + std::cos(k * 2.3) * 0.004)));
+            }
+        const double gridFit[9] = {
+            0.90000000118638623, 0.1200000019812963, -0.050000002962204151,
+            -0.079999996106640811, 1.1000000033821549, 0.070000003085672613,
+            0.14999999443630702, -0.099999987029334353, 1
+        };
+        ok = checkFit("16 points", src, dst, gridFit, 1e-6) && ok;
+        const double jitteredFit[9] = {
+            0.89769975393818913, 0.12018638549534894, -0.050295956402186648,
+            -0.080099992188078326, 1.0995251582064816, 0.070030866401889463,
+            0.14966979245444392, -0.10008351192420208, 1
+        };
+        ok = checkFit("16 jittered points", src, jittered, jitteredFit, 1e-3) && ok;
+
+        // Points that don't determine one
+        const vector<Vec2f> squarePoints = toPoints(square);
+        ok = checkNoFit("three points", vector<Vec2f>(squarePoints.begin(), squarePoints.begin() + 3), vector<Vec2f>(squarePoints.begin(), squarePoints.begin() + 3)) && ok;
+        ok = checkNoFit("fewer points in dst than in src", squarePoints, vector<Vec2f>(squarePoints.begin(), squarePoints.begin() + 3)) && ok;
+        ok = checkNoFit("four points in one place", vector<Vec2f>(4, Vec2f(0.5f, 0.5f)), squarePoints) && ok;
+        const float bent[4][2] = { { 0, 0 }, { 0.5f, 0 }, { 1, 0 }, { 0, 1 } };
+        ok = checkNoFit("a quad with three points in a line", toPoints(bent), squarePoints) && ok;
+        ok = checkNoFit("a square to a quad with three points in a line", squarePoints, toPoints(bent)) && ok;
+        vector<Vec2f> line;
+        for (int i=0; i<16; ++i)
+            line.push_back(Vec2f(i * 0.1f, i * 0.05f));
+        ok = checkNoFit("16 points to a line", src, line) && ok;
+        return ok;
+    }
+
+    bool copyFile(string const& from, string const& to)
+    {
+        ifstream in(from.c_str(), ios::binary);
+        ofstream out(to.c_str(), ios::binary);
+        out << in.rdbuf();
+        return in.good() && out.good();
+    }
+
+    string dateString()
+    {
+        time_t t = time(0);
+        char buf[64];
+        strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+        return buf;
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    string filter;
+    string outPath = "benchmark_results.json";
+    string baselinePath;
+    double tolerance = 0.1;
+    string jsonPath = "../assets/control_points.json";
+    bool checkOnly = false;
+    for (int i=1; i<argc; ++i)
+    {
+        const string arg = argv[i];
+        if (arg == "--check")
+        {
+            checkOnly = true;
+            continue;
+        }
+        if (i+1 == argc)
+        {
+            cerr << "No value given for " << arg << endl;
+            return 2;
+        }
+        const char* value = argv[++i];
+        if (arg == "--filter") filter = value;
+        else if (arg == "--out") outPath = value;
+        else if (arg == "--baseline") baselinePath = value;
+        else if (arg == "--tolerance") tolerance = atof(value);
+        else if (arg == "--json") jsonPath = value;
+        else
+        {
+            cerr << "Unknown option " << arg << endl;
+            return 2;
+        }
+    }
+
+    const bool noiseIsRight = checkNoise();
+    if (!checkHomography() || !noiseIsRight)
+        return 1;
+    if (checkOnly)
+        return 0;
+
+    vector<pair<string, Body> > benchmarks;
+
+    // Splines
+    const Vec2f p0(-0.5f, 0.2f), t0(0.3f, 0.1f), p1(0.4f, -0.6f), t1(-0.2f, 0.3f);
+    benchmarks.push_back(make_pair("Renderer::hermiteSpline segment", timed([=](long i)
+    {
+        gSink = Renderer::hermiteSpline(p0, t0, p1, t1, (i & 1023) / 1024.f).x;
+    })));
+    vector<Vec2f> points;
+    points.push_back(Vec2f(-0.8f, 0.1f));
+    points.push_back(Vec2f(-0.3f, 0.4f));
+    points.push_back(Vec2f(0.2f, 0.3f));
+    points.push_back(Vec2f(0.5f, -0.2f));
+    points.push_back(Vec2f(0.7f, -0.6f));
+    benchmarks.push_back(make_pair("Renderer::hermiteSpline 5 points", timed([=](long i)
+    {
+        gSink = Renderer::hermiteSpline(points, (i & 1023) / 1024.f).x;
+    })));
+    // interpHermite is private and needs a GL context to construct a
+    // Renderer, so this is its body over a map laid out like its own
+    map<int, map<int, vector<Vec2f> > > calculatedPoints;
+    for (int a=0; a<NUM_INSTRUMENTS; ++a)
+        for (int b=0; b<NUM_INSTRUMENTS; ++b)
+            calculatedPoints[a][b] = points;
+    benchmarks.push_back(make_pair("interpHermite lookup and spline", timed([=](long i)
+    {
+        const int a = i % NUM_INSTRUMENTS;
+        const int b = (i / NUM_INSTRUMENTS) % NUM_INSTRUMENTS;
+        gSink = Renderer::hermiteSpline(calculatedPoints.at(a).at(b), (i & 1023) / 1024.f).x;
+    })));
+
+    // State
+    const State fullState = stateWithFullHistories();
+    benchmarks.push_back(make_pair("State::update full histories", [=](long n)
+    {
+        State state = fullState;
+        Clock::time_point start = Clock::now();
+        for (long i=0; i<n; ++i)
+            state.update(5.f, 0.016f);
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }));
+    benchmarks.push_back(make_pair("State::update full histories, a note in and out per instrument", [=](long n)
+    {
+        State state = fullState;
+        float time = 5.f;
+        Clock::time_point start = Clock::now();
+        for (long i=0; i<n; ++i)
+        {
+            time += 0.016f;
+            for (int k=0; k<NUM_INSTRUMENTS; ++k)
+                state.instruments[k].notes.push_back(Note(time, 0.5f));
+            state.update(time, 0.016f);
+        }
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }));
+    benchmarks.push_back(make_pair("State copy full histories", timed([=](long)
+    {
+        State copy = fullState;
+        gSink = copy.narrative;
+    })));
+
+    // OscReceiver, per message
+    benchmarks.push_back(make_pair("OscReceiver::update /viz/note", oscReceiverDecode(noteMessage)));
+    benchmarks.push_back(make_pair("OscReceiver::update /viz/connections", oscReceiverDecode(connectionsMessage)));
+    benchmarks.push_back(make_pair("OscReceiver::update /viz/connections_blob", oscReceiverDecode(connectionsBlobMessage)));
+    benchmarks.push_back(make_pair("OscReceiver::update /viz/narrative", oscReceiverDecode(narrativeMessage)));
+
+    // oscpack
+    benchmarks.push_back(make_pair("ReceivedMessage parse /viz/note", parse(encodeNote)));
+    benchmarks.push_back(make_pair("ReceivedMessage parse /viz/connections", parse(encodeConnections)));
+    benchmarks.push_back(make_pair("OutboundPacketStream encode /viz/note", encode(encodeNote)));
+    benchmarks.push_back(make_pair("OutboundPacketStream encode /viz/connections", encode(encodeConnections)));
+
+    // Warp quads, as solved on every drag in the warp editor
+    vector<Vec2f> square, quad, scattered, fitted;
+    square.push_back(Vec2f(-1, 1));
+    square.push_back(Vec2f(1, 1));
+    square.push_back(Vec2f(1, -1));
+    square.push_back(Vec2f(-1, -1));
+    quad.push_back(Vec2f(-0.9f, 0.8f));
+    quad.push_back(Vec2f(1.f, 1.f));
+    quad.push_back(Vec2f(0.7f, -1.f));
+    quad.push_back(Vec2f(-1.f, -0.6f));
+    for (int i=0; i<32; ++i)
+    {
+        Vec2f p(std::cos(i * 0.7f) * (0.3f + i / 40.f), std::sin(i * 1.3f) * (0.2f + i / 50.f));
+        scattered.push_back(p);
+        fitted.push_back(Vec2f(0.9f * p.x + 0.1f * p.y + 0.05f, 1.1f * p.y - 0.05f * p.x) / (1 + 0.1f * p.x));
+    }
+    benchmarks.push_back(make_pair("homography::find warp quad", timed([=](long)
+    {
+        Matrix44d transform;
+        homography::find(square, quad, transform);
+        gSink = float(transform.m[0]);
+    })));
+    benchmarks.push_back(make_pair("homography::find 32 points", timed([=](long)
+    {
+        Matrix44d transform;
+        homography::find(scattered, fitted, transform);
+        gSink = float(transform.m[0]);
+    })));
+
+    // Particles on the CPU
+    benchmarks.push_back(make_pair("snoise", timed([=](long i)
+    {
+        gSink = snoise(i * 0.013f, i * 0.007f, 0.5f);
+    })));
+    // a batch as Renderer evaluates them, over a slice of the noise
+    std::shared_ptr<vector<float> > noiseX(new vector<float>(1024)), noiseY(new vector<float>(1024)), noiseOut(new vector<float>(1024));
+    for (int i=0; i<1024; ++i)
+    {
+        (*noiseX)[i] = i * 0.013f;
+        (*noiseY)[i] = i * 0.007f;
+    }
+    benchmarks.push_back(make_pair("snoise batch of 1024, per call", timed([=](long i)
+    {
+        snoise(&(*noiseX)[0], &(*noiseY)[0], i * 0.001f, &(*noiseOut)[0], 1024);
+        gSink = (*noiseOut)[0];
+    })));
+    std::shared_ptr<NoiseField> noiseField(new NoiseField);
+    noiseField->setup(64, 0);
+    benchmarks.push_back(make_pair("NoiseField::update 64x64", timed([=](long i)
+    {
+        noiseField->update(i * 0.001f);
+        gSink = noiseField->offsets()[0].x;
+    })));
+    benchmarks.push_back(make_pair("NoiseField::sample", timed([=](long i)
+    {
+        gSink = noiseField->sample(Vec2f((i & 1023) / 512.f - 1, ((i >> 10) & 1023) / 512.f - 1)).x;
+    })));
+    const vector<SpriteRasterizer::Sprite> sprites = particleSprites(30000);
+    std::shared_ptr<SpriteRasterizer> rasterizer(new SpriteRasterizer);
+    rasterizer->setup(Vec2i(1080, 1080), blobSprite(), 0);
+    benchmarks.push_back(make_pair("SpriteRasterizer::render 30000 sprites 1080x1080", timed([=](long)
+    {
+        rasterizer->render(0.7f, sprites);
+        gSink = rasterizer->pixels()[0];
+    })));
+
+    // Control points, on a copy so the real file is never written
+    const string jsonCopy = "benchmark_control_points.json";
+    const bool haveJson = copyFile(jsonPath, jsonCopy);
+    if (!haveJson)
+        cerr << "Could not copy " << jsonPath << ", skipping ControlPointEditor benchmarks" << endl;
+    std::shared_ptr<ControlPointEditor> editor(new ControlPointEditor);
+    editor->setJsonFilename(jsonCopy);
+    if (haveJson)
+    {
+        benchmarks.push_back(make_pair("ControlPointEditor::load", timed([=](long) { editor->load(); })));
+        benchmarks.push_back(make_pair("ControlPointEditor::save", timed([=](long) { editor->save(); })));
+    }
+
+    NullBuffer nullBuffer;
+    vector<Result> results;
+    for (size_t i=0; i<benchmarks.size(); ++i)
+    {
+        if (!filter.empty() && benchmarks[i].first.find(filter) == string::npos)
+            continue;
+        std::streambuf* coutBuffer = cout.rdbuf(&nullBuffer);
+        Result r = run(benchmarks[i].first, benchmarks[i].second);
+        cout.rdbuf(coutBuffer);
+        results.push_back(r);
+        printf("%-64s %12.1f ns/op  (min %10.1f, %ld per repetition)\n", r.name.c_str(), r.medianNs, r.minNs, r.iterations);
+        fflush(stdout);
+    }
+    {
+        // the editor saves when destroyed
+        std::streambuf* coutBuffer = cout.rdbuf(&nullBuffer);
+        benchmarks.clear();
+        editor.reset();
+        cout.rdbuf(coutBuffer);
+        remove(jsonCopy.c_str());
+    }
+
+    Json::Value jRoot;
+    jRoot["date"] = dateString();
+    Json::Value& jResults = jRoot["benchmarks"];
+    jResults = Json::Value(Json::arrayValue);
+    for (size_t i=0; i<results.size(); ++i)
+    {
+        Json::Value jResult;
+        jResult["name"] = results[i].name;
+        jResult["ns per op"] = results[i].medianNs;
+        jResult["min ns per op"] = results[i].minNs;
+        jResult["iterations"] = int(results[i].iterations);
+        jResult["repetitions"] = NUM_REPETITIONS;
+        jResults.append(jResult);
+    }
+    ofstream out(outPath.c_str());
+    out << jRoot;
+    if (!out.good())
+    {
+        cerr << "Could not write " << outPath << endl;
+        return 2;
+    }
+    cout << "Results written to " << outPath << endl;
+
+    if (baselinePath.empty())
+        return 0;
+    Json::Value jBaseline;
+    Json::Reader reader;
+    ifstream in(baselinePath.c_str());
+    if (!reader.parse(in, jBaseline))
+    {
+        cerr << "Could not read " << baselinePath << endl;
+        return 2;
+    }
+    map<string, double> baseline;
+    Json::Value const& jBaselineResults = jBaseline["benchmarks"];
+    for (Json::Value::ArrayIndex i=0; i<jBaselineResults.size(); ++i)
+        baseline[jBaselineResults[i]["name"].asString()] = jBaselineResults[i]["ns per op"].asDouble();
+    bool regressed = false;
+    cout << "\nAgainst " << baselinePath << " (" << jBaseline["date"].asString() << "):" << endl;
+    for (size_t i=0; i<results.size(); ++i)
+    {
+        map<string, double>::const_iterator it = baseline.find(results[i].name);
+        if (it == baseline.end() || it->second <= 0)
+            continue;
+        const double change = results[i].medianNs / it->second - 1;
+        const bool slower = change > tolerance;
+        regressed = regressed || slower;
+        printf("%-64s %+7.1f%%%s\n", results[i].name.c_str(), change * 100, slower? "  REGRESSION" : "");
+    }
+    return regressed? 1 : 0;
+}
@@ -0,0 +1,593 @@
+//
+//  StabilizerStandIn.cpp
+//  EnsembleVisualization
+//
+//  Command line tool that pretends to be the stabilizer so the receive path
+//  of the visualization can be load tested without the real one.
+//
+//  It sends /viz/note, /viz/connections, /viz/narrative and /viz/debug at
+//  the requested rates, answers the /viz/listen_port handshake by sending to
+//  whatever port the visualization announces (or to its multicast group if it
+//  announces /viz/listen_multicast instead), and every report interval
+//  sends /viz/ping <seq>. The visualization answers /viz/pong <seq> <count>
+//  with the number of messages it has taken off its queue, from which we
+//  print the packets per second it actually sustained. /viz/stats from the
+//  visualization is printed as it arrives.
+//
+//  With --shm the well formed messages go through the visualization's shared
+//  memory ring instead of UDP (its "shared memory name" setting).
+//
+//  Patterns:
+//    steady       messages evenly spread over time
+//    bursty       each second's worth of messages sent in one burst
+//    adversarial  steady, with malformed messages and packets mixed in
+//                 (out of range values, wrong types and argument counts,
+//                 unknown addresses, truncated packets, garbage bytes)
+//
+//  Built from the OSC block, along with the app, by the StabilizerStandIn
+//  target of xcode/Viz.xcodeproj and the StabilizerStandIn project in each
+//  vc solution. It only needs Cinder's headers, so elsewhere, e.g. on Linux:
+//    g++ -O2 -std=c++11 -DOSC_HOST_LITTLE_ENDIAN -Dx86_64
+//        -I../blocks/OSC/src -I$CINDER/include StabilizerStandIn.cpp
+//        ../blocks/OSC/src/*.cpp ../blocks/OSC/src/ip/IpEndpointName.cpp
+//        ../blocks/OSC/src/ip/posix/*.cpp ../blocks/OSC/src/osc/OscTypes.cpp
+//        ../blocks/OSC/src/osc/OscOutboundPacketStream.cpp
+//        ../blocks/OSC/src/osc/OscReceivedElements.cpp -lpthread
+//        -o StabilizerStandIn
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OscListener.h"
+#include "OscSender.h"
+#include "osc/OscOutboundPacketStream.h"
+#include "ip/UdpSocket.h"
+
+using namespace std;
+using namespace ci::osc;
+
+namespace
+{
+    /// Must match State.h
+    const int NUM_INSTRUMENTS = 8;
+
+    typedef std::chrono::steady_clock Clock;
+
+    double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    struct Options
+    {
+        string host;
+        int vizPort;
+        int stabilizerPort;
+        double noteRate;
+        double connectionsRate;
+        double narrativeRate;
+        double debugRate;
+        string pattern;
+        /// fraction of messages that are malformed in the adversarial pattern
+        double malformedFraction;
+        double duration;
+        double reportInterval;
+        string sharedMemoryName;
+
+        Options()
+        : host("127.0.0.1")
+        , vizPort(12378)
+        , stabilizerPort(1123)
+        , noteRate(200)
+        , connectionsRate(30)
+        , narrativeRate(30)
+        , debugRate(0.2)
+        , pattern("steady")
+        , malformedFraction(0.1)
+        , duration(0)
+        , reportInterval(1)
+        {}
+    };
+
+    void printUsage()
+    {
+        Options o;
+        cout << "usage: StabilizerStandIn [options]\n"
+             << "  --host <name>            visualization host (" << o.host << ")\n"
+             << "  --port <n>               visualization port until it announces one (" << o.vizPort << ")\n"
+             << "  --stabilizer-port <n>    port we listen on, as the stabilizer would (" << o.stabilizerPort << ")\n"
+             << "  --notes <per second>     /viz/note rate (" << o.noteRate << ")\n"
+             << "  --connections <per s>    /viz/connections rate (" << o.connectionsRate << ")\n"
+             << "  --narrative <per s>      /viz/narrative rate (" << o.narrativeRate << ")\n"
+             << "  --debug <per s>          /viz/debug rate (" << o.debugRate << ")\n"
+             << "  --pattern <name>         steady, bursty or adversarial (" << o.pattern << ")\n"
+             << "  --malformed <fraction>   share of malformed messages when adversarial (" << o.malformedFraction << ")\n"
+             << "  --duration <s>           stop after this long, 0 to run until killed (" << o.duration << ")\n"
+             << "  --report <s>             report interval (" << o.reportInterval << ")\n"
+             << "  --shm <name>             send through this shared memory ring instead of UDP\n";
+    }
+
+    bool parseOptions(int argc, char** argv, Options& o)
+    {
+        for (int i=1; i<argc; ++i)
+        {
+            string arg = argv[i];
+            if (arg == "--help" || arg == "-h" || i+1 >= argc)
+                return false;
+            string value = argv[++i];
+            if (arg == "--host") o.host = value;
+            else if (arg == "--port") o.vizPort = atoi(value.c_str());
+            else if (arg == "--stabilizer-port") o.stabilizerPort = atoi(value.c_str());
+            else if (arg == "--notes") o.noteRate = atof(value.c_str());
+            else if (arg == "--connections") o.connectionsRate = atof(value.c_str());
+            else if (arg == "--narrative") o.narrativeRate = atof(value.c_str());
+            else if (arg == "--debug") o.debugRate = atof(value.c_str());
+            else if (arg == "--pattern") o.pattern = value;
+            else if (arg == "--malformed") o.malformedFraction = atof(value.c_str());
+            else if (arg == "--duration") o.duration = atof(value.c_str());
+            else if (arg == "--report") o.reportInterval = atof(value.c_str());
+            else if (arg == "--shm") o.sharedMemoryName = value;
+            else
+                return false;
+        }
+        return o.pattern == "steady" || o.pattern == "bursty" || o.pattern == "adversarial";
+    }
+
+
+    /// What we have heard back from the visualization
+    class Replies
+    {
+    public:
+        Replies(int listenPort, std::string const& defaultVizHost, int defaultVizPort)
+        : mVizHost(defaultVizHost)
+        , mVizPort(defaultVizPort)
+        , mHandshakeReceived(false)
+        {
+            mListener.setup(listenPort);
+            mListener.registerMessageReceived(this, &Replies::onMessage);
+        }
+
+        std::string vizHost() const
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            return mVizHost;
+        }
+
+        int vizPort() const
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            return mVizPort;
+        }
+
+        bool handshakeReceived() const
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            return mHandshakeReceived;
+        }
+
+        /// Returns the pongs received since last called
+        vector<pair<int, long> > takePongs()
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            vector<pair<int, long> > pongs;
+            pongs.swap(mPongs);
+            return pongs;
+        }
+
+    private:
+        void onMessage(const Message* m)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (m->getAddress() == "/viz/listen_port"
+                && m->getNumArgs() >= 1
+                && m->getArgType(0) == TYPE_INT32)
+            {
+                if (!mHandshakeReceived || mVizPort != m->getArgAsInt32(0))
+                    cout << "Handshake: visualization listening on port " << m->getArgAsInt32(0) << endl;
+                mVizPort = m->getArgAsInt32(0);
+                mHandshakeReceived = true;
+            }
+            else if (m->getAddress() == "/viz/listen_multicast"
+                     && m->getNumArgs() >= 2
+                     && m->getArgType(0) == TYPE_STRING
+                     && m->getArgType(1) == TYPE_INT32)
+            {
+                if (!mHandshakeReceived || mVizHost != m->getArgAsString(0) || mVizPort != m->getArgAsInt32(1))
+                    cout << "Handshake: visualization listening on multicast group " << m->getArgAsString(0) << ':' << m->getArgAsInt32(1) << endl;
+                mVizHost = m->getArgAsString(0);
+                mVizPort = m->getArgAsInt32(1);
+                mHandshakeReceived = true;
+            }
+            else if (m->getAddress() == "/viz/pong"
+                     && m->getNumArgs() >= 2
+                     && m->getArgType(0) == TYPE_INT32
+                     && m->getArgType(1) == TYPE_INT32)
+            {
+                mPongs.push_back(make_pair(m->getArgAsInt32(0), long(m->getArgAsInt32(1))));
+            }
+            else if (m->getAddress() == "/viz/stats"
+                     && m->getNumArgs() >= 9)
+            {
+                try
+                {
+                    printf("viz stats: frame %.2f/%.2f/%.2f ms (mean/p50/p99)  %d particles  %.0f pkt/s  queue %d  dropped %d  latency %.2f/%.2f ms (p50/p99)\n",
+                           m->getArgAsFloat(0), m->getArgAsFloat(1), m->getArgAsFloat(2),
+                           m->getArgAsInt32(3), m->getArgAsFloat(4), m->getArgAsInt32(5),
+                           m->getArgAsInt32(6), m->getArgAsFloat(7), m->getArgAsFloat(8));
+                    fflush(stdout);
+                }
+                catch (OscExc const&)
+                {
+                }
+            }
+        }
+
+        Listener mListener;
+        mutable std::mutex mMutex;
+        std::string mVizHost;
+        int mVizPort;
+        bool mHandshakeReceived;
+        vector<pair<int, long> > mPongs;
+    };
+
+
+    /// Sends well formed messages through ci::osc::Sender and malformed
+    /// ones as raw packets straight onto a socket
+    class Generator
+    {
+    public:
+        Generator(Options const& options)
+        : mOptions(options)
+        , mPort(0)
+        , mRandom(42)
+        , mPacketsSent(0)
+        , mMalformedPacketsSent(0)
+        , mNarrative(0)
+        {
+            mNames.push_back("violin 1");
+            mNames.push_back("violin 2");
+            mNames.push_back("viola");
+            mNames.push_back("cello");
+        }
+
+        void setDestination(std::string const& host, int port)
+        {
+            if (host == mHost && port == mPort)
+                return;
+            mSender.setup(host, port);
+            mRawSocket = std::shared_ptr<UdpTransmitSocket>(new UdpTransmitSocket(IpEndpointName(host.c_str(), port), false));
+            mHost = host;
+            mPort = port;
+        }
+
+        /// Keep trying until the visualization has created the ring
+        bool setupSharedMemory()
+        {
+            return mSender.setupSharedMemory(mOptions.sharedMemoryName);
+        }
+
+        void sendNote()
+        {
+            if (malformed())
+                return sendMalformed();
+            Message m;
+            m.setAddress("/viz/note");
+            m.addIntArg(randomInt(0, NUM_INSTRUMENTS-1));
+            m.addFloatArg(randomFloat());
+            send(m);
+        }
+
+        void sendConnections()
+        {
+            if (malformed())
+                return sendMalformed();
+            Message m;
+            m.setAddress("/viz/connections");
+            m.addIntArg(NUM_INSTRUMENTS);
+            for (int i=0; i<NUM_INSTRUMENTS*NUM_INSTRUMENTS; ++i)
+                m.addFloatArg(randomFloat());
+            send(m);
+        }
+
+        void sendNarrative()
+        {
+            if (malformed())
+                return sendMalformed();
+            mNarrative += 0.001f;
+            if (mNarrative > 1)
+                mNarrative = 0;
+            Message m;
+            m.setAddress("/viz/narrative");
+            m.addFloatArg(mNarrative);
+            send(m);
+        }
+
+        void sendDebug()
+        {
+            Message m;
+            m.setAddress("/viz/debug");
+            m.addIntArg(0);
+            for (size_t i=0; i<mNames.size(); ++i)
+                m.addStringArg(mNames[i]);
+            send(m);
+        }
+
+        void sendPing(int seq)
+        {
+            Message m;
+            m.setAddress("/viz/ping");
+            m.addIntArg(seq);
+            send(m);
+        }
+
+        /// Packets the receiver could have decoded and counted
+        long packetsSent() const { return mPacketsSent; }
+        /// Packets the receiver's OSC parser should reject outright
+        long malformedPacketsSent() const { return mMalformedPacketsSent; }
+
+    private:
+        void send(Message const& m)
+        {
+            mSender.sendMessage(m);
+            ++mPacketsSent;
+        }
+
+        bool malformed()
+        {
+            return mOptions.pattern == "adversarial" && randomFloat() < mOptions.malformedFraction;
+        }
+
+        void sendMalformed()
+        {
+            Message m;
+            switch (randomInt(0, 8))
+            {
+                case 0:
+                    // instrument out of range
+                    m.setAddress("/viz/note");
+                    m.addIntArg(randomInt(0, 1) ? -1 : NUM_INSTRUMENTS + randomInt(0, 1000));
+                    m.addFloatArg(randomFloat());
+                    break;
+                case 1:
+                    // missing arguments
+                    m.setAddress(randomInt(0, 1) ? "/viz/note" : "/viz/narrative");
+                    break;
+                case 2:
+                    // wrong argument types
+                    m.setAddress("/viz/note");
+                    m.addFloatArg(randomFloat());
+                    m.addStringArg("loud");
+                    break;
+                case 3:
+                    // more instruments than the visualization has
+                    m.setAddress("/viz/connections");
+                    m.addIntArg(NUM_INSTRUMENTS + 1);
+                    for (int i=0; i<(NUM_INSTRUMENTS+1)*(NUM_INSTRUMENTS+1); ++i)
+                        m.addFloatArg(randomFloat());
+                    break;
+                case 4:
+                    // argument count disagrees with the instrument count
+                    m.setAddress("/viz/connections");
+                    m.addIntArg(NUM_INSTRUMENTS);
+                    for (int i=0; i<randomInt(0, NUM_INSTRUMENTS*NUM_INSTRUMENTS); ++i)
+                        m.addFloatArg(randomFloat());
+                    break;
+                case 5:
+                    // right count, wrong types
+                    m.setAddress("/viz/connections");
+                    m.addIntArg(2);
+                    m.addFloatArg(0.5f);
+                    m.addStringArg("x");
+                    m.addIntArg(3);
+                    m.addFloatArg(0.5f);
+                    break;
+                case 6:
+                    // nobody listens to this
+                    m.setAddress("/viz/unknown");
+                    m.addIntArg(randomInt(0, 100));
+                    break;
+                case 7:
+                    sendTruncatedPacket();
+                    return;
+                default:
+                    sendGarbagePacket();
+                    return;
+            }
+            send(m);
+        }
+
+        void sendTruncatedPacket()
+        {
+            char buffer[1024];
+            ::osc::OutboundPacketStream p(buffer, sizeof(buffer));
+            p << ::osc::BeginMessage("/viz/note") << int(1) << 0.5f << ::osc::EndMessage;
+            // cut into the argument data, keeping 4 byte alignment
+            int size = int(p.Size()) - 4 * randomInt(1, 2);
+            mRawSocket->Send(p.Data(), size);
+            ++mMalformedPacketsSent;
+        }
+
+        void sendGarbagePacket()
+        {
+            char buffer[64];
+            int size = 4 * randomInt(1, sizeof(buffer)/4);
+            for (int i=0; i<size; ++i)
+                buffer[i] = char(randomInt(0, 255));
+            // make it look like a message so it gets past the first check
+            buffer[0] = '/';
+            mRawSocket->Send(buffer, size);
+            ++mMalformedPacketsSent;
+        }
+
+        int randomInt(int lo, int hi)
+        {
+            return std::uniform_int_distribution<int>(lo, hi)(mRandom);
+        }
+
+        float randomFloat()
+        {
+            return std::uniform_real_distribution<float>(0, 1)(mRandom);
+        }
+
+        Options mOptions;
+        std::string mHost;
+        int mPort;
+        Sender mSender;
+        std::shared_ptr<UdpTransmitSocket> mRawSocket;
+        std::mt19937 mRandom;
+        long mPacketsSent;
+        long mMalformedPacketsSent;
+        float mNarrative;
+        vector<string> mNames;
+    };
+
+
+    /// Decides how many messages of one kind are due
+    class Schedule
+    {
+    public:
+        Schedule(double rate, bool bursty)
+        : mRate(rate)
+        , mBursty(bursty)
+        , mSent(0)
+        {}
+
+        /// Number of messages to send now, elapsed seconds since start
+        long due(double elapsed)
+        {
+            // bursty sends each second's messages at the start of it
+            double t = mBursty ? floor(elapsed) + 1 : elapsed;
+            long target = long(mRate * t);
+            long n = target - mSent;
+            mSent = target;
+            return n > 0 ? n : 0;
+        }
+
+    private:
+        double mRate;
+        bool mBursty;
+        long mSent;
+    };
+}
+
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    Replies replies(options.stabilizerPort, options.host, options.vizPort);
+    Generator generator(options);
+    generator.setDestination(replies.vizHost(), replies.vizPort());
+
+    const bool bursty = options.pattern == "bursty";
+    Schedule notes(options.noteRate, bursty);
+    Schedule connections(options.connectionsRate, bursty);
+    Schedule narrative(options.narrativeRate, bursty);
+    Schedule debug(options.debugRate, bursty);
+
+    cout << "Sending " << options.pattern << " traffic to " << options.host << ':' << options.vizPort
+         << " (until it announces its port on " << options.stabilizerPort << ")" << endl;
+
+    // sent packet count at each ping, so pongs can be matched up
+    map<int, long> sentAtPing;
+    int nextPing = 0;
+    double nextReportTime = options.reportInterval;
+
+    bool haveFirstPong = false;
+    double firstPongTime = 0;
+    long firstPongCount = 0;
+    double lastPongTime = 0;
+    long lastPongCount = 0;
+    long lastPongSent = 0;
+
+    bool sharedMemoryIsSetup = false;
+    double nextSharedMemoryAttempt = 0;
+
+    const Clock::time_point start = Clock::now();
+    while (options.duration <= 0 || secondsSince(start) < options.duration)
+    {
+        const double elapsed = secondsSince(start);
+        generator.setDestination(replies.vizHost(), replies.vizPort());
+        if (!options.sharedMemoryName.empty() && !sharedMemoryIsSetup && elapsed >= nextSharedMemoryAttempt)
+        {
+            sharedMemoryIsSetup = generator.setupSharedMemory();
+            if (sharedMemoryIsSetup)
+                cout << "Sending through shared memory " << options.sharedMemoryName << endl;
+            nextSharedMemoryAttempt = elapsed + 1;
+        }
+
+        for (long i=notes.due(elapsed); i>0; --i)
+            generator.sendNote();
+        for (long i=connections.due(elapsed); i>0; --i)
+            generator.sendConnections();
+        for (long i=narrative.due(elapsed); i>0; --i)
+            generator.sendNarrative();
+        for (long i=debug.due(elapsed); i>0; --i)
+            generator.sendDebug();
+
+        if (elapsed >= nextReportTime)
+        {
+            sentAtPing[nextPing] = generator.packetsSent() + 1;
+            generator.sendPing(nextPing++);
+            nextReportTime += options.reportInterval;
+        }
+
+        vector<pair<int, long> > pongs = replies.takePongs();
+        for (size_t i=0; i<pongs.size(); ++i)
+        {
+            const double t = secondsSince(start);
+            const long received = pongs[i].second;
+            const long sent = sentAtPing.count(pongs[i].first) ? sentAtPing[pongs[i].first] : 0;
+            sentAtPing.erase(pongs[i].first);
+            if (haveFirstPong && t > lastPongTime)
+            {
+                const double dt = t - lastPongTime;
+                printf("sent %8.0f pkt/s   receiver sustained %8.0f pkt/s   lost %ld of %ld   (%ld malformed sent so far)\n",
+                       (sent - lastPongSent) / dt,
+                       (received - lastPongCount) / dt,
+                       (sent - lastPongSent) - (received - lastPongCount),
+                       sent - lastPongSent,
+                       generator.malformedPacketsSent());
+                fflush(stdout);
+            }
+            else if (!haveFirstPong)
+            {
+                haveFirstPong = true;
+                firstPongTime = t;
+                firstPongCount = received;
+            }
+            lastPongTime = t;
+            lastPongCount = received;
+            lastPongSent = sent;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    cout << "Sent " << generator.packetsSent() << " packets and "
+         << generator.malformedPacketsSent() << " malformed packets" << endl;
+    if (!replies.handshakeReceived())
+        cout << "Never received /viz/listen_port from the visualization" << endl;
+    if (haveFirstPong && lastPongTime > firstPongTime)
+        cout << "Receiver sustained " << (lastPongCount - firstPongCount) / (lastPongTime - firstPongTime)
+             << " packets per second overall" << endl;
+    else
+        cout << "No /viz/pong replies, so the receive rate is unknown" << endl;
+    return 0;
+}